@@ -1,2 +1,2 @@
-clang main.c glad_gl.c -I inc -Ofast -lglfw -lm -o wiggle
+clang main.c glad_gl.c -I inc -Ofast -lglfw -lm -lpthread -ldl -o wiggle
 ./wiggle
\ No newline at end of file
@@ -0,0 +1,607 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Console benchmarks, run with: ./wiggle --bench <name>
+    These run before any window or GL context is created.
+
+    Requires menger.h, raster.h, mat.h, vec_ts.h, vec_soa.h, fmath.h and urandf() from main.c
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdlib.h>
+
+double bNow(); // monotonic seconds
+int    benchRun(const char* name); // returns 0 if the benchmark name is unknown, 2 if a correctness check failed
+float  urandf();
+
+//
+
+double bNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void benchMenger()
+{
+    printf("unit = exposed unit quads, opt = welded + cache ordered, merge = opt + greedy rectangles\n\n");
+    printf("level | gen ms   | triangles unit > opt > merge   | vertices unit > opt > merge    | ACMR unit > opt > merge\n");
+    for(GLuint l = 0; l <= MENGER_MAX_LEVEL; l++)
+    {
+        const GLuint faces = mengerCountFaces(l);
+        MengerMesh opt, mrg;
+        const double st = bNow();
+        if(mengerGenerate(&opt, l, MENGER_OPTIMISE) == 0){return;}
+        const double et = bNow() - st;
+        if(mengerGenerate(&mrg, l, MENGER_OPTIMISE | MENGER_MERGE) == 0){mengerFree(&opt); return;}
+
+        // the unit quad mesh is what an unwelded generator would draw, 4 vertices a face in emit order
+        GLuint* unit = malloc(faces*6 * sizeof(GLuint));
+        if(unit == NULL){mengerFree(&opt); mengerFree(&mrg); return;}
+        for(GLuint i = 0; i < faces; i++)
+        {
+            GLuint* ip = &unit[i*6];
+            ip[0] = i*4, ip[1] = i*4+1, ip[2] = i*4+2;
+            ip[3] = i*4, ip[4] = i*4+2, ip[5] = i*4+3;
+        }
+        const float uacmr = mengerACMR(unit, faces*6, faces*4, MENGER_CACHE_SIZE);
+        const float oacmr = mengerACMR(opt.indices, opt.numind, opt.numvert, MENGER_CACHE_SIZE);
+        const float macmr = mengerACMR(mrg.indices, mrg.numind, mrg.numvert, MENGER_CACHE_SIZE);
+        free(unit);
+
+        printf("L%-4u | %-8.2f | %8u > %8u > %-8u | %8u > %8u > %-8u | %.2f > %.2f > %.2f\n",
+            l, et*1000.0, faces*2, opt.numind/3, mrg.numind/3, faces*4, opt.numvert, mrg.numvert, uacmr, oacmr, macmr);
+        mengerFree(&opt);
+        mengerFree(&mrg);
+    }
+}
+
+void benchRng()
+{
+    // the sums keep the loops from being optimised out and double as a sanity check on the mean
+    const unsigned n = 10000000;
+    double st, et, sum;
+
+    printf("generator        | calls    | ns/call  | M/s      | mean\n");
+
+    srand(1); sum = 0.0;
+    st = bNow();
+    for(unsigned i = 0; i < n; i++){sum += (float)rand() * (1.f/(float)RAND_MAX);}
+    et = bNow() - st;
+    printf("rand()           | %-8u | %-8.2f | %-8.1f | %.4f\n", n, et*1e9/n, n/et*1e-6, sum/n);
+
+    int s = 1; sum = 0.0;
+    st = bNow();
+    for(unsigned i = 0; i < n; i++){sum += randf(&s);}
+    et = bNow() - st;
+    printf("randf()          | %-8u | %-8.2f | %-8.1f | %.4f\n", n, et*1e9/n, n/et*1e-6, sum/n);
+
+    const uint64_t key = crandKey(1, 0);
+    uint64_t ctr = 0; sum = 0.0;
+    st = bNow();
+    for(unsigned i = 0; i < n; i++){sum += crandf(key, &ctr);}
+    et = bNow() - st;
+    printf("crandf()         | %-8u | %-8.2f | %-8.1f | %.4f\n", n, et*1e9/n, n/et*1e-6, sum/n);
+
+    ctr = 0; sum = 0.0;
+    st = bNow();
+    for(unsigned i = 0; i < n; i++){sum += crandr(key, &ctr, 17);}
+    et = bNow() - st;
+    printf("crandr(17)       | %-8u | %-8.2f | %-8.1f | %.4f\n", n, et*1e9/n, n/et*1e-6, sum/n);
+
+    sum = 0.0;
+    st = bNow();
+    for(unsigned i = 0; i < n; i++){sum += urandf();}
+    et = bNow() - st;
+    printf("urandf()         | %-8u | %-8.2f | %-8.1f | %.4f\n", n, et*1e9/n, n/et*1e-6, sum/n);
+}
+
+void benchRaster()
+{
+    // one L3 frame at 1024x768 from the start view, Phong lit, to show the thread scaling
+    MengerMesh m;
+    if(mengerGenerate(&m, 3, MENGER_OPTIMISE) == 0){return;}
+    mat proj, view, normalmat;
+    mIdent(&proj);
+    mPerspective(&proj, 60.0f, 1024.f/768.f, 0.01f, 333.f);
+    mIdent(&view);
+    mTranslate(&view, 0.f, 0.f, -14.f);
+    mRotate(&view, d2PI + 0.3f, 1.f, 0.f, 0.f);
+    mRotate(&view, 0.4f, 0.f, 0.f, 1.f);
+    mNormal(&normalmat, &view);
+    const float light[] = {4.f, 8.f, 4.f}, col[] = {0.7f, 0.4f, 0.2f};
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("L3 %u triangles at 1024x768, %ld cores online\n\n", m.numind/3, cores);
+    printf("threads | spans    | ms/frame | Mtri/s   | speedup\n");
+    double base = 0.0;
+    for(unsigned th = 1; th <= RASTER_MAX_THREADS; th *= 2)
+    {
+        for(int k = 0; k < 2; k++)
+        {
+            Raster r;
+            if(rasterInit(&r, th) == 0){mengerFree(&m); return;}
+            if(k == 1 && r.rasterTile == rasterTileBase){rasterFree(&r); continue;} // no AVX2
+            r.rasterTile = k == 0 ? rasterTileBase : r.rasterTile;
+            rasterMesh(&r, m.vertices, m.normals, m.indices, m.numvert, m.numind);
+            if(rasterResize(&r, 1024, 768) == 0){rasterFree(&r); mengerFree(&m); return;}
+            rasterDraw(&r, &view, &normalmat, &proj, light, col, 1.f, RASTER_PHONG, 0); // warm up
+            unsigned n = 0;
+            const double st = bNow();
+            double et;
+            do{rasterDraw(&r, &view, &normalmat, &proj, light, col, 1.f, RASTER_PHONG, 0); n++;}while((et = bNow() - st) < 1.0);
+            const double ms = et * 1000.0 / n;
+            if(base == 0.0){base = ms;}
+            printf("%-7u | %-8s | %-8.2f | %-8.1f | %.2fx\n", th, k == 0 ? "baseline" : "AVX2", ms, (m.numind/3) / ms * 1e-3, base / ms);
+            rasterFree(&r);
+        }
+        if(th >= (unsigned)cores * 2){break;}
+    }
+    mengerFree(&m);
+}
+
+// every mat.h kernel behind one signature, r from a and the parameters in b, so all are timed through the same indirect call
+typedef void (*bMatFn)(mat* r, const mat* a, const mat* b);
+void bMulBase(mat* r, const mat* a, const mat* b){mMulBase(r, a, b);}
+void bMulDispatch(mat* r, const mat* a, const mat* b){mMul(r, a, b);}
+void bScaleBase(mat* r, const mat* a, const mat* b){*r = *a; mScaleBase(r, b->m[0][0], b->m[0][1], b->m[0][2]);}
+void bScale(mat* r, const mat* a, const mat* b){*r = *a; mScale(r, b->m[0][0], b->m[0][1], b->m[0][2]);}
+void bTranslateBase(mat* r, const mat* a, const mat* b){*r = *a; mTranslateBase(r, b->m[0][0], b->m[0][1], b->m[0][2]);}
+void bTranslate(mat* r, const mat* a, const mat* b){*r = *a; mTranslate(r, b->m[0][0], b->m[0][1], b->m[0][2]);}
+void bRotateBase(mat* r, const mat* a, const mat* b){*r = *a; mRotateBase(r, b->m[0][3], b->m[0][0], b->m[0][1], b->m[0][2]);}
+void bRotate(mat* r, const mat* a, const mat* b){*r = *a; mRotate(r, b->m[0][3], b->m[0][0], b->m[0][1], b->m[0][2]);}
+void bTransposeBase(mat* r, const mat* a, const mat* b){mTransposeBase(r, a);}
+void bTranspose(mat* r, const mat* a, const mat* b){mTranspose(r, a);}
+
+__attribute__((noinline)) double benchMatRun(bMatFn f, const mat* in, mat* out, const unsigned m, const unsigned n)
+{
+    const double st = bNow();
+    for(unsigned i = 0; i < n; i++){f(&out[i % m], &in[i % m], &in[(i*7+3) % m]);}
+    return (bNow() - st) * 1e9 / n;
+}
+
+float benchMatErr(const float* r, const float* e, const unsigned n)
+{
+    // the largest difference to the reference, relative to it
+    float err = 0.f;
+    for(unsigned i = 0; i < n; i++)
+    {
+        const float d = fabsf(r[i] - e[i]) / fmaxf(fabsf(e[i]), 1.f);
+        if(d > err){err = d;}
+    }
+    return err;
+}
+
+void benchMatRow(const char* op, const char* variant, bMatFn f, bMatFn ref, const mat* in, mat* out, const unsigned m)
+{
+    float err = 0.f;
+    for(unsigned i = 0; i < m; i++)
+    {
+        mat r, e;
+        f(&r, &in[i], &in[(i*7+3) % m]);
+        ref(&e, &in[i], &in[(i*7+3) % m]);
+        err = fmaxf(err, benchMatErr(&r.m[0][0], &e.m[0][0], 16));
+    }
+    benchMatRun(f, in, out, m, m); // warm up
+    const double ns = benchMatRun(f, in, out, m, 10000000);
+    printf("%-10s | %-8s | %-8.2f | %-8.1f | %.2e\n", op, variant, ns, 1e3 / ns, err);
+}
+
+// the batch kernels against a loop of the single ones, m matrices or 4*m points a call
+typedef void (*bBatchFn)(const mat* in, mat* out, const unsigned m, const int k);
+void bMulLoop(const mat* in, mat* out, const unsigned m, const int k){for(unsigned i = 0; i < m; i++){mMul(&out[i], &in[i], &in[m]);}}
+void bMulN(const mat* in, mat* out, const unsigned m, const int k){(k == 0 ? mMulNBase : mMulN)(out, in, &in[m], m);}
+void bMulPLoop(const mat* in, mat* out, const unsigned m, const int k)
+{
+    const float* p = &in[0].m[0][0];
+    float* o = &out[0].m[0][0];
+    for(unsigned i = 0; i < m*4; i++)
+    {
+        vec v;
+        mMulP(&v, &in[m], p[i], p[m*4 + i], p[m*8 + i]);
+        o[i] = v.x, o[m*4 + i] = v.y, o[m*8 + i] = v.z, o[m*12 + i] = v.w;
+    }
+}
+void bMulPN(const mat* in, mat* out, const unsigned m, const int k)
+{
+    const float* p = &in[0].m[0][0];
+    float* o = &out[0].m[0][0];
+    (k == 0 ? mMulPNBase : mMulPN)(o, &o[m*4], &o[m*8], &o[m*12], &in[m], p, &p[m*4], &p[m*8], m*4);
+}
+void bInvertLoop(const mat* in, mat* out, const unsigned m, const int k){for(unsigned i = 0; i < m; i++){mInvert(&out[i].m[0][0], &in[i].m[0][0]);}}
+void bInvertN(const mat* in, mat* out, const unsigned m, const int k){(k == 0 ? mInvertNBase : mInvertN)(out, in, m);}
+
+void benchMatBatch(const char* op, const char* variant, const unsigned items, bBatchFn f, const int k, const mat* in, mat* out, const mat* ref, const unsigned m)
+{
+    f(in, out, m, k);
+    const float err = benchMatErr(&out[0].m[0][0], &ref[0].m[0][0], m*16);
+    unsigned n = 0;
+    const double st = bNow();
+    double et;
+    do{f(in, out, m, k); n++;}while((et = bNow() - st) < 0.25);
+    const double ns = et * 1e9 / ((double)n * items);
+    printf("%-10s | %-8s | %-8.2f | %-8.1f | %.2e\n", op, variant, ns, 1e3 / ns, err);
+}
+
+void bInvertTranspose(mat* r, const mat* a, const mat* b){mat t; mInvert(&t.m[0][0], &a->m[0][0]); mTranspose(r, &t);}
+void bNormalBase(mat* r, const mat* a, const mat* b){mNormalBase(r, a);}
+void bNormal(mat* r, const mat* a, const mat* b){mNormal(r, a);}
+
+__attribute__((noinline)) double benchNormalLatency(bMatFn f, const mat* in, const unsigned n)
+{
+    // each call on the last result, the inverse transpose of an inverse transpose is where it started
+    mat x = *in;
+    const double st = bNow();
+    for(unsigned i = 0; i < n; i++){f(&x, &x, &x);}
+    const double et = bNow() - st;
+    if(x.m[0][0] != x.m[0][0]){printf("nan\n");}
+    return et * 1e9 / n;
+}
+
+int benchNormal(const mat* in, mat* out, const unsigned m)
+{
+    // view like matrices, a rotation and translation, the same with a non-uniform scale and shear,
+    // and that with a w column like the wiggle gives it, mRotX/Y/Z as mRotate() normalises its
+    // axis by rsqrtss() and leaves 1e-3 off orthonormal
+    mat* rot = malloc(m * sizeof(mat));
+    mat* gen = malloc(m * sizeof(mat));
+    mat* prj = malloc(m * sizeof(mat));
+    if(rot == NULL || gen == NULL || prj == NULL){free(rot); free(gen); free(prj); return 1;}
+    for(unsigned i = 0; i < m; i++)
+    {
+        const float* p = &in[i].m[0][0];
+        mIdent(&rot[i]);
+        mTranslate(&rot[i], p[0]*10.f, p[1]*10.f, p[2]*10.f);
+        mRotX(&rot[i], p[3]*PI);
+        mRotY(&rot[i], p[4]*PI);
+        mRotZ(&rot[i], p[5]*PI);
+        gen[i] = rot[i];
+        mScale(&gen[i], 1.5f + p[11], 1.5f + p[12], 1.5f + p[13]);
+        gen[i].m[1][0] += p[14]*0.5f;
+        prj[i] = gen[i];
+        prj[i].m[1][3] += p[15]*0.5f;
+    }
+    const struct{const char* name; bMatFn f;} k[3] = {{"mInvert+mTranspose", bInvertTranspose}, {"mNormalBase", bNormalBase}, {"mNormal", bNormal}};
+    printf("\nnormal matrix      | input    | latency ns | ns/op    | max rel err to mInvert, upper 3x3\n");
+    const char* sets[3] = {"rotation", "general", "w column"};
+    const float tol = 1e-4f; // the fast paths only reorder the cofactor sums
+    int fail = 0;
+    for(int j = 0; j < 3; j++)
+    {
+        const mat* set = j == 0 ? rot : (j == 1 ? gen : prj);
+        for(int i = 0; i < 3; i++)
+        {
+            float err = 0.f;
+            for(unsigned q = 0; q < m; q++)
+            {
+                mat r, e;
+                k[i].f(&r, &set[q], NULL);
+                bInvertTranspose(&e, &set[q], NULL);
+                for(int row = 0; row < 3; row++){err = fmaxf(err, benchMatErr(r.m[row], e.m[row], 3));}
+            }
+            benchMatRun(k[i].f, set, out, m, m);
+            const double ns = benchMatRun(k[i].f, set, out, m, 10000000);
+            double lat = 0.0;
+            for(unsigned q = 0; q < 16; q++){lat += benchNormalLatency(k[i].f, &set[q], 1000000);}
+            printf("%-18s | %-8s | %-10.2f | %-8.2f | %.2e%s\n", k[i].name, sets[j], lat / 16.0, ns, err, err > tol ? " FAIL" : "");
+            if(err > tol){fail = 1;}
+        }
+    }
+    free(rot);
+    free(gen);
+    free(prj);
+    return fail;
+}
+
+int benchMat()
+{
+    // 256 matrices, 16 KB, so the loads come from L1 and only the kernels are measured
+    const unsigned m = 256;
+    mat* in = malloc(m * sizeof(mat));
+    mat* out = malloc(m * sizeof(mat));
+    if(in == NULL || out == NULL){free(in); free(out); return 1;}
+    for(unsigned i = 0; i < m * 16; i++){(&in[0].m[0][0])[i] = urandf() * 2.f - 1.f;}
+#ifndef NOSSE
+    const char* simd = "SSE";
+    __builtin_cpu_init();
+    const int avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(__ARM_NEON)
+    const char* simd = "NEON";
+    const int avx2 = 0;
+#else
+    const char* simd = "scalar";
+    const int avx2 = 0;
+#endif
+    mInit();
+    printf("op         | kernel   | ns/op    | M/s      | max rel err\n");
+    benchMatRow("mMul", "scalar", bMulBase, bMulBase, in, out, m);
+#ifndef NOSSE
+    benchMatRow("mMul", "SSE", mMulSSE, bMulBase, in, out, m);
+    if(avx2 == 1){benchMatRow("mMul", "AVX2", mMulAVX2, bMulBase, in, out, m);}
+#elif defined(__ARM_NEON)
+    benchMatRow("mMul", "NEON", mMulNEON, bMulBase, in, out, m);
+#endif
+    benchMatRow("mMul", "mInit", bMulDispatch, bMulBase, in, out, m);
+    benchMatRow("mScale", "scalar", bScaleBase, bScaleBase, in, out, m);
+    benchMatRow("mScale", simd, bScale, bScaleBase, in, out, m);
+    benchMatRow("mTranslate", "scalar", bTranslateBase, bTranslateBase, in, out, m);
+    benchMatRow("mTranslate", simd, bTranslate, bTranslateBase, in, out, m);
+    benchMatRow("mRotate", "scalar", bRotateBase, bRotateBase, in, out, m);
+    benchMatRow("mRotate", simd, bRotate, bRotateBase, in, out, m);
+    benchMatRow("mTranspose", "scalar", bTransposeBase, bTransposeBase, in, out, m);
+    benchMatRow("mTranspose", simd, bTranspose, bTransposeBase, in, out, m);
+    const int fail = benchNormal(in, out, m);
+
+    // batches of m matrices or m*4 points, in[m] the shared matrix, the inverses of diagonally dominant matrices
+    mat* ref = malloc((m+1) * sizeof(mat));
+    mat* inv = malloc(m * sizeof(mat));
+    if(ref == NULL || inv == NULL){free(in); free(out); free(ref); free(inv); return 1;}
+    in = realloc(in, (m+1) * sizeof(mat));
+    if(in == NULL){free(out); free(ref); free(inv); return 1;}
+    in[m] = in[0];
+    for(unsigned i = 0; i < m; i++)
+    {
+        inv[i] = in[i];
+        for(int j = 0; j < 4; j++){inv[i].m[j][j] += 4.f;}
+    }
+    const char* batch = avx2 == 1 ? "AVX2" : "baseline";
+    printf("\nbatch      | kernel   | ns/item  | M/s      | max rel err\n");
+    bMulLoop(in, ref, m, 0);
+    benchMatBatch("mMulN", "mMul", m, bMulLoop, 0, in, out, ref, m);
+    benchMatBatch("mMulN", "baseline", m, bMulN, 0, in, out, ref, m);
+    if(avx2 == 1){benchMatBatch("mMulN", batch, m, bMulN, 1, in, out, ref, m);}
+    bMulPLoop(in, ref, m, 0);
+    benchMatBatch("mMulPN", "mMulP", m*4, bMulPLoop, 0, in, out, ref, m);
+    benchMatBatch("mMulPN", "baseline", m*4, bMulPN, 0, in, out, ref, m);
+    if(avx2 == 1){benchMatBatch("mMulPN", batch, m*4, bMulPN, 1, in, out, ref, m);}
+    bInvertLoop(inv, ref, m, 0);
+    benchMatBatch("mInvertN", "mInvert", m, bInvertLoop, 0, inv, out, ref, m);
+    benchMatBatch("mInvertN", "baseline", m, bInvertN, 0, inv, out, ref, m);
+    if(avx2 == 1){benchMatBatch("mInvertN", batch, m, bInvertN, 1, inv, out, ref, m);}
+    free(in);
+    free(out);
+    free(ref);
+    free(inv);
+    return fail;
+}
+
+// the loops over vec, noinline so the repeats are not folded away
+__attribute__((noinline)) void bVecNorm(vec* o, const unsigned n){for(unsigned i = 0; i < n; i++){vNorm(&o[i]);}}
+__attribute__((noinline)) void bVecCross(vec* o, const vec* a, const vec* b, const unsigned n){for(unsigned i = 0; i < n; i++){vCross(&o[i], a[i], b[i]);}}
+__attribute__((noinline)) void bVecDot(float* d, const vec* a, const vec* b, const unsigned n){for(unsigned i = 0; i < n; i++){d[i] = vDot(a[i], b[i]);}}
+__attribute__((noinline)) void bVecAdd(vec* o, const vec* a, const vec* b, const unsigned n){for(unsigned i = 0; i < n; i++){vAdd(&o[i], a[i], b[i]);}}
+
+void benchVecRow(const char* op, const char* variant, const double st, const unsigned n, const unsigned reps, const float err)
+{
+    const double ns = (bNow() - st) * 1e9 / ((double)n * reps);
+    printf("%-6s | %-8s | %-8.3f | %-8.1f | %.2e\n", op, variant, ns, 1e3 / ns, err);
+}
+
+void benchVec()
+{
+    // 4099 vectors so the tails run, 48 KB a stream set, a loop over vec against the vec3xN kernels
+    const unsigned n = 4099, reps = 2000;
+    vec* a = malloc(n * sizeof(vec));
+    vec* b = malloc(n * sizeof(vec));
+    vec* o = malloc(n * sizeof(vec));
+    float* d = malloc(n * sizeof(float));
+    float* e = malloc(n * sizeof(float));
+    vec3xN sa, sb, so;
+    if(a == NULL || b == NULL || o == NULL || d == NULL || e == NULL || vnAlloc(&sa, n) == 0 || vnAlloc(&sb, n) == 0 || vnAlloc(&so, n) == 0)
+    {
+        free(a); free(b); free(o); free(d); free(e);
+        return;
+    }
+    for(unsigned i = 0; i < n; i++)
+    {
+        a[i] = (vec){urandf()*2.f-1.f, urandf()*2.f-1.f, urandf()*2.f-1.f, 0.f};
+        b[i] = (vec){urandf()*2.f-1.f, urandf()*2.f-1.f, urandf()*2.f-1.f, 0.f};
+    }
+    vnFromVec(&sa, a, n);
+    vnFromVec(&sb, b, n);
+    vnInit();
+#ifndef NOSSE
+    const int avx2 = vn_avx2;
+#else
+    const int avx2 = 0;
+#endif
+
+    printf("op     | kernel   | ns/vec   | M/s      | max err\n");
+    double st;
+    float err;
+
+    // normalise, the error is the length off 1
+    err = 0.f;
+    for(unsigned i = 0; i < n; i++){o[i] = a[i]; vNorm(&o[i]); err = fmaxf(err, fabsf(sqrtf(vDot(o[i], o[i])) - 1.f));}
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){memcpy(o, a, n * sizeof(vec)); bVecNorm(o, n);}
+    benchVecRow("norm", "vNorm", st, n, reps, err);
+    for(int v = 0; v <= avx2; v++)
+    {
+        memcpy(so.x, sa.x, n*4); memcpy(so.y, sa.y, n*4); memcpy(so.z, sa.z, n*4);
+        (v == 0 ? vnNormBase : vnNorm)(&so);
+        err = 0.f;
+        for(unsigned i = 0; i < n; i++){const vec t = vnGet(&so, i); err = fmaxf(err, fabsf(sqrtf(vDot(t, t)) - 1.f));}
+        st = bNow();
+        for(unsigned k = 0; k < reps; k++){memcpy(so.x, sa.x, n*4); memcpy(so.y, sa.y, n*4); memcpy(so.z, sa.z, n*4); (v == 0 ? vnNormBase : vnNorm)(&so);}
+        benchVecRow("norm", v == 0 ? "baseline" : "AVX2", st, n, reps, err);
+    }
+
+    // cross, the error is against vCross
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bVecCross(o, a, b, n);}
+    benchVecRow("cross", "vCross", st, n, reps, 0.f);
+    for(int v = 0; v <= avx2; v++)
+    {
+        st = bNow();
+        for(unsigned k = 0; k < reps; k++){(v == 0 ? vnCrossBase : vnCross)(&so, &sa, &sb);}
+        err = 0.f;
+        for(unsigned i = 0; i < n; i++){const vec t = vnGet(&so, i); err = fmaxf(err, fmaxf(fabsf(t.x - o[i].x), fmaxf(fabsf(t.y - o[i].y), fabsf(t.z - o[i].z))));}
+        benchVecRow("cross", v == 0 ? "baseline" : "AVX2", st, n, reps, err);
+    }
+
+    // dot, vDot into e
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bVecDot(e, a, b, n);}
+    benchVecRow("dot", "vDot", st, n, reps, 0.f);
+    for(int v = 0; v <= avx2; v++)
+    {
+        st = bNow();
+        for(unsigned k = 0; k < reps; k++){(v == 0 ? vnDotBase : vnDot)(d, &sa, &sb);}
+        err = 0.f;
+        for(unsigned i = 0; i < n; i++){err = fmaxf(err, fabsf(d[i] - e[i]));}
+        benchVecRow("dot", v == 0 ? "baseline" : "AVX2", st, n, reps, err);
+    }
+
+    // add, memory bound, baseline only
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bVecAdd(o, a, b, n);}
+    benchVecRow("add", "vAdd", st, n, reps, 0.f);
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){vnAdd(&so, &sa, &sb);}
+    err = 0.f;
+    for(unsigned i = 0; i < n; i++){const vec t = vnGet(&so, i); err = fmaxf(err, fmaxf(fabsf(t.x - o[i].x), fmaxf(fabsf(t.y - o[i].y), fabsf(t.z - o[i].z))));}
+    benchVecRow("add", "baseline", st, n, reps, err);
+
+    // the round trip
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){vnFromVec(&so, a, n); vnToVec(o, &so);}
+    err = 0.f;
+    for(unsigned i = 0; i < n; i++){err = fmaxf(err, fabsf(o[i].x - a[i].x) + fabsf(o[i].y - a[i].y) + fabsf(o[i].z - a[i].z));}
+    benchVecRow("conv", "to+from", st, n, reps, err);
+
+    free(a); free(b); free(o); free(d); free(e);
+    vnFree(&sa); vnFree(&sb); vnFree(&so);
+}
+
+// libm a call at a time as the frame makes them, noinline so -Ofast can not swap the loops for its vector versions
+__attribute__((noinline)) void bLibmSinCos1(const float x, float* s, float* c){*s = sinf(x), *c = cosf(x);}
+__attribute__((noinline)) void bLibmExp1(const float x, float* r){*r = expf(x);}
+__attribute__((noinline)) void bLibmLog1(const float x, float* r){*r = logf(x);}
+// and a plain loop, which -Ofast on glibc hands to libmvec
+__attribute__((noinline)) void bLoopSinCos(float* s, float* c, const float* x, const unsigned n){for(unsigned i = 0; i < n; i++){s[i] = sinf(x[i]), c[i] = cosf(x[i]);}}
+__attribute__((noinline)) void bLoopExp(float* r, const float* x, const unsigned n){for(unsigned i = 0; i < n; i++){r[i] = expf(x[i]);}}
+__attribute__((noinline)) void bLoopLog(float* r, const float* x, const unsigned n){for(unsigned i = 0; i < n; i++){r[i] = logf(x[i]);}}
+void bLibmSinCos(float* s, float* c, const float* x, const unsigned n){for(unsigned i = 0; i < n; i++){bLibmSinCos1(x[i], &s[i], &c[i]);}}
+void bLibmExp(float* r, const float* x, const unsigned n){for(unsigned i = 0; i < n; i++){bLibmExp1(x[i], &r[i]);}}
+void bLibmLog(float* r, const float* x, const unsigned n){for(unsigned i = 0; i < n; i++){bLibmLog1(x[i], &r[i]);}}
+
+int benchMathRow(const char* op, const char* tier, const char* variant, const double st, const unsigned n, const unsigned reps, const double err, const double tol)
+{
+    const double ns = (bNow() - st) * 1e9 / ((double)n * reps);
+    printf("%-6s | %-7s | %-8s | %-8.3f | %-8.1f | %.2e%s\n", op, tier, variant, ns, 1e3 / ns, err, err > tol ? " FAIL" : "");
+    return err > tol;
+}
+
+int benchMath()
+{
+    // 4099 values so the tails run, sin and cos on [-100, 100], exp on [-80, 80], log on [1e-30, 1e30]
+    // the error is against the double libm, absolute for sin and cos, relative for exp and log,
+    // and fails past tol[] of the tier, libm is held to the precise one
+    const unsigned n = 4099, reps = 2000;
+    float* x = malloc(n * sizeof(float));
+    float* s = malloc(n * sizeof(float));
+    float* c = malloc(n * sizeof(float));
+    if(x == NULL || s == NULL || c == NULL){free(x); free(s); free(c); return 1;}
+    fmInit();
+#ifndef NOSSE
+    const int avx2 = fm_avx2;
+#else
+    const int avx2 = 0;
+#endif
+    const char* tiers[2] = {"fast", "precise"};
+    const double tol[2] = {1e-3, 1e-6};
+    int fail = 0;
+
+    printf("op     | tier    | kernel   | ns/value | M/s      | max err\n");
+    double st, err;
+
+    for(unsigned i = 0; i < n; i++){x[i] = urandf() * 200.f - 100.f;}
+    #define SINCOS_ERR for(unsigned i = 0; i < n; i++){err = fmax(err, fmax(fabs(s[i] - sin((double)x[i])), fabs(c[i] - cos((double)x[i]))));}
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bLibmSinCos(s, c, x, n);}
+    err = 0.0; SINCOS_ERR
+    fail |= benchMathRow("sincos", "libm", "sincosf", st, n, reps, err, tol[FM_PRECISE]);
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bLoopSinCos(s, c, x, n);}
+    err = 0.0; SINCOS_ERR
+    fail |= benchMathRow("sincos", "libm", "loop", st, n, reps, err, tol[FM_PRECISE]);
+    for(int t = FM_FAST; t <= FM_PRECISE; t++)
+    {
+        for(int v = 0; v <= avx2; v++)
+        {
+            st = bNow();
+            for(unsigned k = 0; k < reps; k++){(v == 0 ? fmSinCosNBase : fmSinCosN)(s, c, x, n, t);}
+            err = 0.0; SINCOS_ERR
+            fail |= benchMathRow("sincos", tiers[t], v == 0 ? "baseline" : "AVX2", st, n, reps, err, tol[t]);
+        }
+    }
+    #undef SINCOS_ERR
+
+    for(unsigned i = 0; i < n; i++){x[i] = urandf() * 160.f - 80.f;}
+    #define EXP_ERR for(unsigned i = 0; i < n; i++){err = fmax(err, fabs(s[i] / exp((double)x[i]) - 1.0));}
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bLibmExp(s, x, n);}
+    err = 0.0; EXP_ERR
+    fail |= benchMathRow("exp", "libm", "expf", st, n, reps, err, tol[FM_PRECISE]);
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bLoopExp(s, x, n);}
+    err = 0.0; EXP_ERR
+    fail |= benchMathRow("exp", "libm", "loop", st, n, reps, err, tol[FM_PRECISE]);
+    for(int t = FM_FAST; t <= FM_PRECISE; t++)
+    {
+        for(int v = 0; v <= avx2; v++)
+        {
+            st = bNow();
+            for(unsigned k = 0; k < reps; k++){(v == 0 ? fmExpNBase : fmExpN)(s, x, n, t);}
+            err = 0.0; EXP_ERR
+            fail |= benchMathRow("exp", tiers[t], v == 0 ? "baseline" : "AVX2", st, n, reps, err, tol[t]);
+        }
+    }
+    #undef EXP_ERR
+
+    for(unsigned i = 0; i < n; i++){x[i] = expf(urandf() * 138.f - 69.f);}
+    #define LOG_ERR for(unsigned i = 0; i < n; i++){const double l = log((double)x[i]); err = fmax(err, fabs(s[i] - l) / fmax(1.0, fabs(l)));}
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bLibmLog(s, x, n);}
+    err = 0.0; LOG_ERR
+    fail |= benchMathRow("log", "libm", "logf", st, n, reps, err, tol[FM_PRECISE]);
+    st = bNow();
+    for(unsigned k = 0; k < reps; k++){bLoopLog(s, x, n);}
+    err = 0.0; LOG_ERR
+    fail |= benchMathRow("log", "libm", "loop", st, n, reps, err, tol[FM_PRECISE]);
+    for(int t = FM_FAST; t <= FM_PRECISE; t++)
+    {
+        for(int v = 0; v <= avx2; v++)
+        {
+            st = bNow();
+            for(unsigned k = 0; k < reps; k++){(v == 0 ? fmLogNBase : fmLogN)(s, x, n, t);}
+            err = 0.0; LOG_ERR
+            fail |= benchMathRow("log", tiers[t], v == 0 ? "baseline" : "AVX2", st, n, reps, err, tol[t]);
+        }
+    }
+    #undef LOG_ERR
+
+    free(x); free(s); free(c);
+    return fail;
+}
+
+int benchRun(const char* name)
+{
+    if(strcmp(name, "menger") == 0){benchMenger(); return 1;}
+    if(strcmp(name, "rng") == 0){benchRng(); return 1;}
+    if(strcmp(name, "raster") == 0){benchRaster(); return 1;}
+    if(strcmp(name, "mat") == 0){return benchMat() == 0 ? 1 : 2;}
+    if(strcmp(name, "vec") == 0){benchVec(); return 1;}
+    if(strcmp(name, "math") == 0){return benchMath() == 0 ? 1 : 2;}
+    return 0;
+}
+
+#endif
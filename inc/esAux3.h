@@ -1,7 +1,7 @@
 /*
 --------------------------------------------------
     James William Fletcher (github.com/mrbid)
-        December 2022 - esAux3.h v3.0
+        December 2022 - esAux3.h v3.7
 --------------------------------------------------
 
     A pretty good color converter: https://www.easyrgb.com/en/convert.php
@@ -14,6 +14,40 @@
     (or)- vec_ts.h: https://gist.github.com/mrbid/9d8831feae1a6881c95434c4006a7229
         - mat.h:    https://gist.github.com/mrbid/cbc69ec9d99b0fda44204975fcbeae7c
 
+    v3.7: [December 2022]
+        - programs are finished on first use, makeX() only submits the
+          compile and link and shadeX() waits for it with esFinish().
+          With GL_KHR_parallel_shader_compile and more than one core they
+          link on driver threads and esPoll() finishes the ones that are
+          done without waiting, otherwise the sources are kept and only
+          compiled on first use
+
+    v3.6: [December 2022]
+        - added esMakeProgram(), every makeX() builds through it, and
+          esCacheInit() to keep linked program binaries on disk
+          (GL_ARB_get_program_binary) so a warm start skips compiling
+
+    v3.5: [December 2022]
+        - added esRandC/esRandFloatC, counter based versions of
+          esRand/esRandFloat using crand() from vec_ts.h
+
+    v3.4: [December 2022]
+        - added Lambert7/Phong7, Lambert4/Phong4 with the view matrix
+          wiggle done by a hash kernel in the vertex shader
+
+    v3.3: [December 2022]
+        - added Lambert6/Phong6, instanced Lambert4/Phong4 with a per
+          instance offset and wiggle seed (needs OpenGL 3.3 instancing)
+
+    v3.2: [December 2022]
+        - added Lambert5/Phong5 for packed lattice vertices without a face
+          id, the flat normal comes from screen-space derivatives and is
+          snapped to the nearest axis (GL_OES_standard_derivatives)
+
+    v3.1: [December 2022]
+        - added Lambert4/Phong4 for packed lattice vertices (xyz + face id
+          as 4 unsigned bytes, normals are derived from the face id)
+
     v3.0: [December 2022]
         - improved shaders, debugging, etc
 
@@ -41,6 +75,12 @@
 #ifndef AUX_H
 #define AUX_H
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "vec_ts.h"
 #include "mat.h"
 
@@ -64,6 +104,8 @@ typedef struct
 
 GLuint esRand(const GLuint min, const GLuint max);
 GLfloat esRandFloat(const GLfloat min, const GLfloat max);
+GLuint esRandC(const uint64_t key, uint64_t* ctr, const GLuint min, const GLuint max);           // counter based, see crand() in vec_ts.h
+GLfloat esRandFloatC(const uint64_t key, uint64_t* ctr, const GLfloat min, const GLfloat max);  // counter based, see crand() in vec_ts.h
 void esBind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage);
 void esRebind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage);
 void esBindModel(ESModel* model, const GLfloat* vertices, const GLsizei vertlen, const GLushort* indices, const GLsizei indlen);
@@ -75,6 +117,20 @@ GLuint esLoadTextureA(const GLuint w, const GLuint h, const unsigned char* data)
 //*************************************
 
 GLuint debugShader(GLuint shader_program);
+int esHasExtension(const char* name);
+
+// makeX() calls esMakeProgram(&shdX, vs, fs, makeX), which submits the program and returns 0. Once
+// it has linked esFinish() calls makeX() again, esMakeProgram() then returns 1 and makeX() goes on to
+// look up its locations. shdX is 0 until then, and after if it failed.
+int  esLinkInit(GLADloadfunc load); // returns 1 with parallel linking, else programs are compiled on first use
+int  esMakeProgram(GLuint* program, const GLchar* vs, const GLchar* fs, void (*make)());
+void esFinish(GLuint* program); // waits for the program to link, every shadeX() does this first
+void esPoll();      // finishes the programs that have linked, never waits
+void esFinishAll();
+
+// programs are kept in dir/app/ as <hash>.bin, dir is $XDG_CACHE_HOME or ~/.cache, the hash is
+// of both sources and the GL vendor, renderer and version, a binary the driver rejects is rebuilt
+int esCacheInit(GLADloadfunc load, const char* app); // returns 0 without program binaries, esMakeProgram() then always compiles
 
 void makeAllShaders();
 
@@ -87,6 +143,14 @@ void makePhong();
 void makePhong1();
 void makePhong2();
 void makePhong3();
+void makeLambert4();
+void makePhong4();
+void makeLambert5();
+void makePhong5();
+void makeLambert6();
+void makePhong6();
+void makeLambert7();
+void makePhong7();
 
 void shadeFullbrightT(GLint* position, GLint* projection, GLint* modelview, GLint* texcoord, GLint* sampler);                             // texture + no shading
 void shadeFullbright(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* opacity);                                 // solid color + no shading
@@ -101,6 +165,24 @@ void shadePhong1(GLint* position, GLint* projection, GLint* modelview, GLint* no
 void shadePhong2(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* color, GLint* opacity);                  // colors + no normals
 void shadePhong3(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity);   // colors + normals
 
+// position is packed lattice xyz + face id (0-5 = +x,-x,+y,-y,+z,-z), world position = lattice * quant.x + quant.y
+void shadeLambert4(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity);                    // solid color + packed lattice
+void shadePhong4(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity);    // solid color + packed lattice
+void shadeLambert5(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity);                    // solid color + packed lattice + derivative normals
+void shadePhong5(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity);    // solid color + packed lattice + derivative normals
+
+// instance is a per instance attribute: xyz = world offset, w = wiggle seed
+// each instance runs the gpu wiggle below with instance.w added to its key, so no two perturb alike
+void shadeLambert6(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* instance, GLint* wparams, GLint* witer, GLint* color, GLint* opacity);   // solid color + packed lattice + instanced
+void shadePhong6(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* instance, GLint* wparams, GLint* witer, GLint* color, GLint* opacity);     // solid color + packed lattice + instanced
+
+// wparams = (seed, frac, ws, mode), witer = (iter, key scale), the key is floor(lattice * key scale)
+// so a key scale of 0 wiggles the whole mesh alike and 1 every vertex, a negative key scale keys on
+// the level 1 sub-cube packed above the face id by MENGER_CELLS so every sub-cube moves rigidly
+// Phong6/Phong7 derive their normal matrix from the wiggled modelview, they have no normalmat uniform
+void shadeLambert7(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* wparams, GLint* witer, GLint* color, GLint* opacity);   // solid color + packed lattice + gpu wiggle
+void shadePhong7(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* wparams, GLint* witer, GLint* color, GLint* opacity);     // solid color + packed lattice + gpu wiggle
+
 //*************************************
 // UTILITY CODE
 //*************************************
@@ -116,6 +198,16 @@ GLfloat esRandFloat(const GLfloat min, const GLfloat max)
     return (((GLfloat)rand()) * rrndmax) * (max-min) + min;
 }
 
+GLuint esRandC(const uint64_t key, uint64_t* ctr, const GLuint min, const GLuint max)
+{
+    return crandr(key, ctr, max+1-min)+min;
+}
+
+GLfloat esRandFloatC(const uint64_t key, uint64_t* ctr, const GLfloat min, const GLfloat max)
+{
+    return crandf(key, ctr) * (max-min) + min;
+}
+
 void esBind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage)
 {
     glGenBuffers(1, buffer);
@@ -233,6 +325,283 @@ GLuint debugShader(GLuint shader_program)
     return linked;
 }
 
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    #define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+    #define GL_PROGRAM_BINARY_LENGTH 0x8741
+    #define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+struct
+{
+    int on;
+    char dir[512];
+    uint64_t key; // of the GL vendor, renderer and version
+    void (GLAD_API_PTR *getProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* format, void* binary);
+    void (GLAD_API_PTR *programBinary)(GLuint program, GLenum format, const void* binary, GLsizei length);
+    void (GLAD_API_PTR *programParameteri)(GLuint program, GLenum pname, GLint value);
+    unsigned hits, built, rejected;
+} es_cache;
+
+int esHasExtension(const char* name)
+{
+    const char* ext = (const char*)glGetString(GL_EXTENSIONS); // NULL in a core profile
+    if(ext != NULL)
+    {
+        const size_t len = strlen(name);
+        for(const char* p = ext; (p = strstr(p, name)) != NULL; p += len)
+            if((p == ext || p[-1] == ' ') && (p[len] == ' ' || p[len] == 0))
+                return 1;
+        return 0;
+    }
+    if(glGetStringi == NULL){return 0;}
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+    for(GLint i = 0; i < n; i++)
+        if(strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return 1;
+    return 0;
+}
+
+uint64_t esHash(uint64_t h, const char* s)
+{
+    // FNV-1a, the terminator too so "ab","c" and "a","bc" differ
+    do{h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;}while(*s++ != 0);
+    return h;
+}
+
+int esCacheInit(GLADloadfunc load, const char* app)
+{
+    memset(&es_cache, 0, sizeof(es_cache));
+    const char* ver = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if(ver == NULL || sscanf(ver, "%d.%d", &major, &minor) != 2){return 0;}
+    const int has = major > 4 || (major == 4 && minor >= 1) || esHasExtension("GL_ARB_get_program_binary");
+    GLint formats = 0;
+    if(has == 1){glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);}
+    if(formats == 0){return 0;}
+
+    es_cache.getProgramBinary = (void*)load("glGetProgramBinary");
+    es_cache.programBinary = (void*)load("glProgramBinary");
+    es_cache.programParameteri = (void*)load("glProgramParameteri");
+    if(es_cache.getProgramBinary == NULL || es_cache.programBinary == NULL || es_cache.programParameteri == NULL){return 0;}
+
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char base[384];
+    if(xdg != NULL && xdg[0] == '/')
+        snprintf(base, sizeof(base), "%s", xdg);
+    else if(home != NULL)
+        snprintf(base, sizeof(base), "%s/.cache", home);
+    else
+        return 0;
+    snprintf(es_cache.dir, sizeof(es_cache.dir), "%s/%s", base, app);
+    mkdir(base, 0755);
+    if(mkdir(es_cache.dir, 0755) != 0 && errno != EEXIST){return 0;}
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = esHash(h, (const char*)glGetString(GL_VENDOR));
+    h = esHash(h, (const char*)glGetString(GL_RENDERER));
+    es_cache.key = esHash(h, ver);
+    es_cache.on = 1;
+    return 1;
+}
+
+GLuint esCacheLoad(const char* path)
+{
+    // the link status is not asked for here, a rejected binary shows up in esFinish()
+    FILE* f = fopen(path, "rb");
+    if(f == NULL){return 0;}
+    uint32_t head[3]; // magic, format, length
+    GLuint program = 0;
+    void* data = NULL;
+    if(fread(head, sizeof(head), 1, f) == 1 && head[0] == 0x42505345 && head[2] > 0 && head[2] < (1u << 26) &&
+        (data = malloc(head[2])) != NULL && fread(data, 1, head[2], f) == head[2])
+    {
+        program = glCreateProgram();
+        es_cache.programBinary(program, head[1], data, head[2]);
+    }
+    free(data);
+    fclose(f);
+    return program;
+}
+
+void esCacheSave(const char* path, const GLuint program)
+{
+    GLint len = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+    if(len <= 0){return;}
+    void* data = malloc(len);
+    if(data == NULL){return;}
+    uint32_t head[3] = {0x42505345, 0, 0};
+    GLsizei got = 0;
+    GLenum format = 0;
+    es_cache.getProgramBinary(program, len, &got, &format, data);
+    head[1] = format, head[2] = got;
+
+    // written aside and renamed over, so a second instance never reads half a file
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if(f != NULL)
+    {
+        const int ok = got > 0 && fwrite(head, sizeof(head), 1, f) == 1 && fwrite(data, 1, got, f) == (size_t)got;
+        if(fclose(f) == 0 && ok == 1){rename(tmp, path);}
+        else{remove(tmp);}
+    }
+    free(data);
+}
+
+#ifndef GL_COMPLETION_STATUS_KHR
+    #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#define ES_PROGRAMS 32
+#define ES_LAZY 0       // sources kept, nothing submitted
+#define ES_LINKING 1    // submitted, the driver may still be at it
+#define ES_LOCATING 2   // linked, make() is looking up the locations
+#define ES_DONE 3
+
+typedef struct
+{
+    GLuint* program;
+    void (*make)();
+    const GLchar* vs;
+    const GLchar* fs;
+    uint64_t hash;
+    int state, cached;
+} ESProgram;
+
+struct
+{
+    int parallel;   // GL_KHR_parallel_shader_compile
+    int lazy;       // submit on first use
+    ESProgram p[ES_PROGRAMS];
+    unsigned n, waiting;
+} es_link;
+
+int esLinkInit(GLADloadfunc load)
+{
+    memset(&es_link, 0, sizeof(es_link));
+    if(esHasExtension("GL_KHR_parallel_shader_compile"))
+    {
+        // as many driver threads as it likes, the default is up to the driver
+        void (GLAD_API_PTR *maxThreads)(GLuint count) = (void*)load("glMaxShaderCompilerThreadsKHR");
+        if(maxThreads != NULL){maxThreads(0xFFFFFFFF);}
+        es_link.parallel = 1;
+    }
+    // a driver without it compiles inside glLinkProgram(), and with one core its threads
+    // take the time from this one all the same, so then only what is used is compiled
+    es_link.lazy = es_link.parallel == 0 || sysconf(_SC_NPROCESSORS_ONLN) < 2;
+    return es_link.lazy == 0;
+}
+
+void esSubmit(ESProgram* e, const int cache)
+{
+    if(cache == 1 && es_cache.on == 1)
+    {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/%016lx.bin", es_cache.dir, (unsigned long)e->hash);
+        *e->program = esCacheLoad(path);
+        e->cached = *e->program != 0;
+        if(e->cached == 1){e->state = ES_LINKING; return;}
+    }
+    e->cached = 0;
+
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &e->vs, NULL);
+    glCompileShader(vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &e->fs, NULL);
+    glCompileShader(fragmentShader);
+
+    GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+    if(es_cache.on == 1){es_cache.programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);}
+    glLinkProgram(program);
+    glDeleteShader(vertexShader); // flagged, they go with the program
+    glDeleteShader(fragmentShader);
+    *e->program = program;
+    e->state = ES_LINKING;
+}
+
+ESProgram* esFind(const GLuint* program)
+{
+    for(unsigned i = 0; i < es_link.n; i++)
+        if(es_link.p[i].program == program)
+            return &es_link.p[i];
+    return NULL;
+}
+
+int esMakeProgram(GLuint* program, const GLchar* vs, const GLchar* fs, void (*make)())
+{
+    ESProgram* e = esFind(program);
+    if(e != NULL){return e->state >= ES_LOCATING && *program != 0;} // called back by esFinish(), or made again
+    if(es_link.n == ES_PROGRAMS){printf("!!! more than %d programs !!!\n", ES_PROGRAMS); *program = 0; return 0;}
+    e = &es_link.p[es_link.n++];
+    e->program = program, e->make = make, e->vs = vs, e->fs = fs, e->cached = 0;
+    e->hash = es_cache.on == 1 ? esHash(esHash(es_cache.key, vs), fs) : 0;
+    e->state = ES_LAZY;
+    *program = 0;
+    es_link.waiting++;
+    if(es_link.lazy == 0){esSubmit(e, 1);}
+    return 0;
+}
+
+void esFinish(GLuint* program)
+{
+    ESProgram* e = esFind(program);
+    if(e == NULL || e->state >= ES_LOCATING){return;}
+    if(e->state == ES_LAZY){esSubmit(e, 1);}
+
+    // the first status query is where a driver without parallel linking has to finish
+    GLint linked = GL_FALSE;
+    glGetProgramiv(*program, GL_LINK_STATUS, &linked);
+    if(linked == GL_FALSE && e->cached == 1)
+    {
+        glDeleteProgram(*program);
+        es_cache.rejected++;
+        esSubmit(e, 0);
+    }
+    es_link.waiting--;
+    e->state = ES_DONE;
+    if(debugShader(*program) == GL_FALSE){*program = 0; return;}
+    if(e->cached == 1)
+        es_cache.hits++;
+    else
+    {
+        es_cache.built++;
+        if(es_cache.on == 1)
+        {
+            char path[600];
+            snprintf(path, sizeof(path), "%s/%016lx.bin", es_cache.dir, (unsigned long)e->hash);
+            esCacheSave(path, *program);
+        }
+    }
+    e->state = ES_LOCATING;
+    e->make();
+    e->state = ES_DONE;
+}
+
+void esPoll()
+{
+    if(es_link.parallel == 0 || es_link.waiting == 0){return;}
+    for(unsigned i = 0; i < es_link.n; i++)
+    {
+        if(es_link.p[i].state != ES_LINKING){continue;}
+        GLint done = GL_FALSE;
+        glGetProgramiv(*es_link.p[i].program, GL_COMPLETION_STATUS_KHR, &done);
+        if(done == GL_TRUE){esFinish(es_link.p[i].program);}
+    }
+}
+
+void esFinishAll()
+{
+    for(unsigned i = 0; i < es_link.n; i++)
+        esFinish(es_link.p[i].program);
+}
+
 //*************************************
 // SHADER CODE
 //*************************************
@@ -392,6 +761,133 @@ const GLchar* v13 =
         "gl_Position = projection * vertPos4;\n"
     "}\n";
 
+// solid color + packed lattice position and face id
+const GLchar* v14 =
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform vec3 color;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertNorm;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "float axis = floor(position.w * 0.5);\n"
+        "vec3 normal = vec3(equal(vec3(axis), vec3(0.0, 1.0, 2.0))) * (1.0 - 2.0 * (position.w - axis * 2.0));\n"
+        "vec4 vertPos4 = modelview * vec4(position.xyz * quant.x + quant.y, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertNorm = vec3(modelview * vec4(normal, 0.0));\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+// vertex shader wiggle kernel, hash13() is Dave Hoskins' "hash without sine"
+// it perturbs witer.x random elements of m, like the CPU loop in main_loop()
+#define GLSL_WIGGLE \
+    "uniform vec4 wparams;\n" \
+    "uniform vec2 witer;\n" \
+    "float hash13(vec3 p3)\n" \
+    "{\n" \
+        "p3 = fract(p3 * 0.1031);\n" \
+        "p3 += dot(p3, p3.zyx + 31.32);\n" \
+        "return fract((p3.x + p3.y) * p3.z);\n" \
+    "}\n" \
+    "mat4 wiggleMat(mat4 m, vec3 key, float stream)\n" \
+    "{\n" \
+        "for(int i = 0; i < 16; i++)\n" \
+        "{\n" \
+            "if(float(i) >= witer.x){break;}\n" \
+            "vec3 h = vec3(wparams.x, float(i) * 2.0 + stream, 0.0) + key * vec3(17.0, 59.0, 113.0);\n" \
+            "float k = floor(hash13(h) * 16.0);\n" \
+            "float d = (hash13(h + 0.5) * 2.0 - 1.0) * wparams.z * wparams.y;\n" \
+            "for(int j = 0; j < 4; j++)\n" \
+            "{\n" \
+                "vec4 e = vec4(equal(vec4(k - float(j) * 4.0), vec4(0.0, 1.0, 2.0, 3.0)));\n" \
+                "m[j] += e * mix(m[j] * wparams.y, vec4(d), wparams.w);\n" \
+            "}\n" \
+        "}\n" \
+        "return m;\n" \
+    "}\n" \
+    "vec3 wiggleKey(vec4 p)\n" \
+    "{\n" \
+        "if(witer.y >= 0.0){return floor(p.xyz * witer.y);}\n" \
+        "float c = floor((p.w + 0.5) / 8.0);\n" \
+        "float z = floor((c + 0.5) / 9.0);\n" \
+        "float y = floor((c - z * 9.0 + 0.5) / 3.0);\n" \
+        "return vec3(c - z * 9.0 - y * 3.0, y, z);\n" \
+    "}\n"
+
+// solid color + packed lattice position and face id + instanced
+const GLchar* v16 =
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform vec3 color;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "attribute vec4 instance;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertNorm;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    GLSL_WIGGLE
+    "void main()\n"
+    "{\n"
+        "mat4 mv = wiggleMat(modelview, wiggleKey(position) + vec3(0.0, 0.0, instance.w), 0.0);\n"
+        "float face = position.w - floor((position.w + 0.5) / 8.0) * 8.0;\n"
+        "float axis = floor(face * 0.5);\n"
+        "vec3 normal = vec3(equal(vec3(axis), vec3(0.0, 1.0, 2.0))) * (1.0 - 2.0 * (face - axis * 2.0));\n"
+        "vec4 vertPos4 = mv * vec4(position.xyz * quant.x + quant.y + instance.xyz, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertNorm = vec3(mv * vec4(normal, 0.0));\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+// solid color + packed lattice position and face id + gpu wiggle
+const GLchar* v17 =
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform vec3 color;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertNorm;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    GLSL_WIGGLE
+    "void main()\n"
+    "{\n"
+        "mat4 mv = wiggleMat(modelview, wiggleKey(position), 0.0);\n"
+        "float face = position.w - floor((position.w + 0.5) / 8.0) * 8.0;\n"
+        "float axis = floor(face * 0.5);\n"
+        "vec3 normal = vec3(equal(vec3(axis), vec3(0.0, 1.0, 2.0))) * (1.0 - 2.0 * (face - axis * 2.0));\n"
+        "vec4 vertPos4 = mv * vec4(position.xyz * quant.x + quant.y, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertNorm = vec3(mv * vec4(normal, 0.0));\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
 const GLchar* f1 =
     "#version 100\n"
     "precision mediump float;\n"
@@ -408,6 +904,58 @@ const GLchar* f1 =
         "gl_FragColor = vec4(ambientColor + lambertian*vertCol, vertOpa);\n"
     "}\n";
 
+// solid color + packed lattice position, flat normal from derivatives
+const GLchar* v15 =
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform vec3 color;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 objPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "objPos = position.xyz * quant.x + quant.y;\n"
+        "vec4 vertPos4 = modelview * vec4(objPos, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+// the derivative cross product faces the viewer, a mirrored modelview
+// shows the inside of the faces so the determinant flips it back out
+const GLchar* f15 =
+    "#version 100\n"
+    "#extension GL_OES_standard_derivatives : enable\n"
+    "precision mediump float;\n"
+    "uniform highp mat4 modelview;\n"
+    "varying vec3 vertPos;\n"
+    "varying highp vec3 objPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "highp vec3 dn = cross(dFdx(objPos), dFdy(objPos));\n"
+        "vec3 an = abs(dn);\n"
+        "vec3 normal = an.x > an.y && an.x > an.z ? vec3(sign(dn.x), 0.0, 0.0) : an.y > an.z ? vec3(0.0, sign(dn.y), 0.0) : vec3(0.0, 0.0, sign(dn.z));\n"
+        "mat3 lm = mat3(modelview[0].xyz, modelview[1].xyz, modelview[2].xyz);\n"
+        "normal *= sign(dot(cross(lm[0], lm[1]), lm[2]));\n"
+        "vec3 vertNorm = lm * normal;\n"
+        "vec3 ambientColor = vertCol * 0.148;\n"
+        "vec3 lightDir = normalize(vlightPos - vertPos);\n"
+        "float lambertian = max(dot(lightDir, normalize(vertNorm)), 0.0);\n"
+        "gl_FragColor = vec4(ambientColor + lambertian*vertCol, vertOpa);\n"
+    "}\n";
+
 const GLchar* v2 = 
     "#version 100\n" 
     "uniform mat4 modelview;\n"
@@ -510,6 +1058,106 @@ const GLchar* v23 =
         "gl_Position = projection * vertPos4;\n"
     "}\n";
    
+const GLchar* v24 = 
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform mat4 normalmat;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec3 color;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "varying vec3 normalInterp;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "float axis = floor(position.w * 0.5);\n"
+        "vec3 normal = vec3(equal(vec3(axis), vec3(0.0, 1.0, 2.0))) * (1.0 - 2.0 * (position.w - axis * 2.0));\n"
+        "vec4 vertPos4 = modelview * vec4(position.xyz * quant.x + quant.y, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "normalInterp = vec3(normalmat * vec4(normal, 0.0));\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+const GLchar* v26 = 
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec3 color;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "attribute vec4 instance;\n"
+    "varying vec3 normalInterp;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    GLSL_WIGGLE
+    "void main()\n"
+    "{\n"
+        "vec3 key = wiggleKey(position) + vec3(0.0, 0.0, instance.w);\n"
+        "mat4 mv = wiggleMat(modelview, key, 0.0);\n"
+        "vec3 c0 = cross(mv[1].xyz, mv[2].xyz);\n"
+        "vec3 c1 = cross(mv[2].xyz, mv[0].xyz);\n"
+        "vec3 c2 = cross(mv[0].xyz, mv[1].xyz);\n"
+        "mat4 nm = wiggleMat(mat4(vec4(c0, 0.0), vec4(c1, 0.0), vec4(c2, 0.0), vec4(0.0, 0.0, 0.0, 1.0)) * (1.0 / dot(mv[0].xyz, c0)), key, 1.0);\n"
+        "float face = position.w - floor((position.w + 0.5) / 8.0) * 8.0;\n"
+        "float axis = floor(face * 0.5);\n"
+        "vec3 normal = vec3(equal(vec3(axis), vec3(0.0, 1.0, 2.0))) * (1.0 - 2.0 * (face - axis * 2.0));\n"
+        "vec4 vertPos4 = mv * vec4(position.xyz * quant.x + quant.y + instance.xyz, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "normalInterp = vec3(nm * vec4(normal, 0.0));\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+const GLchar* v27 = 
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec3 color;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "varying vec3 normalInterp;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    GLSL_WIGGLE
+    "void main()\n"
+    "{\n"
+        "vec3 key = wiggleKey(position);\n"
+        "mat4 mv = wiggleMat(modelview, key, 0.0);\n"
+        // inverse transpose of the upper 3x3 is its cofactor matrix over the determinant
+        "vec3 c0 = cross(mv[1].xyz, mv[2].xyz);\n"
+        "vec3 c1 = cross(mv[2].xyz, mv[0].xyz);\n"
+        "vec3 c2 = cross(mv[0].xyz, mv[1].xyz);\n"
+        "mat4 nm = wiggleMat(mat4(vec4(c0, 0.0), vec4(c1, 0.0), vec4(c2, 0.0), vec4(0.0, 0.0, 0.0, 1.0)) * (1.0 / dot(mv[0].xyz, c0)), key, 1.0);\n"
+        "float face = position.w - floor((position.w + 0.5) / 8.0) * 8.0;\n"
+        "float axis = floor(face * 0.5);\n"
+        "vec3 normal = vec3(equal(vec3(axis), vec3(0.0, 1.0, 2.0))) * (1.0 - 2.0 * (face - axis * 2.0));\n"
+        "vec4 vertPos4 = mv * vec4(position.xyz * quant.x + quant.y, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "normalInterp = vec3(nm * vec4(normal, 0.0));\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
 const GLchar* f2 = 
     "#version 100\n" 
     "precision mediump float;\n"
@@ -546,6 +1194,74 @@ const GLchar* f2 =
         "gl_FragColor = vec4(ambientColor + max(specular * lumosity, 0.0), vertOpa);\n" // [0] .. you can max this
     "}\n";
 
+const GLchar* v25 = 
+    "#version 100\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec3 color;\n"
+    "uniform vec2 quant;\n"
+    "attribute vec4 position;\n"
+    "varying vec3 objPos;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "objPos = position.xyz * quant.x + quant.y;\n"
+        "vec4 vertPos4 = modelview * vec4(objPos, 1.0);\n"
+        "vertPos = vertPos4.xyz / vertPos4.w;\n"
+        "vertCol = color;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = lightpos;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+const GLchar* f25 = 
+    "#version 100\n"
+    "#extension GL_OES_standard_derivatives : enable\n"
+    "precision mediump float;\n"
+    "uniform highp mat4 modelview;\n"
+    "uniform highp mat4 normalmat;\n"
+    "varying highp vec3 objPos;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "highp vec3 dn = cross(dFdx(objPos), dFdy(objPos));\n"
+        "vec3 an = abs(dn);\n"
+        "vec3 fn = an.x > an.y && an.x > an.z ? vec3(sign(dn.x), 0.0, 0.0) : an.y > an.z ? vec3(0.0, sign(dn.y), 0.0) : vec3(0.0, 0.0, sign(dn.z));\n"
+        "fn *= sign(dot(cross(modelview[0].xyz, modelview[1].xyz), modelview[2].xyz));\n"
+        "vec3 ambientColor = vertCol * 0.14;\n"
+        "vec3 diffuseColor = vertCol;\n"
+        "vec3 specColor = vec3(1.0, 1.0, 1.0);\n"
+        "float specAmount = 4.0;\n"
+        "vec3 normal = normalize(vec3(normalmat * vec4(fn, 0.0)));\n"
+        "vec3 lightDir = normalize(vlightPos - vertPos);\n"
+        "vec3 viewDir = normalize(-vertPos);\n"
+#ifdef REGULAR_PHONG
+        "vec3 reflectDir = reflect(-lightDir, normal);\n"
+#else
+        "vec3 halfDir = normalize(viewDir + lightDir);\n"
+#endif
+        "float lumosity = dot(lightDir, normal);\n"
+        "vec3 specular = diffuseColor;\n"
+        "if(lumosity > 0.0)\n"
+        "{\n"
+#ifdef REGULAR_PHONG
+            "float specAngle = max(dot(reflectDir, viewDir), 0.0);\n"
+#else
+            "float specAngle = max(dot(halfDir, normal), 0.0);\n"
+#endif
+            "specular += pow(specAngle, specAmount) * specColor;\n"
+        "}\n"
+        "gl_FragColor = vec4(ambientColor + max(specular * lumosity, 0.0), vertOpa);\n"
+    "}\n";
+
 //
 
 GLuint shdFullbrightT;
@@ -624,24 +1340,87 @@ GLint  shdPhong3_lightpos;
 GLint  shdPhong3_color;
 GLint  shdPhong3_normal;
 GLint  shdPhong3_opacity;
+GLuint shdLambert4;
+GLint  shdLambert4_position;
+GLint  shdLambert4_projection;
+GLint  shdLambert4_modelview;
+GLint  shdLambert4_lightpos;
+GLint  shdLambert4_quant;
+GLint  shdLambert4_color;
+GLint  shdLambert4_opacity;
+GLuint shdPhong4;
+GLint  shdPhong4_position;
+GLint  shdPhong4_projection;
+GLint  shdPhong4_modelview;
+GLint  shdPhong4_normalmat;
+GLint  shdPhong4_lightpos;
+GLint  shdPhong4_quant;
+GLint  shdPhong4_color;
+GLint  shdPhong4_opacity;
+GLuint shdLambert5;
+GLint  shdLambert5_position;
+GLint  shdLambert5_projection;
+GLint  shdLambert5_modelview;
+GLint  shdLambert5_lightpos;
+GLint  shdLambert5_quant;
+GLint  shdLambert5_color;
+GLint  shdLambert5_opacity;
+GLuint shdPhong5;
+GLint  shdPhong5_position;
+GLint  shdPhong5_projection;
+GLint  shdPhong5_modelview;
+GLint  shdPhong5_normalmat;
+GLint  shdPhong5_lightpos;
+GLint  shdPhong5_quant;
+GLint  shdPhong5_color;
+GLint  shdPhong5_opacity;
+GLuint shdLambert6;
+GLint  shdLambert6_position;
+GLint  shdLambert6_projection;
+GLint  shdLambert6_modelview;
+GLint  shdLambert6_lightpos;
+GLint  shdLambert6_quant;
+GLint  shdLambert6_instance;
+GLint  shdLambert6_wparams;
+GLint  shdLambert6_witer;
+GLint  shdLambert6_color;
+GLint  shdLambert6_opacity;
+GLuint shdPhong6;
+GLint  shdPhong6_position;
+GLint  shdPhong6_projection;
+GLint  shdPhong6_modelview;
+GLint  shdPhong6_lightpos;
+GLint  shdPhong6_quant;
+GLint  shdPhong6_instance;
+GLint  shdPhong6_wparams;
+GLint  shdPhong6_witer;
+GLint  shdPhong6_color;
+GLint  shdPhong6_opacity;
+GLuint shdLambert7;
+GLint  shdLambert7_position;
+GLint  shdLambert7_projection;
+GLint  shdLambert7_modelview;
+GLint  shdLambert7_lightpos;
+GLint  shdLambert7_quant;
+GLint  shdLambert7_wparams;
+GLint  shdLambert7_witer;
+GLint  shdLambert7_color;
+GLint  shdLambert7_opacity;
+GLuint shdPhong7;
+GLint  shdPhong7_position;
+GLint  shdPhong7_projection;
+GLint  shdPhong7_modelview;
+GLint  shdPhong7_lightpos;
+GLint  shdPhong7_quant;
+GLint  shdPhong7_wparams;
+GLint  shdPhong7_witer;
+GLint  shdPhong7_color;
+GLint  shdPhong7_opacity;
 
 //
 void makeFullbrightT()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vt0, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &ft0, NULL);
-    glCompileShader(fragmentShader);
-
-    shdFullbrightT = glCreateProgram();
-        glAttachShader(shdFullbrightT, vertexShader);
-        glAttachShader(shdFullbrightT, fragmentShader);
-    glLinkProgram(shdFullbrightT);
-
-    if(debugShader(shdFullbrightT) == GL_FALSE){return;}
+    if(esMakeProgram(&shdFullbrightT, vt0, ft0, makeFullbrightT) == 0){return;}
 
     shdFullbrightT_position   = glGetAttribLocation(shdFullbrightT,  "position");
     shdFullbrightT_texcoord   = glGetAttribLocation(shdFullbrightT,  "texcoord");
@@ -654,20 +1433,7 @@ void makeFullbrightT()
 
 void makeFullbright()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v0, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f0, NULL);
-    glCompileShader(fragmentShader);
-
-    shdFullbright = glCreateProgram();
-        glAttachShader(shdFullbright, vertexShader);
-        glAttachShader(shdFullbright, fragmentShader);
-    glLinkProgram(shdFullbright);
-
-    if(debugShader(shdFullbright) == GL_FALSE){return;}
+    if(esMakeProgram(&shdFullbright, v0, f0, makeFullbright) == 0){return;}
 
     shdFullbright_position = glGetAttribLocation(shdFullbright, "position");
     
@@ -679,20 +1445,7 @@ void makeFullbright()
 
 void makeLambert()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v1, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f1, NULL);
-    glCompileShader(fragmentShader);
-
-    shdLambert = glCreateProgram();
-        glAttachShader(shdLambert, vertexShader);
-        glAttachShader(shdLambert, fragmentShader);
-    glLinkProgram(shdLambert);
-
-    if(debugShader(shdLambert) == GL_FALSE){return;}
+    if(esMakeProgram(&shdLambert, v1, f1, makeLambert) == 0){return;}
 
     shdLambert_position = glGetAttribLocation(shdLambert, "position");
     
@@ -705,20 +1458,7 @@ void makeLambert()
 
 void makeLambert1()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v11, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f1, NULL);
-    glCompileShader(fragmentShader);
-
-    shdLambert1 = glCreateProgram();
-        glAttachShader(shdLambert1, vertexShader);
-        glAttachShader(shdLambert1, fragmentShader);
-    glLinkProgram(shdLambert1);
-
-    if(debugShader(shdLambert1) == GL_FALSE){return;}
+    if(esMakeProgram(&shdLambert1, v11, f1, makeLambert1) == 0){return;}
 
     shdLambert1_position = glGetAttribLocation(shdLambert1, "position");
     shdLambert1_normal = glGetAttribLocation(shdLambert1, "normal");
@@ -732,20 +1472,7 @@ void makeLambert1()
 
 void makeLambert2()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v12, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f1, NULL);
-    glCompileShader(fragmentShader);
-
-    shdLambert2 = glCreateProgram();
-        glAttachShader(shdLambert2, vertexShader);
-        glAttachShader(shdLambert2, fragmentShader);
-    glLinkProgram(shdLambert2);
-
-    if(debugShader(shdLambert2) == GL_FALSE){return;}
+    if(esMakeProgram(&shdLambert2, v12, f1, makeLambert2) == 0){return;}
 
     shdLambert2_position = glGetAttribLocation(shdLambert2, "position");
     shdLambert2_color = glGetAttribLocation(shdLambert2, "color");
@@ -758,20 +1485,7 @@ void makeLambert2()
 
 void makeLambert3()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v13, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f1, NULL);
-    glCompileShader(fragmentShader);
-
-    shdLambert3 = glCreateProgram();
-        glAttachShader(shdLambert3, vertexShader);
-        glAttachShader(shdLambert3, fragmentShader);
-    glLinkProgram(shdLambert3);
-
-    if(debugShader(shdLambert3) == GL_FALSE){return;}
+    if(esMakeProgram(&shdLambert3, v13, f1, makeLambert3) == 0){return;}
 
     shdLambert3_position = glGetAttribLocation(shdLambert3, "position");
     shdLambert3_normal = glGetAttribLocation(shdLambert3, "normal");
@@ -785,20 +1499,7 @@ void makeLambert3()
 
 void makePhong()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v2, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f2, NULL);
-    glCompileShader(fragmentShader);
-
-    shdPhong = glCreateProgram();
-        glAttachShader(shdPhong, vertexShader);
-        glAttachShader(shdPhong, fragmentShader);
-    glLinkProgram(shdPhong);
-
-    if(debugShader(shdPhong) == GL_FALSE){return;}
+    if(esMakeProgram(&shdPhong, v2, f2, makePhong) == 0){return;}
 
     shdPhong_position = glGetAttribLocation(shdPhong, "position");
     
@@ -812,20 +1513,7 @@ void makePhong()
 
 void makePhong1()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v21, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f2, NULL);
-    glCompileShader(fragmentShader);
-
-    shdPhong1 = glCreateProgram();
-        glAttachShader(shdPhong1, vertexShader);
-        glAttachShader(shdPhong1, fragmentShader);
-    glLinkProgram(shdPhong1);
-
-    if(debugShader(shdPhong1) == GL_FALSE){return;}
+    if(esMakeProgram(&shdPhong1, v21, f2, makePhong1) == 0){return;}
 
     shdPhong1_position = glGetAttribLocation(shdPhong1, "position");
     shdPhong1_normal = glGetAttribLocation(shdPhong1, "normal");
@@ -840,20 +1528,7 @@ void makePhong1()
 
 void makePhong2()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v22, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f2, NULL);
-    glCompileShader(fragmentShader);
-
-    shdPhong2 = glCreateProgram();
-        glAttachShader(shdPhong2, vertexShader);
-        glAttachShader(shdPhong2, fragmentShader);
-    glLinkProgram(shdPhong2);
-
-    if(debugShader(shdPhong2) == GL_FALSE){return;}
+    if(esMakeProgram(&shdPhong2, v22, f2, makePhong2) == 0){return;}
 
     shdPhong2_position = glGetAttribLocation(shdPhong2, "position");
     shdPhong2_color = glGetAttribLocation(shdPhong2, "color");
@@ -867,20 +1542,7 @@ void makePhong2()
 
 void makePhong3()
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &v23, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &f2, NULL);
-    glCompileShader(fragmentShader);
-
-    shdPhong3 = glCreateProgram();
-        glAttachShader(shdPhong3, vertexShader);
-        glAttachShader(shdPhong3, fragmentShader);
-    glLinkProgram(shdPhong3);
-
-    if(debugShader(shdPhong3) == GL_FALSE){return;}
+    if(esMakeProgram(&shdPhong3, v23, f2, makePhong3) == 0){return;}
 
     shdPhong3_position = glGetAttribLocation(shdPhong3, "position");
     shdPhong3_color = glGetAttribLocation(shdPhong3, "color");
@@ -893,6 +1555,130 @@ void makePhong3()
     shdPhong3_opacity = glGetUniformLocation(shdPhong3, "opacity");
 }
 
+void makeLambert4()
+{
+    if(esMakeProgram(&shdLambert4, v14, f1, makeLambert4) == 0){return;}
+
+    shdLambert4_position = glGetAttribLocation(shdLambert4, "position");
+    
+    shdLambert4_projection = glGetUniformLocation(shdLambert4, "projection");
+    shdLambert4_modelview = glGetUniformLocation(shdLambert4, "modelview");
+    shdLambert4_lightpos = glGetUniformLocation(shdLambert4, "lightpos");
+    shdLambert4_quant = glGetUniformLocation(shdLambert4, "quant");
+    shdLambert4_color = glGetUniformLocation(shdLambert4, "color");
+    shdLambert4_opacity = glGetUniformLocation(shdLambert4, "opacity");
+}
+
+void makePhong4()
+{
+    if(esMakeProgram(&shdPhong4, v24, f2, makePhong4) == 0){return;}
+
+    shdPhong4_position = glGetAttribLocation(shdPhong4, "position");
+    
+    shdPhong4_projection = glGetUniformLocation(shdPhong4, "projection");
+    shdPhong4_modelview = glGetUniformLocation(shdPhong4, "modelview");
+    shdPhong4_normalmat = glGetUniformLocation(shdPhong4, "normalmat");
+    shdPhong4_lightpos = glGetUniformLocation(shdPhong4, "lightpos");
+    shdPhong4_quant = glGetUniformLocation(shdPhong4, "quant");
+    shdPhong4_opacity = glGetUniformLocation(shdPhong4, "opacity");
+    shdPhong4_color = glGetUniformLocation(shdPhong4, "color");
+}
+
+void makeLambert5()
+{
+    if(esMakeProgram(&shdLambert5, v15, f15, makeLambert5) == 0){return;}
+
+    shdLambert5_position = glGetAttribLocation(shdLambert5, "position");
+    
+    shdLambert5_projection = glGetUniformLocation(shdLambert5, "projection");
+    shdLambert5_modelview = glGetUniformLocation(shdLambert5, "modelview");
+    shdLambert5_lightpos = glGetUniformLocation(shdLambert5, "lightpos");
+    shdLambert5_quant = glGetUniformLocation(shdLambert5, "quant");
+    shdLambert5_color = glGetUniformLocation(shdLambert5, "color");
+    shdLambert5_opacity = glGetUniformLocation(shdLambert5, "opacity");
+}
+
+void makePhong5()
+{
+    if(esMakeProgram(&shdPhong5, v25, f25, makePhong5) == 0){return;}
+
+    shdPhong5_position = glGetAttribLocation(shdPhong5, "position");
+    
+    shdPhong5_projection = glGetUniformLocation(shdPhong5, "projection");
+    shdPhong5_modelview = glGetUniformLocation(shdPhong5, "modelview");
+    shdPhong5_normalmat = glGetUniformLocation(shdPhong5, "normalmat");
+    shdPhong5_lightpos = glGetUniformLocation(shdPhong5, "lightpos");
+    shdPhong5_quant = glGetUniformLocation(shdPhong5, "quant");
+    shdPhong5_opacity = glGetUniformLocation(shdPhong5, "opacity");
+    shdPhong5_color = glGetUniformLocation(shdPhong5, "color");
+}
+
+void makeLambert6()
+{
+    if(esMakeProgram(&shdLambert6, v16, f1, makeLambert6) == 0){return;}
+
+    shdLambert6_position = glGetAttribLocation(shdLambert6, "position");
+    shdLambert6_instance = glGetAttribLocation(shdLambert6, "instance");
+    
+    shdLambert6_projection = glGetUniformLocation(shdLambert6, "projection");
+    shdLambert6_modelview = glGetUniformLocation(shdLambert6, "modelview");
+    shdLambert6_lightpos = glGetUniformLocation(shdLambert6, "lightpos");
+    shdLambert6_quant = glGetUniformLocation(shdLambert6, "quant");
+    shdLambert6_wparams = glGetUniformLocation(shdLambert6, "wparams");
+    shdLambert6_witer = glGetUniformLocation(shdLambert6, "witer");
+    shdLambert6_color = glGetUniformLocation(shdLambert6, "color");
+    shdLambert6_opacity = glGetUniformLocation(shdLambert6, "opacity");
+}
+
+void makePhong6()
+{
+    if(esMakeProgram(&shdPhong6, v26, f2, makePhong6) == 0){return;}
+
+    shdPhong6_position = glGetAttribLocation(shdPhong6, "position");
+    shdPhong6_instance = glGetAttribLocation(shdPhong6, "instance");
+    
+    shdPhong6_projection = glGetUniformLocation(shdPhong6, "projection");
+    shdPhong6_modelview = glGetUniformLocation(shdPhong6, "modelview");
+    shdPhong6_lightpos = glGetUniformLocation(shdPhong6, "lightpos");
+    shdPhong6_quant = glGetUniformLocation(shdPhong6, "quant");
+    shdPhong6_wparams = glGetUniformLocation(shdPhong6, "wparams");
+    shdPhong6_witer = glGetUniformLocation(shdPhong6, "witer");
+    shdPhong6_opacity = glGetUniformLocation(shdPhong6, "opacity");
+    shdPhong6_color = glGetUniformLocation(shdPhong6, "color");
+}
+
+void makeLambert7()
+{
+    if(esMakeProgram(&shdLambert7, v17, f1, makeLambert7) == 0){return;}
+
+    shdLambert7_position = glGetAttribLocation(shdLambert7, "position");
+    
+    shdLambert7_projection = glGetUniformLocation(shdLambert7, "projection");
+    shdLambert7_modelview = glGetUniformLocation(shdLambert7, "modelview");
+    shdLambert7_lightpos = glGetUniformLocation(shdLambert7, "lightpos");
+    shdLambert7_quant = glGetUniformLocation(shdLambert7, "quant");
+    shdLambert7_wparams = glGetUniformLocation(shdLambert7, "wparams");
+    shdLambert7_witer = glGetUniformLocation(shdLambert7, "witer");
+    shdLambert7_color = glGetUniformLocation(shdLambert7, "color");
+    shdLambert7_opacity = glGetUniformLocation(shdLambert7, "opacity");
+}
+
+void makePhong7()
+{
+    if(esMakeProgram(&shdPhong7, v27, f2, makePhong7) == 0){return;}
+
+    shdPhong7_position = glGetAttribLocation(shdPhong7, "position");
+    
+    shdPhong7_projection = glGetUniformLocation(shdPhong7, "projection");
+    shdPhong7_modelview = glGetUniformLocation(shdPhong7, "modelview");
+    shdPhong7_lightpos = glGetUniformLocation(shdPhong7, "lightpos");
+    shdPhong7_quant = glGetUniformLocation(shdPhong7, "quant");
+    shdPhong7_wparams = glGetUniformLocation(shdPhong7, "wparams");
+    shdPhong7_witer = glGetUniformLocation(shdPhong7, "witer");
+    shdPhong7_opacity = glGetUniformLocation(shdPhong7, "opacity");
+    shdPhong7_color = glGetUniformLocation(shdPhong7, "color");
+}
+
 void makeAllShaders()
 {
     makeFullbrightT();
@@ -905,10 +1691,19 @@ void makeAllShaders()
     makePhong1();
     makePhong2();
     makePhong3();
+    makeLambert4();
+    makePhong4();
+    makeLambert5();
+    makePhong5();
+    makeLambert6();
+    makePhong6();
+    makeLambert7();
+    makePhong7();
 }
 
 void shadeFullbrightT(GLint* position, GLint* projection, GLint* modelview, GLint* texcoord, GLint* sampler)
 {
+    esFinish(&shdFullbrightT);
     *position = shdFullbrightT_position;
     *projection = shdFullbrightT_projection;
     *modelview = shdFullbrightT_modelview;
@@ -919,6 +1714,7 @@ void shadeFullbrightT(GLint* position, GLint* projection, GLint* modelview, GLin
 
 void shadeFullbright(GLint* position, GLint* projection, GLint* modelview, GLint* color, GLint* opacity)
 {
+    esFinish(&shdFullbright);
     *position = shdFullbright_position;
     *projection = shdFullbright_projection;
     *modelview = shdFullbright_modelview;
@@ -929,6 +1725,7 @@ void shadeFullbright(GLint* position, GLint* projection, GLint* modelview, GLint
 
 void shadeLambert(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* color, GLint* opacity)
 {
+    esFinish(&shdLambert);
     *position = shdLambert_position;
     *projection = shdLambert_projection;
     *modelview = shdLambert_modelview;
@@ -940,6 +1737,7 @@ void shadeLambert(GLint* position, GLint* projection, GLint* modelview, GLint* l
 
 void shadeLambert1(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity)
 {
+    esFinish(&shdLambert1);
     *position = shdLambert1_position;
     *projection = shdLambert1_projection;
     *modelview = shdLambert1_modelview;
@@ -952,6 +1750,7 @@ void shadeLambert1(GLint* position, GLint* projection, GLint* modelview, GLint*
 
 void shadeLambert2(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* color, GLint* opacity)
 {
+    esFinish(&shdLambert2);
     *position = shdLambert2_position;
     *projection = shdLambert2_projection;
     *modelview = shdLambert2_modelview;
@@ -963,6 +1762,7 @@ void shadeLambert2(GLint* position, GLint* projection, GLint* modelview, GLint*
 
 void shadeLambert3(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity)
 {
+    esFinish(&shdLambert3);
     *position = shdLambert3_position;
     *projection = shdLambert3_projection;
     *modelview = shdLambert3_modelview;
@@ -975,6 +1775,7 @@ void shadeLambert3(GLint* position, GLint* projection, GLint* modelview, GLint*
 
 void shadePhong(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* color, GLint* opacity)
 {
+    esFinish(&shdPhong);
     *position = shdPhong_position;
     *projection = shdPhong_projection;
     *modelview = shdPhong_modelview;
@@ -987,6 +1788,7 @@ void shadePhong(GLint* position, GLint* projection, GLint* modelview, GLint* nor
 
 void shadePhong1(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity)
 {
+    esFinish(&shdPhong1);
     *position = shdPhong1_position;
     *projection = shdPhong1_projection;
     *modelview = shdPhong1_modelview;
@@ -1000,6 +1802,7 @@ void shadePhong1(GLint* position, GLint* projection, GLint* modelview, GLint* no
 
 void shadePhong2(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* color, GLint* opacity)
 {
+    esFinish(&shdPhong2);
     *position = shdPhong2_position;
     *projection = shdPhong2_projection;
     *modelview = shdPhong2_modelview;
@@ -1012,6 +1815,7 @@ void shadePhong2(GLint* position, GLint* projection, GLint* modelview, GLint* no
 
 void shadePhong3(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity)
 {
+    esFinish(&shdPhong3);
     *position = shdPhong3_position;
     *projection = shdPhong3_projection;
     *modelview = shdPhong3_modelview;
@@ -1023,4 +1827,120 @@ void shadePhong3(GLint* position, GLint* projection, GLint* modelview, GLint* no
     glUseProgram(shdPhong3);
 }
 
+void shadeLambert4(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity)
+{
+    esFinish(&shdLambert4);
+    *position = shdLambert4_position;
+    *projection = shdLambert4_projection;
+    *modelview = shdLambert4_modelview;
+    *lightpos = shdLambert4_lightpos;
+    *quant = shdLambert4_quant;
+    *color = shdLambert4_color;
+    *opacity = shdLambert4_opacity;
+    glUseProgram(shdLambert4);
+}
+
+void shadePhong4(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity)
+{
+    esFinish(&shdPhong4);
+    *position = shdPhong4_position;
+    *projection = shdPhong4_projection;
+    *modelview = shdPhong4_modelview;
+    *normalmat = shdPhong4_normalmat;
+    *lightpos = shdPhong4_lightpos;
+    *quant = shdPhong4_quant;
+    *color = shdPhong4_color;
+    *opacity = shdPhong4_opacity;
+    glUseProgram(shdPhong4);
+}
+
+void shadeLambert5(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity)
+{
+    esFinish(&shdLambert5);
+    *position = shdLambert5_position;
+    *projection = shdLambert5_projection;
+    *modelview = shdLambert5_modelview;
+    *lightpos = shdLambert5_lightpos;
+    *quant = shdLambert5_quant;
+    *color = shdLambert5_color;
+    *opacity = shdLambert5_opacity;
+    glUseProgram(shdLambert5);
+}
+
+void shadePhong5(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* quant, GLint* color, GLint* opacity)
+{
+    esFinish(&shdPhong5);
+    *position = shdPhong5_position;
+    *projection = shdPhong5_projection;
+    *modelview = shdPhong5_modelview;
+    *normalmat = shdPhong5_normalmat;
+    *lightpos = shdPhong5_lightpos;
+    *quant = shdPhong5_quant;
+    *color = shdPhong5_color;
+    *opacity = shdPhong5_opacity;
+    glUseProgram(shdPhong5);
+}
+
+void shadeLambert6(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* instance, GLint* wparams, GLint* witer, GLint* color, GLint* opacity)
+{
+    esFinish(&shdLambert6);
+    *position = shdLambert6_position;
+    *projection = shdLambert6_projection;
+    *modelview = shdLambert6_modelview;
+    *lightpos = shdLambert6_lightpos;
+    *quant = shdLambert6_quant;
+    *instance = shdLambert6_instance;
+    *wparams = shdLambert6_wparams;
+    *witer = shdLambert6_witer;
+    *color = shdLambert6_color;
+    *opacity = shdLambert6_opacity;
+    glUseProgram(shdLambert6);
+}
+
+void shadePhong6(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* instance, GLint* wparams, GLint* witer, GLint* color, GLint* opacity)
+{
+    esFinish(&shdPhong6);
+    *position = shdPhong6_position;
+    *projection = shdPhong6_projection;
+    *modelview = shdPhong6_modelview;
+    *lightpos = shdPhong6_lightpos;
+    *quant = shdPhong6_quant;
+    *instance = shdPhong6_instance;
+    *wparams = shdPhong6_wparams;
+    *witer = shdPhong6_witer;
+    *color = shdPhong6_color;
+    *opacity = shdPhong6_opacity;
+    glUseProgram(shdPhong6);
+}
+
+void shadeLambert7(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* wparams, GLint* witer, GLint* color, GLint* opacity)
+{
+    esFinish(&shdLambert7);
+    *position = shdLambert7_position;
+    *projection = shdLambert7_projection;
+    *modelview = shdLambert7_modelview;
+    *lightpos = shdLambert7_lightpos;
+    *quant = shdLambert7_quant;
+    *wparams = shdLambert7_wparams;
+    *witer = shdLambert7_witer;
+    *color = shdLambert7_color;
+    *opacity = shdLambert7_opacity;
+    glUseProgram(shdLambert7);
+}
+
+void shadePhong7(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* quant, GLint* wparams, GLint* witer, GLint* color, GLint* opacity)
+{
+    esFinish(&shdPhong7);
+    *position = shdPhong7_position;
+    *projection = shdPhong7_projection;
+    *modelview = shdPhong7_modelview;
+    *lightpos = shdPhong7_lightpos;
+    *quant = shdPhong7_quant;
+    *wparams = shdPhong7_wparams;
+    *witer = shdPhong7_witer;
+    *color = shdPhong7_color;
+    *opacity = shdPhong7_opacity;
+    glUseProgram(shdPhong7);
+}
+
 #endif
\ No newline at end of file
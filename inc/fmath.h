@@ -0,0 +1,263 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Polynomial sin, cos, exp and log
+
+    Two tiers. FM_PRECISE is the Cephes single precision polynomials after
+    a three part Cody-Waite reduction, a couple of ulp from libm. FM_FAST
+    drops a term from each and reduces in one step, 5e-5 for sin and cos
+    near zero growing with |x|, 4e-4 for exp and 1e-4 for log, about what
+    rsqrtss gives vNorm().
+
+    fm8SinCos(), fm8Exp() and fm8Log() are 8 lanes of a GCC vector for
+    kernels that keep their values in registers, the baseline builds them
+    as SSE or NEON pairs. fmSinCosN(), fmExpN() and fmLogN() run over
+    arrays, compiled once for AVX2 + FMA and once for the baseline and
+    picked by fmInit() like vec_soa.h.
+
+    A value at a time stays with libm, glibc's is table driven and as
+    quick as the polynomial at half an ulp.
+
+    sin and cos reduce by pi/2 in float, past FM_TRIG_MAX that would lose
+    the low bits of the angle so those lanes go to libm. -Ofast would
+    subtract the parts of pi/2 and ln2 in any order, FM_KEEP() makes the
+    exact one go first. exp clamps to the normal float range. log wants
+    x > 0 and normal.
+
+    See: ./wiggle --bench math
+*/
+
+#ifndef FMATH_H
+#define FMATH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#define FM_FAST 0
+#define FM_PRECISE 1
+
+#define FM_TRIG_MAX 8192.f
+#define FM_EXP_MIN -87.3f               // 2^-126, the smallest normal
+#define FM_EXP_MAX 88.37f               // below 2^127.5
+
+#define FM_2_PI 0.6366197724f           // 2 / pi
+#define FM_PIO2 1.570796327f            // pi / 2, FM_FAST
+#define FM_PIO2_1 1.5703125f            // pi / 2 in three parts, FM_PRECISE
+#define FM_PIO2_2 4.837512969970703125e-4f
+#define FM_PIO2_3 7.54978995489188216e-8f
+#define FM_LOG2E 1.442695041f
+#define FM_LN2 0.6931471806f            // FM_FAST
+#define FM_LN2_1 0.693359375f           // ln 2 in two parts, FM_PRECISE
+#define FM_LN2_2 -2.12194440e-4f
+#define FM_SQRTH 0.7071067812f
+
+// the value has to be computed here, a memory operand works for any type on any target
+#define FM_KEEP(v) __asm__("" : "+m"(v))
+
+typedef float fm8 __attribute__((vector_size(32)));
+typedef int32_t fmi8 __attribute__((vector_size(32)));
+typedef uint32_t fmu8 __attribute__((vector_size(32)));
+
+void fmInit(); // picks the AVX2 kernels by CPUID
+void fmSinCosN(float* s, float* c, const float* x, const size_t n, const int tier); // s or c may be x
+void fmExpN(float* r, const float* x, const size_t n, const int tier); // r may be x
+void fmLogN(float* r, const float* x, const size_t n, const int tier); // r may be x
+
+//
+
+// sin on [-pi/4, pi/4] as r + r^3 P(r^2), cos as 1 - r^2/2 + r^4 Q(r^2)
+#define FM_SIN_P(z) (-1.6666654611e-1f + (z) * (8.3321608736e-3f + (z) * -1.9515295891e-4f))
+#define FM_COS_Q(z) (4.166664568298827e-2f + (z) * (-1.388731625493765e-3f + (z) * 2.443315711809948e-5f))
+#define FM_SIN_P_FAST(z) (-1.666611247e-1f + (z) * 8.220790522e-3f)
+#define FM_COS_FAST(z) (1.f + (z) * (-4.999613214e-1f + (z) * 4.088061461e-2f))
+
+// exp on [-ln2/2, ln2/2] as 1 + r + r^2 P(r)
+#define FM_EXP_P(r) (5.0000001201e-1f + (r) * (1.6666665459e-1f + (r) * (4.1665795894e-2f + (r) * (8.3334519073e-3f + (r) * (1.3981999507e-3f + (r) * 1.9875691500e-4f)))))
+#define FM_EXP_P_FAST(r) (5.025098871e-1f + (r) * 1.674191662e-1f)
+
+// log(1 + m) on [sqrt(1/2) - 1, sqrt(2) - 1] as m - m^2/2 + m^3 P(m)
+#define FM_LOG_P(m) (3.3333331174e-1f + (m) * (-2.4999993993e-1f + (m) * (2.0000714765e-1f + (m) * (-1.6668057665e-1f + (m) * \
+                    (1.4249322787e-1f + (m) * (-1.2420140846e-1f + (m) * (1.1676998740e-1f + (m) * (-1.1514610310e-1f + (m) * 7.0376836292e-2f))))))))
+#define FM_LOG_P_FAST(m) (3.339481701e-1f + (m) * (-2.639461534e-1f + (m) * 1.875902450e-1f))
+
+// an fm8 never goes through a call: without AVX a 32 byte vector argument or return value
+// changes the ABI and GCC says so (-Wpsabi), so the one liners are macros and the rest take pointers
+#define fm8Splat(f) ({const float fm8Splat_f = (f); (fm8){fm8Splat_f, fm8Splat_f, fm8Splat_f, fm8Splat_f, fm8Splat_f, fm8Splat_f, fm8Splat_f, fm8Splat_f};})
+
+// all ones where a < b, from the sign of a - b, the baseline would compare a lane at a time
+#define fm8Less(a, b) ((fmi8)((a) - (b)) >> 31)
+
+// a where m is all ones
+#define fm8Sel(m, a, b) ({const fmi8 fm8Sel_m = (m); (fm8)(((fmi8)(a) & fm8Sel_m) | ((fmi8)(b) & ~fm8Sel_m));})
+
+// to nearest, halves away from zero
+#define fm8Round(t) ({const fm8 fm8Round_t = (t); __builtin_convertvector(fm8Round_t + 0.5f + __builtin_convertvector((fmi8)fm8Round_t >> 31, fm8), fmi8);})
+
+static inline __attribute__((always_inline)) void fm8SinCos(const fm8* px, fm8* s, fm8* c, const int tier)
+{
+    const fm8 x = *px;
+    const fmi8 q = fm8Round(x * FM_2_PI);
+    const fm8 fq = __builtin_convertvector(q, fm8);
+    fm8 ps, pc;
+    if(tier == FM_FAST)
+    {
+        const fm8 r = x - fq * FM_PIO2;
+        const fm8 z = r * r;
+        ps = r + r * z * FM_SIN_P_FAST(z);
+        pc = FM_COS_FAST(z);
+    }
+    else
+    {
+        fm8 r = x - fq * FM_PIO2_1;
+        FM_KEEP(r);
+        r = (r - fq * FM_PIO2_2) - fq * FM_PIO2_3;
+        const fm8 z = r * r;
+        ps = r + r * z * FM_SIN_P(z);
+        pc = 1.f - 0.5f * z + z * z * FM_COS_Q(z);
+    }
+    const fmi8 odd = -(q & 1);
+    *s = (fm8)((fmu8)fm8Sel(odd, pc, ps) ^ ((fmu8)(q & 2) << 30));
+    *c = (fm8)((fmu8)fm8Sel(odd, ps, pc) ^ ((fmu8)((q + 1) & 2) << 30));
+
+    // the rare lane past FM_TRIG_MAX
+    const fmi8 big = ((fmi8)fm8Splat(FM_TRIG_MAX) - (fmi8)((fmu8)x & 0x7fffffff)) >> 31; // |x| as bits, no NaN in the way
+    uint64_t w[4];
+    memcpy(w, &big, sizeof(fmi8));
+    if((w[0] | w[1] | w[2] | w[3]) != 0)
+        for(int i = 0; i < 8; i++)
+            if(big[i] != 0){(*s)[i] = sinf(x[i]), (*c)[i] = cosf(x[i]);}
+}
+
+static inline __attribute__((always_inline)) void fm8Exp(fm8* px, const int tier)
+{
+    fm8 x = *px;
+    x = fm8Sel(fm8Less(x, fm8Splat(FM_EXP_MIN)), fm8Splat(FM_EXP_MIN), x);
+    x = fm8Sel(fm8Less(fm8Splat(FM_EXP_MAX), x), fm8Splat(FM_EXP_MAX), x);
+    const fmi8 n = fm8Round(x * FM_LOG2E);
+    const fm8 fn = __builtin_convertvector(n, fm8);
+    const fm8 p = (fm8)((fmu8)(n + 127) << 23);
+    if(tier == FM_FAST)
+    {
+        const fm8 r = x - fn * FM_LN2;
+        *px = (1.f + r + r * r * FM_EXP_P_FAST(r)) * p;
+        return;
+    }
+    fm8 r = x - fn * FM_LN2_1;
+    FM_KEEP(r);
+    r = r - fn * FM_LN2_2;
+    *px = (1.f + r + r * r * FM_EXP_P(r)) * p;
+}
+
+static inline __attribute__((always_inline)) void fm8Log(fm8* px, const int tier)
+{
+    const fmu8 b = (fmu8)*px;
+    const fm8 h = (fm8)((b & 0x007fffff) | 0x3f000000);
+    const fmi8 lo = fm8Less(h, fm8Splat(FM_SQRTH));
+    const fm8 m = h + (fm8)((fmi8)h & lo) - 1.f; // doubled where below sqrt(1/2)
+    const fm8 fe = __builtin_convertvector((fmi8)(b >> 23) - 126 + lo, fm8);
+    const fm8 z = m * m;
+    if(tier == FM_FAST)
+        *px = m - 0.5f * z + m * z * FM_LOG_P_FAST(m) + fe * FM_LN2;
+    else
+        *px = m + (m * z * FM_LOG_P(m) + fe * FM_LN2_2 - 0.5f * z) + fe * FM_LN2_1;
+}
+
+//
+
+static inline __attribute__((always_inline)) void fmSinCosNKernel(float* s, float* c, const float* x, const size_t n, const int tier)
+{
+    size_t i = 0;
+    fm8 v, vs, vc;
+    for(; i + 8 <= n; i += 8)
+    {
+        memcpy(&v, &x[i], sizeof(fm8));
+        fm8SinCos(&v, &vs, &vc, tier);
+        memcpy(&s[i], &vs, sizeof(fm8));
+        memcpy(&c[i], &vc, sizeof(fm8));
+    }
+    if(i == n){return;}
+    v = fm8Splat(0.f);
+    memcpy(&v, &x[i], (n - i) * sizeof(float));
+    fm8SinCos(&v, &vs, &vc, tier);
+    memcpy(&s[i], &vs, (n - i) * sizeof(float));
+    memcpy(&c[i], &vc, (n - i) * sizeof(float));
+}
+
+static inline __attribute__((always_inline)) void fmExpNKernel(float* r, const float* x, const size_t n, const int tier)
+{
+    size_t i = 0;
+    fm8 v;
+    for(; i + 8 <= n; i += 8)
+    {
+        memcpy(&v, &x[i], sizeof(fm8));
+        fm8Exp(&v, tier);
+        memcpy(&r[i], &v, sizeof(fm8));
+    }
+    if(i == n){return;}
+    v = fm8Splat(0.f);
+    memcpy(&v, &x[i], (n - i) * sizeof(float));
+    fm8Exp(&v, tier);
+    memcpy(&r[i], &v, (n - i) * sizeof(float));
+}
+
+static inline __attribute__((always_inline)) void fmLogNKernel(float* r, const float* x, const size_t n, const int tier)
+{
+    size_t i = 0;
+    fm8 v;
+    for(; i + 8 <= n; i += 8)
+    {
+        memcpy(&v, &x[i], sizeof(fm8));
+        fm8Log(&v, tier);
+        memcpy(&r[i], &v, sizeof(fm8));
+    }
+    if(i == n){return;}
+    v = fm8Splat(1.f);
+    memcpy(&v, &x[i], (n - i) * sizeof(float));
+    fm8Log(&v, tier);
+    memcpy(&r[i], &v, (n - i) * sizeof(float));
+}
+
+// the tier as a constant so each build has its own loops
+#define FM_TIERS(call) if(tier == FM_FAST){call(FM_FAST);}else{call(FM_PRECISE);}
+#define FM_SINCOS(t) fmSinCosNKernel(s, c, x, n, t)
+#define FM_EXP(t) fmExpNKernel(r, x, n, t)
+#define FM_LOG(t) fmLogNKernel(r, x, n, t)
+
+#ifndef NOSSE
+__attribute__((target("avx2,fma"))) void fmSinCosNAVX2(float* s, float* c, const float* x, const size_t n, const int tier){FM_TIERS(FM_SINCOS)}
+__attribute__((target("avx2,fma"))) void fmExpNAVX2(float* r, const float* x, const size_t n, const int tier){FM_TIERS(FM_EXP)}
+__attribute__((target("avx2,fma"))) void fmLogNAVX2(float* r, const float* x, const size_t n, const int tier){FM_TIERS(FM_LOG)}
+#endif
+void fmSinCosNBase(float* s, float* c, const float* x, const size_t n, const int tier){FM_TIERS(FM_SINCOS)}
+void fmExpNBase(float* r, const float* x, const size_t n, const int tier){FM_TIERS(FM_EXP)}
+void fmLogNBase(float* r, const float* x, const size_t n, const int tier){FM_TIERS(FM_LOG)}
+
+#undef FM_TIERS
+#undef FM_SINCOS
+#undef FM_EXP
+#undef FM_LOG
+
+int fm_avx2 = 0;
+
+void fmInit()
+{
+#ifndef NOSSE
+    __builtin_cpu_init();
+    fm_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#ifndef NOSSE
+void fmSinCosN(float* s, float* c, const float* x, const size_t n, const int tier){if(fm_avx2 == 1){fmSinCosNAVX2(s, c, x, n, tier);}else{fmSinCosNBase(s, c, x, n, tier);}}
+void fmExpN(float* r, const float* x, const size_t n, const int tier){if(fm_avx2 == 1){fmExpNAVX2(r, x, n, tier);}else{fmExpNBase(r, x, n, tier);}}
+void fmLogN(float* r, const float* x, const size_t n, const int tier){if(fm_avx2 == 1){fmLogNAVX2(r, x, n, tier);}else{fmLogNBase(r, x, n, tier);}}
+#else
+void fmSinCosN(float* s, float* c, const float* x, const size_t n, const int tier){fmSinCosNBase(s, c, x, n, tier);}
+void fmExpN(float* r, const float* x, const size_t n, const int tier){fmExpNBase(r, x, n, tier);}
+void fmLogN(float* r, const float* x, const size_t n, const int tier){fmLogNBase(r, x, n, tier);}
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Offscreen OpenGL context for machines without a display.
+
+    libEGL is opened at runtime so windowed builds gain no link dependency,
+    the few EGL types and enums used are declared here. The display is the
+    Mesa surfaceless platform when the client supports it (llvmpipe on a
+    box with no GPU and no X) or else the default display. A pbuffer is
+    made current if the config allows, otherwise no surface at all.
+
+    Either way rendering goes to a framebuffer object from hlFramebuffer()
+    so the draw target is the same size and format on every machine.
+
+    Usage:
+        if(hlInit() == 0){fail}
+        gladLoadGL(hlGetProcAddress);
+        if(hlFramebuffer(w, h) == 0){fail}
+        ...
+        hlDestroy();
+*/
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+typedef void* hlEGLDisplay;
+typedef void* hlEGLConfig;
+typedef void* hlEGLContext;
+typedef void* hlEGLSurface;
+typedef int32_t hlEGLint;
+
+#define HL_EGL_ALPHA_SIZE 0x3021
+#define HL_EGL_BLUE_SIZE 0x3022
+#define HL_EGL_GREEN_SIZE 0x3023
+#define HL_EGL_RED_SIZE 0x3024
+#define HL_EGL_DEPTH_SIZE 0x3025
+#define HL_EGL_SURFACE_TYPE 0x3033
+#define HL_EGL_NONE 0x3038
+#define HL_EGL_RENDERABLE_TYPE 0x3040
+#define HL_EGL_VENDOR 0x3053
+#define HL_EGL_EXTENSIONS 0x3055
+#define HL_EGL_HEIGHT 0x3056
+#define HL_EGL_WIDTH 0x3057
+#define HL_EGL_OPENGL_API 0x30A2
+#define HL_EGL_PBUFFER_BIT 0x0001
+#define HL_EGL_OPENGL_BIT 0x0008
+#define HL_EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+
+struct
+{
+    void* lib;
+    hlEGLDisplay display;
+    hlEGLContext context;
+    hlEGLSurface surface;
+    GLuint fbo, rbo[2];
+
+    void*        (*GetProcAddress)(const char*);
+    hlEGLDisplay (*GetDisplay)(void*);
+    hlEGLDisplay (*GetPlatformDisplayEXT)(unsigned, void*, const hlEGLint*);
+    unsigned     (*Initialize)(hlEGLDisplay, hlEGLint*, hlEGLint*);
+    unsigned     (*Terminate)(hlEGLDisplay);
+    const char*  (*QueryString)(hlEGLDisplay, hlEGLint);
+    unsigned     (*BindAPI)(unsigned);
+    unsigned     (*ChooseConfig)(hlEGLDisplay, const hlEGLint*, hlEGLConfig*, hlEGLint, hlEGLint*);
+    hlEGLContext (*CreateContext)(hlEGLDisplay, hlEGLConfig, hlEGLContext, const hlEGLint*);
+    hlEGLSurface (*CreatePbufferSurface)(hlEGLDisplay, hlEGLConfig, const hlEGLint*);
+    unsigned     (*MakeCurrent)(hlEGLDisplay, hlEGLSurface, hlEGLSurface, hlEGLContext);
+    unsigned     (*DestroyContext)(hlEGLDisplay, hlEGLContext);
+    unsigned     (*DestroySurface)(hlEGLDisplay, hlEGLSurface);
+} hl;
+
+int         hlInit(); // returns 0 on failure, the context is current on success
+GLADapiproc hlGetProcAddress(const char* name);
+int         hlFramebuffer(const GLuint w, const GLuint h); // returns 0 on failure, binds a color + depth target
+void        hlDestroy();
+
+//
+
+GLADapiproc hlGetProcAddress(const char* name)
+{
+    return (GLADapiproc)hl.GetProcAddress(name);
+}
+
+int hlInit()
+{
+    memset(&hl, 0, sizeof(hl));
+    hl.lib = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if(hl.lib == NULL){hl.lib = dlopen("libEGL.so", RTLD_NOW | RTLD_LOCAL);}
+    if(hl.lib == NULL){printf("headless: libEGL not found: %s\n", dlerror()); return 0;}
+
+    #define HL_LOAD(f) *(void**)&hl.f = dlsym(hl.lib, "egl" #f); if(hl.f == NULL){printf("headless: missing egl" #f "\n"); return 0;}
+    HL_LOAD(GetProcAddress)
+    HL_LOAD(GetDisplay)
+    HL_LOAD(Initialize)
+    HL_LOAD(Terminate)
+    HL_LOAD(QueryString)
+    HL_LOAD(BindAPI)
+    HL_LOAD(ChooseConfig)
+    HL_LOAD(CreateContext)
+    HL_LOAD(CreatePbufferSurface)
+    HL_LOAD(MakeCurrent)
+    HL_LOAD(DestroyContext)
+    HL_LOAD(DestroySurface)
+    #undef HL_LOAD
+
+    // client extensions, queried without a display
+    const char* cext = hl.QueryString(NULL, HL_EGL_EXTENSIONS);
+    *(void**)&hl.GetPlatformDisplayEXT = hl.GetProcAddress("eglGetPlatformDisplayEXT");
+    if(cext != NULL && strstr(cext, "EGL_MESA_platform_surfaceless") != NULL && hl.GetPlatformDisplayEXT != NULL)
+        hl.display = hl.GetPlatformDisplayEXT(HL_EGL_PLATFORM_SURFACELESS_MESA, NULL, NULL);
+    if(hl.display == NULL)
+        hl.display = hl.GetDisplay(NULL);
+    if(hl.display == NULL || hl.Initialize(hl.display, NULL, NULL) == 0){printf("headless: no EGL display.\n"); return 0;}
+    if(hl.BindAPI(HL_EGL_OPENGL_API) == 0){printf("headless: EGL has no desktop OpenGL.\n"); return 0;}
+
+    // a pbuffer config if there is one, the framebuffer object is the real target
+    const hlEGLint pattr[] = {HL_EGL_SURFACE_TYPE, HL_EGL_PBUFFER_BIT, HL_EGL_RENDERABLE_TYPE, HL_EGL_OPENGL_BIT, HL_EGL_NONE};
+    const hlEGLint sattr[] = {HL_EGL_RENDERABLE_TYPE, HL_EGL_OPENGL_BIT, HL_EGL_NONE};
+    hlEGLConfig config;
+    hlEGLint n = 0;
+    int pbuffer = 1;
+    if(hl.ChooseConfig(hl.display, pattr, &config, 1, &n) == 0 || n == 0)
+    {
+        pbuffer = 0;
+        if(hl.ChooseConfig(hl.display, sattr, &config, 1, &n) == 0 || n == 0){printf("headless: no EGL config.\n"); return 0;}
+    }
+
+    hl.context = hl.CreateContext(hl.display, config, NULL, NULL);
+    if(hl.context == NULL){printf("headless: eglCreateContext() failed.\n"); return 0;}
+    if(pbuffer == 1)
+    {
+        const hlEGLint sa[] = {HL_EGL_WIDTH, 16, HL_EGL_HEIGHT, 16, HL_EGL_NONE};
+        hl.surface = hl.CreatePbufferSurface(hl.display, config, sa);
+    }
+    if(hl.MakeCurrent(hl.display, hl.surface, hl.surface, hl.context) == 0){printf("headless: eglMakeCurrent() failed.\n"); return 0;}
+
+    printf("headless: EGL %s, %s\n", hl.QueryString(hl.display, HL_EGL_VENDOR), hl.surface != NULL ? "pbuffer" : "surfaceless");
+    return 1;
+}
+
+int hlFramebuffer(const GLuint w, const GLuint h)
+{
+    glGenFramebuffers(1, &hl.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, hl.fbo);
+    glGenRenderbuffers(2, &hl.rbo[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, hl.rbo[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, hl.rbo[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, hl.rbo[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, hl.rbo[1]);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){printf("headless: framebuffer incomplete.\n"); return 0;}
+    printf("headless: %ux%u %s\n", w, h, glGetString(GL_RENDERER));
+    return 1;
+}
+
+void hlDestroy()
+{
+    if(hl.fbo != 0)
+    {
+        glDeleteRenderbuffers(2, &hl.rbo[0]);
+        glDeleteFramebuffers(1, &hl.fbo);
+    }
+    if(hl.display != NULL)
+    {
+        hl.MakeCurrent(hl.display, NULL, NULL, NULL);
+        if(hl.context != NULL){hl.DestroyContext(hl.display, hl.context);}
+        if(hl.surface != NULL){hl.DestroySurface(hl.display, hl.surface);}
+        hl.Terminate(hl.display);
+    }
+    if(hl.lib != NULL){dlclose(hl.lib);}
+    memset(&hl, 0, sizeof(hl));
+}
+
+#endif
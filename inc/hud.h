@@ -0,0 +1,314 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    On-screen overlay of text and a frame time graph.
+
+    Everything is quads of one RGBA atlas, an 8x13 font baked from DejaVu
+    Sans Mono at 12 px (Bitstream Vera licence) with a few solid swatches
+    under it, so a whole overlay is one vertex upload and one glDrawArrays() with
+    shdFullbrightT. The swatches colour the panel and the graph bars, the
+    shader has no tint.
+
+    Positions are pixels from the top left corner.
+
+    Usage:
+        if(hudInit() == 0){fail}    // with the GL context current
+        hudFrame();                 // once a frame, adds the interval to the graph
+        hudBegin();
+        hudRect(x, y, w, h, HUD_SHADE);
+        hudText(x, y, "%.2f ms", ms);
+        hudGraph(x, y, w, h, target_ms);
+        hudDraw(winw, winh, program, blend, src, dst); // the state to put back, it is never queried
+        hudFree();
+*/
+
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#define HUD_GW 8        // glyph cell
+#define HUD_GH 13
+#define HUD_TEX 128     // atlas size
+#define HUD_QUADS 2048  // per overlay, more are dropped
+#define HUD_GRAPH 256   // frame time samples kept
+
+#define HUD_WHITE 0     // swatches
+#define HUD_GREEN 1
+#define HUD_YELLOW 2
+#define HUD_RED 3
+#define HUD_SHADE 4
+
+struct
+{
+    GLuint tex, vbo;
+    GLfloat* verts;     // x, y, u, v per vertex, 6 vertices a quad
+    unsigned quads;
+    float graph[HUD_GRAPH]; // ms
+    uint64_t frames;
+    int64_t last;
+} hud;
+
+const unsigned char hud_swatch[][4] = {{255,255,255,255}, {64,224,96,255}, {240,208,64,255}, {240,72,64,255}, {0,0,0,160}};
+
+// ASCII 32 to 126, a byte per row, the top bit is the left pixel
+const unsigned char hud_font[95][HUD_GH] = {
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // space
+    {0x00,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x10,0x10,0x00,0x00,0x00}, // !
+    {0x00,0x28,0x28,0x28,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // "
+    {0x00,0x00,0x14,0x24,0x7e,0x28,0x28,0xfc,0x48,0x50,0x00,0x00,0x00}, // #
+    {0x00,0x10,0x38,0x54,0x50,0x70,0x1c,0x14,0x54,0x38,0x10,0x10,0x00}, // $
+    {0x00,0x60,0x90,0x90,0x64,0x18,0x6c,0x12,0x12,0x0c,0x00,0x00,0x00}, // %
+    {0x00,0x1c,0x20,0x20,0x30,0x30,0x4a,0x4e,0x64,0x3a,0x00,0x00,0x00}, // &
+    {0x00,0x10,0x10,0x10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // '
+    {0x0c,0x08,0x08,0x10,0x10,0x10,0x10,0x10,0x08,0x08,0x0c,0x00,0x00}, // (
+    {0x30,0x10,0x10,0x08,0x08,0x08,0x08,0x08,0x10,0x10,0x30,0x00,0x00}, // )
+    {0x00,0x10,0x54,0x38,0x38,0x54,0x10,0x00,0x00,0x00,0x00,0x00,0x00}, // *
+    {0x00,0x00,0x00,0x10,0x10,0x10,0xfe,0x10,0x10,0x10,0x00,0x00,0x00}, // +
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10,0x10,0x20,0x00,0x00}, // ,
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x38,0x00,0x00,0x00,0x00,0x00,0x00}, // -
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10,0x10,0x00,0x00,0x00}, // .
+    {0x00,0x02,0x04,0x04,0x08,0x08,0x10,0x10,0x20,0x20,0x40,0x00,0x00}, // /
+    {0x00,0x3c,0x24,0x42,0x42,0x4a,0x42,0x42,0x24,0x3c,0x00,0x00,0x00}, // 0
+    {0x00,0x70,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x7c,0x00,0x00,0x00}, // 1
+    {0x00,0x3c,0x42,0x02,0x02,0x04,0x08,0x10,0x20,0x7e,0x00,0x00,0x00}, // 2
+    {0x00,0x3c,0x42,0x02,0x02,0x1c,0x02,0x02,0x42,0x3c,0x00,0x00,0x00}, // 3
+    {0x00,0x0c,0x0c,0x14,0x34,0x24,0x44,0x7e,0x04,0x04,0x00,0x00,0x00}, // 4
+    {0x00,0x7c,0x40,0x40,0x7c,0x06,0x02,0x02,0x46,0x3c,0x00,0x00,0x00}, // 5
+    {0x00,0x1c,0x22,0x40,0x5c,0x66,0x42,0x42,0x26,0x3c,0x00,0x00,0x00}, // 6
+    {0x00,0x7e,0x06,0x04,0x04,0x08,0x08,0x10,0x10,0x20,0x00,0x00,0x00}, // 7
+    {0x00,0x3c,0x42,0x42,0x42,0x3c,0x42,0x42,0x42,0x3c,0x00,0x00,0x00}, // 8
+    {0x00,0x3c,0x64,0x42,0x42,0x46,0x3a,0x02,0x44,0x38,0x00,0x00,0x00}, // 9
+    {0x00,0x00,0x00,0x00,0x10,0x10,0x00,0x00,0x10,0x10,0x00,0x00,0x00}, // :
+    {0x00,0x00,0x00,0x00,0x10,0x10,0x00,0x00,0x10,0x10,0x20,0x00,0x00}, // ;
+    {0x00,0x00,0x00,0x02,0x1c,0x60,0x60,0x1c,0x02,0x00,0x00,0x00,0x00}, // <
+    {0x00,0x00,0x00,0x00,0x00,0x7e,0x00,0x7e,0x00,0x00,0x00,0x00,0x00}, // =
+    {0x00,0x00,0x00,0x40,0x38,0x06,0x06,0x38,0x40,0x00,0x00,0x00,0x00}, // >
+    {0x00,0x1c,0x22,0x02,0x0c,0x18,0x10,0x00,0x10,0x10,0x00,0x00,0x00}, // ?
+    {0x00,0x00,0x1c,0x26,0x42,0x4e,0x52,0x52,0x4e,0x60,0x20,0x1c,0x00}, // @
+    {0x00,0x18,0x18,0x18,0x24,0x24,0x24,0x3c,0x42,0x42,0x00,0x00,0x00}, // A
+    {0x00,0x7c,0x42,0x42,0x42,0x7c,0x42,0x42,0x42,0x7c,0x00,0x00,0x00}, // B
+    {0x00,0x1c,0x22,0x40,0x40,0x40,0x40,0x40,0x22,0x1c,0x00,0x00,0x00}, // C
+    {0x00,0x78,0x44,0x42,0x42,0x42,0x42,0x42,0x44,0x78,0x00,0x00,0x00}, // D
+    {0x00,0x7e,0x40,0x40,0x40,0x7e,0x40,0x40,0x40,0x7e,0x00,0x00,0x00}, // E
+    {0x00,0x7e,0x40,0x40,0x40,0x7e,0x40,0x40,0x40,0x40,0x00,0x00,0x00}, // F
+    {0x00,0x1c,0x22,0x40,0x40,0x46,0x42,0x42,0x22,0x1c,0x00,0x00,0x00}, // G
+    {0x00,0x42,0x42,0x42,0x42,0x7e,0x42,0x42,0x42,0x42,0x00,0x00,0x00}, // H
+    {0x00,0x7c,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x7c,0x00,0x00,0x00}, // I
+    {0x00,0x1c,0x04,0x04,0x04,0x04,0x04,0x04,0x44,0x38,0x00,0x00,0x00}, // J
+    {0x00,0x42,0x44,0x48,0x50,0x70,0x48,0x4c,0x44,0x42,0x00,0x00,0x00}, // K
+    {0x00,0x40,0x40,0x40,0x40,0x40,0x40,0x40,0x40,0x7e,0x00,0x00,0x00}, // L
+    {0x00,0x42,0x66,0x66,0x5a,0x5a,0x5a,0x42,0x42,0x42,0x00,0x00,0x00}, // M
+    {0x00,0x62,0x62,0x52,0x52,0x5a,0x4a,0x4a,0x46,0x46,0x00,0x00,0x00}, // N
+    {0x00,0x3c,0x24,0x42,0x42,0x42,0x42,0x42,0x24,0x3c,0x00,0x00,0x00}, // O
+    {0x00,0x7c,0x42,0x42,0x42,0x7c,0x40,0x40,0x40,0x40,0x00,0x00,0x00}, // P
+    {0x00,0x3c,0x24,0x42,0x42,0x42,0x42,0x42,0x26,0x3c,0x04,0x04,0x00}, // Q
+    {0x00,0x7c,0x42,0x42,0x42,0x7c,0x44,0x42,0x42,0x41,0x00,0x00,0x00}, // R
+    {0x00,0x3c,0x42,0x40,0x60,0x3c,0x02,0x02,0x42,0x3c,0x00,0x00,0x00}, // S
+    {0x00,0xfe,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x00,0x00}, // T
+    {0x00,0x42,0x42,0x42,0x42,0x42,0x42,0x42,0x42,0x3c,0x00,0x00,0x00}, // U
+    {0x00,0x42,0x42,0x24,0x24,0x24,0x24,0x18,0x18,0x18,0x00,0x00,0x00}, // V
+    {0x00,0x82,0x92,0x92,0xaa,0xaa,0xaa,0x6c,0x44,0x44,0x00,0x00,0x00}, // W
+    {0x00,0x42,0x24,0x24,0x18,0x18,0x18,0x24,0x24,0x42,0x00,0x00,0x00}, // X
+    {0x00,0x82,0x44,0x28,0x28,0x10,0x10,0x10,0x10,0x10,0x00,0x00,0x00}, // Y
+    {0x00,0x7e,0x06,0x04,0x08,0x18,0x10,0x20,0x60,0x7e,0x00,0x00,0x00}, // Z
+    {0x18,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x18,0x00,0x00}, // [
+    {0x00,0x40,0x20,0x20,0x10,0x10,0x08,0x08,0x04,0x04,0x02,0x00,0x00}, // backslash
+    {0x30,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x30,0x00,0x00}, // ]
+    {0x00,0x30,0x48,0x84,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // ^
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xfe}, // _
+    {0x10,0x08,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // `
+    {0x00,0x00,0x00,0x38,0x44,0x04,0x3c,0x44,0x44,0x3c,0x00,0x00,0x00}, // a
+    {0x40,0x40,0x40,0x78,0x44,0x44,0x44,0x44,0x44,0x78,0x00,0x00,0x00}, // b
+    {0x00,0x00,0x00,0x38,0x64,0x40,0x40,0x40,0x60,0x3c,0x00,0x00,0x00}, // c
+    {0x04,0x04,0x04,0x3c,0x44,0x44,0x44,0x44,0x44,0x3c,0x00,0x00,0x00}, // d
+    {0x00,0x00,0x00,0x38,0x64,0x44,0x7c,0x40,0x44,0x38,0x00,0x00,0x00}, // e
+    {0x0c,0x10,0x10,0x7c,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x00,0x00}, // f
+    {0x00,0x00,0x00,0x3c,0x44,0x44,0x44,0x44,0x44,0x3c,0x04,0x24,0x18}, // g
+    {0x40,0x40,0x40,0x58,0x64,0x44,0x44,0x44,0x44,0x44,0x00,0x00,0x00}, // h
+    {0x10,0x00,0x00,0x70,0x10,0x10,0x10,0x10,0x10,0x7c,0x00,0x00,0x00}, // i
+    {0x08,0x00,0x00,0x38,0x08,0x08,0x08,0x08,0x08,0x08,0x08,0x08,0x30}, // j
+    {0x40,0x40,0x40,0x44,0x48,0x50,0x60,0x50,0x48,0x44,0x00,0x00,0x00}, // k
+    {0x70,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x0c,0x00,0x00,0x00}, // l
+    {0x00,0x00,0x00,0x7c,0x54,0x54,0x54,0x54,0x54,0x54,0x00,0x00,0x00}, // m
+    {0x00,0x00,0x00,0x58,0x64,0x44,0x44,0x44,0x44,0x44,0x00,0x00,0x00}, // n
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00}, // o
+    {0x00,0x00,0x00,0x78,0x44,0x44,0x44,0x44,0x44,0x78,0x40,0x40,0x40}, // p
+    {0x00,0x00,0x00,0x3c,0x44,0x44,0x44,0x44,0x44,0x3c,0x04,0x04,0x04}, // q
+    {0x00,0x00,0x00,0x3c,0x32,0x20,0x20,0x20,0x20,0x20,0x00,0x00,0x00}, // r
+    {0x00,0x00,0x00,0x38,0x44,0x40,0x38,0x04,0x44,0x38,0x00,0x00,0x00}, // s
+    {0x00,0x10,0x10,0x7c,0x10,0x10,0x10,0x10,0x10,0x1c,0x00,0x00,0x00}, // t
+    {0x00,0x00,0x00,0x44,0x44,0x44,0x44,0x44,0x44,0x3c,0x00,0x00,0x00}, // u
+    {0x00,0x00,0x00,0x44,0x44,0x28,0x28,0x28,0x10,0x10,0x00,0x00,0x00}, // v
+    {0x00,0x00,0x00,0x82,0x82,0x54,0x54,0x6c,0x28,0x28,0x00,0x00,0x00}, // w
+    {0x00,0x00,0x00,0x44,0x28,0x28,0x10,0x28,0x28,0x44,0x00,0x00,0x00}, // x
+    {0x00,0x00,0x00,0x44,0x44,0x28,0x28,0x28,0x30,0x10,0x10,0x20,0x60}, // y
+    {0x00,0x00,0x00,0x7c,0x04,0x08,0x10,0x20,0x40,0x7c,0x00,0x00,0x00}, // z
+    {0x1c,0x10,0x10,0x10,0x10,0x60,0x10,0x10,0x10,0x10,0x1c,0x00,0x00}, // {
+    {0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x00}, // |
+    {0x70,0x10,0x10,0x10,0x10,0x0c,0x10,0x10,0x10,0x10,0x70,0x00,0x00}, // }
+    {0x00,0x00,0x00,0x00,0x00,0x70,0x0e,0x00,0x00,0x00,0x00,0x00,0x00}  // ~
+};
+
+int  hudInit(); // returns 0 on failure, compiles shdFullbrightT if need be
+void hudFrame();
+void hudBegin();
+void hudRect(const float x, const float y, const float w, const float h, const unsigned swatch);
+void hudText(float x, const float y, const char* fmt, ...);
+void hudGraph(const float x, const float y, const float w, const float h, const float target); // newest on the right, full height is 2x target
+void hudDraw(const GLuint w, const GLuint h, const GLuint program, const GLuint blend, const GLenum src, const GLenum dst); // binds program, GL_BLEND and glBlendFunc() after
+void hudFree();
+
+//
+
+int hudInit()
+{
+    memset(&hud, 0, sizeof(hud));
+    if(shdFullbrightT == 0){makeFullbrightT();}
+    esFinish(&shdFullbrightT);
+    if(shdFullbrightT == 0){return 0;}
+
+    unsigned char* px = calloc(HUD_TEX * HUD_TEX, 4);
+    hud.verts = malloc(HUD_QUADS * 6 * 4 * sizeof(GLfloat));
+    if(px == NULL || hud.verts == NULL){free(px); free(hud.verts); return 0;}
+
+    // 16 glyphs a row, then the swatches as 8x8 blocks along the bottom
+    for(unsigned c = 0; c < 95; c++)
+    {
+        const unsigned cx = (c % 16) * HUD_GW, cy = (c / 16) * HUD_GH;
+        for(unsigned y = 0; y < HUD_GH; y++)
+            for(unsigned x = 0; x < HUD_GW; x++)
+                if(hud_font[c][y] & (0x80 >> x))
+                    memset(&px[((cy+y) * HUD_TEX + cx+x) * 4], 255, 4);
+    }
+    for(unsigned s = 0; s < sizeof(hud_swatch)/4; s++)
+        for(unsigned y = HUD_TEX-8; y < HUD_TEX; y++)
+            for(unsigned x = s*8; x < s*8+8; x++)
+                memcpy(&px[(y * HUD_TEX + x) * 4], hud_swatch[s], 4);
+    hud.tex = esLoadTextureA(HUD_TEX, HUD_TEX, px);
+    free(px);
+
+    esBind(GL_ARRAY_BUFFER, &hud.vbo, NULL, HUD_QUADS * 6 * 4 * sizeof(GLfloat), GL_STREAM_DRAW);
+    hud.last = 0;
+    return 1;
+}
+
+void hudFrame()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const int64_t now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if(hud.last != 0)
+    {
+        hud.graph[hud.frames % HUD_GRAPH] = (float)(now - hud.last) * 1e-6f;
+        hud.frames++;
+    }
+    hud.last = now;
+}
+
+void hudBegin()
+{
+    hud.quads = 0;
+}
+
+static inline void hudQuad(const float x, const float y, const float w, const float h, const float u0, const float v0, const float u1, const float v1)
+{
+    if(hud.quads == HUD_QUADS){return;}
+    GLfloat* v = &hud.verts[hud.quads * 24];
+    const GLfloat q[24] = {x,y,u0,v0, x,y+h,u0,v1, x+w,y,u1,v0,  x+w,y,u1,v0, x,y+h,u0,v1, x+w,y+h,u1,v1};
+    memcpy(v, q, sizeof(q));
+    hud.quads++;
+}
+
+void hudRect(const float x, const float y, const float w, const float h, const unsigned swatch)
+{
+    // the middle of the swatch at every corner, one flat colour
+    const float u = (swatch * 8 + 4) / (float)HUD_TEX, v = (HUD_TEX - 4) / (float)HUD_TEX;
+    hudQuad(x, y, w, h, u, v, u, v);
+}
+
+void hudText(float x, const float y, const char* fmt, ...)
+{
+    char s[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(s, sizeof(s), fmt, args);
+    va_end(args);
+    const float du = HUD_GW / (float)HUD_TEX, dv = HUD_GH / (float)HUD_TEX;
+    for(const char* p = s; *p != 0; p++, x += HUD_GW)
+    {
+        const unsigned c = (unsigned char)*p - 32;
+        if(c == 0 || c >= 95){continue;}
+        const float u = (c % 16) * du, v = (c / 16) * dv;
+        hudQuad(x, y, HUD_GW, HUD_GH, u, v, u+du, v+dv);
+    }
+}
+
+void hudGraph(const float x, const float y, const float w, const float h, const float target)
+{
+    unsigned n = (unsigned)w;
+    if(n > HUD_GRAPH){n = HUD_GRAPH;}
+    if(n > hud.frames){n = (unsigned)hud.frames;}
+    const float scale = h / (target * 2.f);
+    for(unsigned i = 0; i < n; i++)
+    {
+        const float ms = hud.graph[(hud.frames - 1 - i) % HUD_GRAPH];
+        const float bh = ms * scale > h ? h : ms * scale;
+        const unsigned s = ms <= target * 1.1f ? HUD_GREEN : (ms <= target * 2.f ? HUD_YELLOW : HUD_RED);
+        hudRect(x + w - 1 - i, y + h - bh, 1.f, bh, s);
+    }
+    hudRect(x, y + h * 0.5f, w, 1.f, HUD_WHITE); // the target
+}
+
+void hudDraw(const GLuint w, const GLuint h, const GLuint program, const GLuint blend, const GLenum src, const GLenum dst)
+{
+    if(hud.quads == 0){return;}
+    GLint position, projection, modelview, texcoord, sampler;
+    shadeFullbrightT(&position, &projection, &modelview, &texcoord, &sampler);
+    mat p, ident;
+    mIdent(&p);
+    mOrtho(&p, 0.f, (float)w, (float)h, 0.f, -1.f, 1.f);
+    mIdent(&ident);
+    glUniformMatrix4fv(projection, 1, GL_FALSE, (GLfloat*) &p.m[0][0]);
+    glUniformMatrix4fv(modelview, 1, GL_FALSE, (GLfloat*) &ident.m[0][0]);
+    glUniform1i(sampler, 0);
+    glBindTexture(GL_TEXTURE_2D, hud.tex);
+
+    // new storage each frame, the previous frame's draw may still be reading the old
+    glBindBuffer(GL_ARRAY_BUFFER, hud.vbo);
+    glBufferData(GL_ARRAY_BUFFER, hud.quads * 6 * 4 * sizeof(GLfloat), hud.verts, GL_STREAM_DRAW);
+    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*4, 0);
+    glEnableVertexAttribArray(position);
+    glVertexAttribPointer(texcoord, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*4, (void*)(sizeof(GLfloat)*2));
+    glEnableVertexAttribArray(texcoord);
+    if(glVertexAttribDivisor != NULL) // an instanced program may have left one on these locations
+    {
+        glVertexAttribDivisor(position, 0);
+        glVertexAttribDivisor(texcoord, 0);
+    }
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_DEPTH_TEST);
+    glDrawArrays(GL_TRIANGLES, 0, hud.quads * 6);
+    glEnable(GL_DEPTH_TEST);
+    glBlendFunc(src, dst);
+    if(blend == 0){glDisable(GL_BLEND);}
+    glUseProgram(program);
+}
+
+void hudFree()
+{
+    if(hud.tex != 0){glDeleteTextures(1, &hud.tex);}
+    if(hud.vbo != 0){glDeleteBuffers(1, &hud.vbo);}
+    free(hud.verts);
+    memset(&hud, 0, sizeof(hud));
+}
+
+#endif
@@ -3,6 +3,18 @@
 
     Requires vec.h: https://gist.github.com/mrbid/77a92019e1ab8b86109bf103166bd04e
 
+    Points and vectors are rows, p' = p * m, like GL reads these with
+    transpose GL_FALSE, so the translation is m[3].
+
+    SSE by default, NEON or scalar with NOSSE. mMul is a pointer that
+    mInit() points at the AVX2 + FMA kernel when CPUID has it, it is the
+    SSE / NEON / scalar kernel until then. The *Base functions are the
+    scalar reference kernels, see: ./wiggle --bench mat
+
+    The batches mMulN, mMulPN and mInvertN are pointers mInit() sets too,
+    to AVX2 + FMA kernels, 8 points or two matrices a register. Their
+    baseline kernels are GCC vector extensions, or mInvert() with SSE.
+
     Credits:
     Aaftab Munshi, Dan Ginsburg, Dave Shreiner, James William Fletcher, Intel, Gabriel Cramer
 */
@@ -12,15 +24,20 @@
 
 #include "vec_ts.h"
 
+#if defined(NOSSE) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
 typedef struct
 {
     float m[4][4];
 } mat;
 
+void mInit(); // picks the mMul and batch kernels by CPUID
 void mIdent(mat *m);
 void mCopy(mat *restrict r, const mat *restrict v);
-void mMul(mat *restrict r, const mat *restrict a, const mat *restrict b);
-void mMulP(vec *restrict r, const mat *restrict a, const float x, const float y, const float z);
+extern void (*mMul)(mat *r, const mat *a, const mat *b); // r may be a or b
+void mMulP(vec *restrict r, const mat *restrict a, const float x, const float y, const float z); // w = 1
 void mMulV(vec *restrict r, const mat *restrict a, const vec v);
 void mScale(mat *r, const float x, const float y, const float z);
 void mTranslate(mat *r, const float x, const float y, const float z);
@@ -34,6 +51,7 @@ void mOrtho(mat *r, const float left, const float right, const float bottom, con
 void mLookAt(mat *r, const vec origin, const vec unit_dir);
 void mInvert(float *restrict dst, const float *restrict mat);
 void mTranspose(mat *restrict r, const mat *restrict m);
+void mNormal(mat *r, const mat *m); // normal matrix, the upper 3x3 of mTranspose(mInvert(m)), r may be m
 void mSetViewDir(mat *r, const vec dir_norm, const vec up_norm);
 void mGetViewDir(vec *r, const mat matrix); // returns normal/unit vector
 void mGetDirX(vec *r, const mat matrix);
@@ -41,6 +59,18 @@ void mGetDirY(vec *r, const mat matrix);
 void mGetDirZ(vec *r, const mat matrix);
 void mGetPos(vec *r, const mat matrix);
 
+// batches, r may be the input but b must not be in r
+extern void (*mMulN)(mat *r, const mat *a, const mat *b, const unsigned n); // r[i] = a[i] * b
+extern void (*mMulPN)(float *rx, float *ry, float *rz, float *rw, const mat *a, const float *x, const float *y, const float *z, const unsigned n); // w = 1, rw may be NULL
+extern void (*mInvertN)(mat *r, const mat *m, const unsigned n);
+
+void mMulBase(mat *r, const mat *a, const mat *b);
+void mScaleBase(mat *r, const float x, const float y, const float z);
+void mTranslateBase(mat *r, const float x, const float y, const float z);
+void mRotateBase(mat *r, const float radians, float x, float y, float z);
+void mTransposeBase(mat *restrict r, const mat *restrict m);
+void mNormalBase(mat *r, const mat *m);
+
 //
 
 void mIdent(mat *m)
@@ -57,7 +87,7 @@ void mCopy(mat *restrict r, const mat *restrict v)
     memcpy(r, v, sizeof(mat));
 }
 
-void mMul(mat *restrict r, const mat *restrict a, const mat *restrict b)
+void mMulBase(mat *r, const mat *a, const mat *b)
 {
     mat tmp;
     for(int i = 0; i < 4; i++)
@@ -85,48 +115,130 @@ void mMul(mat *restrict r, const mat *restrict a, const mat *restrict b)
     memcpy(r, &tmp, sizeof(mat));
 }
 
-void mMulP(vec *restrict r, const mat *restrict a, const float x, const float y, const float z)
+// each kernel loads all of b before the first store, so r may be a or b
+#ifndef NOSSE
+void mMulSSE(mat *r, const mat *a, const mat *b)
 {
-    r->x =  (a->m[0][0] * x) +
-            (a->m[0][1] * x) +
-            (a->m[0][2] * x) +
-            (a->m[0][3] * x) ;
-
-    r->y =  (a->m[1][0] * y) +
-            (a->m[1][1] * y) +
-            (a->m[1][2] * y) +
-            (a->m[1][3] * y) ;
+    const __m128 b0 = _mm_loadu_ps(b->m[0]);
+    const __m128 b1 = _mm_loadu_ps(b->m[1]);
+    const __m128 b2 = _mm_loadu_ps(b->m[2]);
+    const __m128 b3 = _mm_loadu_ps(b->m[3]);
+    __m128 o[4];
+    for(int i = 0; i < 4; i++)
+    {
+        const __m128 ai = _mm_loadu_ps(a->m[i]);
+        o[i] =             _mm_mul_ps(_mm_shuffle_ps(ai, ai, 0x00), b0);
+        o[i] = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(ai, ai, 0x55), b1), o[i]);
+        o[i] = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(ai, ai, 0xAA), b2), o[i]);
+        o[i] = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(ai, ai, 0xFF), b3), o[i]);
+    }
+    for(int i = 0; i < 4; i++){_mm_storeu_ps(r->m[i], o[i]);}
+}
 
-    r->z =  (a->m[2][0] * z) +
-            (a->m[2][1] * z) +
-            (a->m[2][2] * z) +
-            (a->m[2][3] * z) ;
+__attribute__((target("avx2,fma"))) void mMulAVX2(mat *r, const mat *a, const mat *b)
+{
+    // two rows of a to a register, each row of b in both lanes
+    const __m256 b0 = _mm256_broadcast_ps((const __m128*)b->m[0]);
+    const __m256 b1 = _mm256_broadcast_ps((const __m128*)b->m[1]);
+    const __m256 b2 = _mm256_broadcast_ps((const __m128*)b->m[2]);
+    const __m256 b3 = _mm256_broadcast_ps((const __m128*)b->m[3]);
+    const __m256 a01 = _mm256_loadu_ps(a->m[0]);
+    const __m256 a23 = _mm256_loadu_ps(a->m[2]);
+    __m256 o01 =    _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+    __m256 o23 =    _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+    o01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1, o01);
+    o23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1, o23);
+    o01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xAA), b2, o01);
+    o23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xAA), b2, o23);
+    o01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xFF), b3, o01);
+    o23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xFF), b3, o23);
+    _mm256_storeu_ps(r->m[0], o01);
+    _mm256_storeu_ps(r->m[2], o23);
 }
 
-void mMulV(vec *restrict r, const mat *restrict a, const vec v)
+void (*mMul)(mat *r, const mat *a, const mat *b) = mMulSSE;
+#elif defined(__ARM_NEON)
+void mMulNEON(mat *r, const mat *a, const mat *b)
 {
-    r->x =  (a->m[0][0] * v.x) +
-            (a->m[0][1] * v.x) +
-            (a->m[0][2] * v.x) +
-            (a->m[0][3] * v.x) ;
+    const float32x4_t b0 = vld1q_f32(b->m[0]);
+    const float32x4_t b1 = vld1q_f32(b->m[1]);
+    const float32x4_t b2 = vld1q_f32(b->m[2]);
+    const float32x4_t b3 = vld1q_f32(b->m[3]);
+    float32x4_t o[4];
+    for(int i = 0; i < 4; i++)
+    {
+        const float32x4_t ai = vld1q_f32(a->m[i]);
+        o[i] = vmulq_n_f32(b0, vgetq_lane_f32(ai, 0));
+        o[i] = vmlaq_n_f32(o[i], b1, vgetq_lane_f32(ai, 1));
+        o[i] = vmlaq_n_f32(o[i], b2, vgetq_lane_f32(ai, 2));
+        o[i] = vmlaq_n_f32(o[i], b3, vgetq_lane_f32(ai, 3));
+    }
+    for(int i = 0; i < 4; i++){vst1q_f32(r->m[i], o[i]);}
+}
+
+void (*mMul)(mat *r, const mat *a, const mat *b) = mMulNEON;
+#else
+void (*mMul)(mat *r, const mat *a, const mat *b) = mMulBase;
+#endif
 
-    r->y =  (a->m[1][0] * v.y) +
-            (a->m[1][1] * v.y) +
-            (a->m[1][2] * v.y) +
-            (a->m[1][3] * v.y) ;
+// r = t * r for a rotation t, the upper 3x3 of a matrix that is identity elsewhere
+static inline void mRotMul(mat *r, const float t[3][3])
+{
+#ifndef NOSSE
+    const __m128 r0 = _mm_loadu_ps(r->m[0]);
+    const __m128 r1 = _mm_loadu_ps(r->m[1]);
+    const __m128 r2 = _mm_loadu_ps(r->m[2]);
+    for(int i = 0; i < 3; i++)
+        _mm_storeu_ps(r->m[i], _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[i][0]), r0),
+                                                     _mm_mul_ps(_mm_set1_ps(t[i][1]), r1)),
+                                                     _mm_mul_ps(_mm_set1_ps(t[i][2]), r2)));
+#elif defined(__ARM_NEON)
+    const float32x4_t r0 = vld1q_f32(r->m[0]);
+    const float32x4_t r1 = vld1q_f32(r->m[1]);
+    const float32x4_t r2 = vld1q_f32(r->m[2]);
+    for(int i = 0; i < 3; i++)
+        vst1q_f32(r->m[i], vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(r0, t[i][0]), r1, t[i][1]), r2, t[i][2]));
+#else
+    mat o;
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 4; j++)
+            o.m[i][j] = t[i][0] * r->m[0][j] + t[i][1] * r->m[1][j] + t[i][2] * r->m[2][j];
+    memcpy(r, &o, sizeof(float)*12);
+#endif
+}
 
-    r->z =  (a->m[2][0] * v.z) +
-            (a->m[2][1] * v.z) +
-            (a->m[2][2] * v.z) +
-            (a->m[2][3] * v.z) ;
+void mMulP(vec *restrict r, const mat *restrict a, const float x, const float y, const float z)
+{
+    r->x = (a->m[0][0] * x) + (a->m[1][0] * y) + (a->m[2][0] * z) + a->m[3][0];
+    r->y = (a->m[0][1] * x) + (a->m[1][1] * y) + (a->m[2][1] * z) + a->m[3][1];
+    r->z = (a->m[0][2] * x) + (a->m[1][2] * y) + (a->m[2][2] * z) + a->m[3][2];
+    r->w = (a->m[0][3] * x) + (a->m[1][3] * y) + (a->m[2][3] * z) + a->m[3][3];
+}
 
-    r->w =  (a->m[3][0] * v.w) +
-            (a->m[3][1] * v.w) +
-            (a->m[3][2] * v.w) +
-            (a->m[3][3] * v.w) ;
+void mMulV(vec *restrict r, const mat *restrict a, const vec v)
+{
+    r->x = (a->m[0][0] * v.x) + (a->m[1][0] * v.y) + (a->m[2][0] * v.z) + (a->m[3][0] * v.w);
+    r->y = (a->m[0][1] * v.x) + (a->m[1][1] * v.y) + (a->m[2][1] * v.z) + (a->m[3][1] * v.w);
+    r->z = (a->m[0][2] * v.x) + (a->m[1][2] * v.y) + (a->m[2][2] * v.z) + (a->m[3][2] * v.w);
+    r->w = (a->m[0][3] * v.x) + (a->m[1][3] * v.y) + (a->m[2][3] * v.z) + (a->m[3][3] * v.w);
 }
 
 void mScale(mat *r, const float x, const float y, const float z)
+{
+#ifndef NOSSE
+    _mm_storeu_ps(r->m[0], _mm_mul_ps(_mm_loadu_ps(r->m[0]), _mm_set1_ps(x)));
+    _mm_storeu_ps(r->m[1], _mm_mul_ps(_mm_loadu_ps(r->m[1]), _mm_set1_ps(y)));
+    _mm_storeu_ps(r->m[2], _mm_mul_ps(_mm_loadu_ps(r->m[2]), _mm_set1_ps(z)));
+#elif defined(__ARM_NEON)
+    vst1q_f32(r->m[0], vmulq_n_f32(vld1q_f32(r->m[0]), x));
+    vst1q_f32(r->m[1], vmulq_n_f32(vld1q_f32(r->m[1]), y));
+    vst1q_f32(r->m[2], vmulq_n_f32(vld1q_f32(r->m[2]), z));
+#else
+    mScaleBase(r, x, y, z);
+#endif
+}
+
+void mScaleBase(mat *r, const float x, const float y, const float z)
 {
     r->m[0][0] *= x;
     r->m[0][1] *= x;
@@ -145,6 +257,21 @@ void mScale(mat *r, const float x, const float y, const float z)
 }
 
 void mTranslate(mat *r, const float x, const float y, const float z)
+{
+#ifndef NOSSE
+    const __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(r->m[0]), _mm_set1_ps(x)),
+                                           _mm_mul_ps(_mm_loadu_ps(r->m[1]), _mm_set1_ps(y))),
+                                           _mm_mul_ps(_mm_loadu_ps(r->m[2]), _mm_set1_ps(z)));
+    _mm_storeu_ps(r->m[3], _mm_add_ps(_mm_loadu_ps(r->m[3]), t));
+#elif defined(__ARM_NEON)
+    const float32x4_t t = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vld1q_f32(r->m[0]), x), vld1q_f32(r->m[1]), y), vld1q_f32(r->m[2]), z);
+    vst1q_f32(r->m[3], vaddq_f32(vld1q_f32(r->m[3]), t));
+#else
+    mTranslateBase(r, x, y, z);
+#endif
+}
+
+void mTranslateBase(mat *r, const float x, const float y, const float z)
 {
     r->m[3][0] += (r->m[0][0] * x + r->m[1][0] * y + r->m[2][0] * z);
     r->m[3][1] += (r->m[0][1] * x + r->m[1][1] * y + r->m[2][1] * z);
@@ -153,6 +280,25 @@ void mTranslate(mat *r, const float x, const float y, const float z)
 }
 
 void mRotate(mat *r, const float radians, float x, float y, float z)
+{
+    const float mag = rsqrtss(x * x + y * y + z * z);
+    const float sinAngle = sinf(radians);
+    const float cosAngle = cosf(radians);
+    if(mag > 0.0f)
+    {
+        x *= mag;
+        y *= mag;
+        z *= mag;
+        const float oneMinusCos = 1.0f - cosAngle;
+        const float xs = x * sinAngle, ys = y * sinAngle, zs = z * sinAngle;
+        const float t[3][3] = {{(oneMinusCos * x * x) + cosAngle, (oneMinusCos * x * y) - zs, (oneMinusCos * z * x) + ys},
+                               {(oneMinusCos * x * y) + zs, (oneMinusCos * y * y) + cosAngle, (oneMinusCos * y * z) - xs},
+                               {(oneMinusCos * z * x) - ys, (oneMinusCos * y * z) + xs, (oneMinusCos * z * z) + cosAngle}};
+        mRotMul(r, t);
+    }
+}
+
+void mRotateBase(mat *r, const float radians, float x, float y, float z)
 {
     const float mag = rsqrtss(x * x + y * y + z * z);
     const float sinAngle = sinf(radians);
@@ -195,7 +341,7 @@ void mRotate(mat *r, const float radians, float x, float y, float z)
         rotMat.m[3][2] = 0.0F;
         rotMat.m[3][3] = 1.0F;
 
-        mMul(r, &rotMat, r);
+        mMulBase(r, &rotMat, r);
     }
 }
 
@@ -203,33 +349,24 @@ void mRotX(mat *r, const float radians)
 {
     const float s = sinf(radians);
     const float c = cosf(radians);
-    const mat t = { c, 0.f, s, 0.f,
-                    0.f, 1.f, 0.f, 0.f,
-                    -s, 0.f, c, 0.f,
-                    0.f, 0.f, 0.f, 1.f };
-    mMul(r, &t, r);
+    const float t[3][3] = {{c, 0.f, s}, {0.f, 1.f, 0.f}, {-s, 0.f, c}};
+    mRotMul(r, t);
 }
 
 void mRotY(mat *r, const float radians)
 {
     const float s = sinf(radians);
     const float c = cosf(radians);
-    const mat t = { 1.f, 0.f, 0.f, 0.f,
-                    0.f, c, -s, 0.f,
-                    0.f, s, c, 0.f,
-                    0.f, 0.f, 0.f, 1.f };
-    mMul(r, &t, r);
+    const float t[3][3] = {{1.f, 0.f, 0.f}, {0.f, c, -s}, {0.f, s, c}};
+    mRotMul(r, t);
 }
 
 void mRotZ(mat *r, const float radians)
 {
     const float s = sinf(radians);
     const float c = cosf(radians);
-    const mat t = { c, -s, 0.f, 0.f,
-                    s, c, 0.f, 0.f,
-                    0.f, 0.f, 1.f, 0.f,
-                    0.f, 0.f, 0.f, 1.f };
-    mMul(r, &t, r);
+    const float t[3][3] = {{c, -s, 0.f}, {s, c, 0.f}, {0.f, 0.f, 1.f}};
+    mRotMul(r, t);
 }
 
 void mFrustum(mat *r, const float left, const float right, const float bottom, const float top, const float nearZ, const float farZ)
@@ -510,7 +647,30 @@ void mInvert(float *restrict dst, const float *restrict src)
 #endif
 }
 
-void mTranspose(mat *r, const mat *restrict m)
+void mTranspose(mat *restrict r, const mat *restrict m)
+{
+#ifndef NOSSE
+    __m128 r0 = _mm_loadu_ps(m->m[0]);
+    __m128 r1 = _mm_loadu_ps(m->m[1]);
+    __m128 r2 = _mm_loadu_ps(m->m[2]);
+    __m128 r3 = _mm_loadu_ps(m->m[3]);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(r->m[0], r0);
+    _mm_storeu_ps(r->m[1], r1);
+    _mm_storeu_ps(r->m[2], r2);
+    _mm_storeu_ps(r->m[3], r3);
+#elif defined(__ARM_NEON)
+    const float32x4x4_t c = vld4q_f32(&m->m[0][0]); // de-interleaves the columns
+    vst1q_f32(r->m[0], c.val[0]);
+    vst1q_f32(r->m[1], c.val[1]);
+    vst1q_f32(r->m[2], c.val[2]);
+    vst1q_f32(r->m[3], c.val[3]);
+#else
+    mTransposeBase(r, m);
+#endif
+}
+
+void mTransposeBase(mat *restrict r, const mat *restrict m)
 {
     r->m[0][0] = m->m[0][0];
     r->m[1][0] = m->m[0][1];
@@ -533,6 +693,91 @@ void mTranspose(mat *r, const mat *restrict m)
     r->m[3][3] = m->m[3][3];
 }
 
+// the inverse transpose of a 3x3 is its cofactor matrix over its determinant, and the
+// cofactor rows are the cross products of the other two rows, a rotation is its own
+// cofactor matrix so that is also the test for the orthonormal case that skips the divide
+#define M_ORTHO_TOL 1e-5f
+
+static inline int mNormalProjective(mat *r, const mat *m)
+{
+    // with a w column the upper 3x3 of the inverse is not the inverse of the upper 3x3,
+    // the wiggle does that and its lighting is the full inverse, so that it stays
+    if(m->m[0][3] == 0.f && m->m[1][3] == 0.f && m->m[2][3] == 0.f){return 0;}
+    mat t;
+    mInvert(&t.m[0][0], &m->m[0][0]);
+    mTranspose(r, &t);
+    return 1;
+}
+
+#ifndef NOSSE
+static inline __m128 mCrossSSE(const __m128 a, const __m128 b)
+{
+    // (a * b.yzx - a.yzx * b).yzx, w stays 0
+    const __m128 ay = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 by = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a, by), _mm_mul_ps(ay, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+void mNormal(mat *r, const mat *m)
+{
+    if(mNormalProjective(r, m) == 1){return;}
+#ifndef NOSSE
+    const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const __m128 a0 = _mm_and_ps(_mm_loadu_ps(m->m[0]), xyz);
+    const __m128 a1 = _mm_and_ps(_mm_loadu_ps(m->m[1]), xyz);
+    const __m128 a2 = _mm_and_ps(_mm_loadu_ps(m->m[2]), xyz);
+    __m128 c0 = mCrossSSE(a1, a2);
+    __m128 c1 = mCrossSSE(a2, a0);
+    __m128 c2 = mCrossSSE(a0, a1);
+    const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 e = _mm_max_ps(_mm_max_ps(_mm_and_ps(_mm_sub_ps(c0, a0), abs), _mm_and_ps(_mm_sub_ps(c1, a1), abs)), _mm_and_ps(_mm_sub_ps(c2, a2), abs));
+    if(_mm_movemask_ps(_mm_cmpgt_ps(e, _mm_set1_ps(M_ORTHO_TOL))) == 0)
+    {
+        c0 = a0, c1 = a1, c2 = a2;
+    }
+    else
+    {
+        __m128 det = _mm_mul_ps(a0, c0);
+        det = _mm_add_ps(_mm_shuffle_ps(det, det, 0x4E), det);
+        det = _mm_add_ps(_mm_shuffle_ps(det, det, 0xB1), det);
+        det = _mm_div_ps(_mm_set1_ps(1.f), det);
+        c0 = _mm_mul_ps(c0, det);
+        c1 = _mm_mul_ps(c1, det);
+        c2 = _mm_mul_ps(c2, det);
+    }
+    _mm_storeu_ps(r->m[0], c0);
+    _mm_storeu_ps(r->m[1], c1);
+    _mm_storeu_ps(r->m[2], c2);
+    _mm_storeu_ps(r->m[3], _mm_set_ps(1.f, 0.f, 0.f, 0.f));
+#else
+    mNormalBase(r, m);
+#endif
+}
+
+void mNormalBase(mat *r, const mat *m)
+{
+    if(mNormalProjective(r, m) == 1){return;}
+    const float (*a)[4] = m->m;
+    float c[3][3] = {{a[1][1]*a[2][2] - a[1][2]*a[2][1], a[1][2]*a[2][0] - a[1][0]*a[2][2], a[1][0]*a[2][1] - a[1][1]*a[2][0]},
+                     {a[2][1]*a[0][2] - a[2][2]*a[0][1], a[2][2]*a[0][0] - a[2][0]*a[0][2], a[2][0]*a[0][1] - a[2][1]*a[0][0]},
+                     {a[0][1]*a[1][2] - a[0][2]*a[1][1], a[0][2]*a[1][0] - a[0][0]*a[1][2], a[0][0]*a[1][1] - a[0][1]*a[1][0]}};
+    int ortho = 1;
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+            ortho &= fabsf(c[i][j] - a[i][j]) <= M_ORTHO_TOL;
+    const float det = ortho == 1 ? 1.f : 1.f / (a[0][0]*c[0][0] + a[0][1]*c[0][1] + a[0][2]*c[0][2]);
+    for(int i = 0; i < 3; i++)
+    {
+        r->m[i][0] = ortho == 1 ? a[i][0] : c[i][0] * det;
+        r->m[i][1] = ortho == 1 ? a[i][1] : c[i][1] * det;
+        r->m[i][2] = ortho == 1 ? a[i][2] : c[i][2] * det;
+    }
+    r->m[0][3] = 0.f, r->m[1][3] = 0.f, r->m[2][3] = 0.f;
+    r->m[3][0] = 0.f, r->m[3][1] = 0.f, r->m[3][2] = 0.f, r->m[3][3] = 1.f;
+}
+
 void mSetViewDir(mat *r, const vec dir_norm, const vec up_norm)
 {
     vec c;
@@ -590,4 +835,314 @@ void mGetPos(vec *r, const mat matrix)
     r->z = matrix.m[3][2];
 }
 
+//
+
+typedef float mf8 __attribute__((vector_size(32)));
+
+// macros, not functions: an mf8 argument or return value outside target("avx2") changes the ABI (-Wpsabi)
+#define mfSplat(f) ({const float mfSplat_f = (f); (mf8){mfSplat_f, mfSplat_f, mfSplat_f, mfSplat_f, mfSplat_f, mfSplat_f, mfSplat_f, mfSplat_f};})
+#define mfLoad(p) ({mf8 mfLoad_v; memcpy(&mfLoad_v, (p), sizeof(mf8)); mfLoad_v;})
+#define mfStore(p, v) ({const mf8 mfStore_v = (v); memcpy((p), &mfStore_v, sizeof(mf8));})
+
+static inline __attribute__((always_inline)) void mMulNKernel(mat *r, const mat *a, const mat *b, const unsigned n)
+{
+    // two rows of a[i] to a vector, each row of b in both halves, like mMulAVX2
+    mf8 bk[4];
+    for(int k = 0; k < 4; k++)
+        bk[k] = (mf8){b->m[k][0], b->m[k][1], b->m[k][2], b->m[k][3], b->m[k][0], b->m[k][1], b->m[k][2], b->m[k][3]};
+    for(unsigned i = 0; i < n; i++)
+    {
+        const float (*ai)[4] = a[i].m;
+        mf8 o01 = mfSplat(0.f), o23 = mfSplat(0.f);
+        for(int k = 0; k < 4; k++)
+        {
+            o01 += (mf8){ai[0][k], ai[0][k], ai[0][k], ai[0][k], ai[1][k], ai[1][k], ai[1][k], ai[1][k]} * bk[k];
+            o23 += (mf8){ai[2][k], ai[2][k], ai[2][k], ai[2][k], ai[3][k], ai[3][k], ai[3][k], ai[3][k]} * bk[k];
+        }
+        mfStore(r[i].m[0], o01);
+        mfStore(r[i].m[2], o23);
+    }
+}
+
+static inline __attribute__((always_inline)) void mMulPNKernel(float *rx, float *ry, float *rz, float *rw, const mat *a, const float *x, const float *y, const float *z, const unsigned n)
+{
+    // 8 points at a time, the tail one at a time
+    mf8 c[4][4];
+    for(int k = 0; k < 4; k++)
+        for(int j = 0; j < 4; j++)
+            c[k][j] = mfSplat(a->m[k][j]);
+    unsigned i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        const mf8 px = mfLoad(&x[i]), py = mfLoad(&y[i]), pz = mfLoad(&z[i]);
+        const mf8 ox = px*c[0][0] + py*c[1][0] + pz*c[2][0] + c[3][0];
+        const mf8 oy = px*c[0][1] + py*c[1][1] + pz*c[2][1] + c[3][1];
+        const mf8 oz = px*c[0][2] + py*c[1][2] + pz*c[2][2] + c[3][2];
+        if(rw != NULL){mfStore(&rw[i], px*c[0][3] + py*c[1][3] + pz*c[2][3] + c[3][3]);}
+        mfStore(&rx[i], ox);
+        mfStore(&ry[i], oy);
+        mfStore(&rz[i], oz);
+    }
+    for(; i < n; i++)
+    {
+        vec p;
+        mMulP(&p, a, x[i], y[i], z[i]);
+        rx[i] = p.x, ry[i] = p.y, rz[i] = p.z;
+        if(rw != NULL){rw[i] = p.w;}
+    }
+}
+
+static inline __attribute__((always_inline)) void mInvertNKernel(mat *r, const mat *m, const unsigned n)
+{
+    // the Cramer inverse of mInvert() with NOSSE, 8 matrices at a time, one in each lane
+    static const float ident[16] = {1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f};
+    for(unsigned b = 0; b < n; b += 8)
+    {
+        const unsigned lanes = n - b < 8 ? n - b : 8; // the tail lanes invert the identity
+        mf8 tsrc[16], dst[16], tmp[12];
+        for(unsigned l = 0; l < 8; l++)
+        {
+            const float* src = l < lanes ? &m[b+l].m[0][0] : ident;
+            for(int i = 0; i < 4; i++)
+            {
+                tsrc[i][l] = src[i*4];
+                tsrc[i + 4][l] = src[i*4 + 1];
+                tsrc[i + 8][l] = src[i*4 + 2];
+                tsrc[i + 12][l] = src[i*4 + 3];
+            }
+        }
+
+        tmp[0] = tsrc[10] * tsrc[15];
+        tmp[1] = tsrc[11] * tsrc[14];
+        tmp[2] = tsrc[9] * tsrc[15];
+        tmp[3] = tsrc[11] * tsrc[13];
+        tmp[4] = tsrc[9] * tsrc[14];
+        tmp[5] = tsrc[10] * tsrc[13];
+        tmp[6] = tsrc[8] * tsrc[15];
+        tmp[7] = tsrc[11] * tsrc[12];
+        tmp[8] = tsrc[8] * tsrc[14];
+        tmp[9] = tsrc[10] * tsrc[12];
+        tmp[10] = tsrc[8] * tsrc[13];
+        tmp[11] = tsrc[9] * tsrc[12];
+
+        dst[0] = tmp[0]*tsrc[5] + tmp[3]*tsrc[6] + tmp[4]*tsrc[7];
+        dst[0] -= tmp[1]*tsrc[5] + tmp[2]*tsrc[6] + tmp[5]*tsrc[7];
+        dst[1] = tmp[1]*tsrc[4] + tmp[6]*tsrc[6] + tmp[9]*tsrc[7];
+        dst[1] -= tmp[0]*tsrc[4] + tmp[7]*tsrc[6] + tmp[8]*tsrc[7];
+        dst[2] = tmp[2]*tsrc[4] + tmp[7]*tsrc[5] + tmp[10]*tsrc[7];
+        dst[2] -= tmp[3]*tsrc[4] + tmp[6]*tsrc[5] + tmp[11]*tsrc[7];
+        dst[3] = tmp[5]*tsrc[4] + tmp[8]*tsrc[5] + tmp[11]*tsrc[6];
+        dst[3] -= tmp[4]*tsrc[4] + tmp[9]*tsrc[5] + tmp[10]*tsrc[6];
+        dst[4] = tmp[1]*tsrc[1] + tmp[2]*tsrc[2] + tmp[5]*tsrc[3];
+        dst[4] -= tmp[0]*tsrc[1] + tmp[3]*tsrc[2] + tmp[4]*tsrc[3];
+        dst[5] = tmp[0]*tsrc[0] + tmp[7]*tsrc[2] + tmp[8]*tsrc[3];
+        dst[5] -= tmp[1]*tsrc[0] + tmp[6]*tsrc[2] + tmp[9]*tsrc[3];
+        dst[6] = tmp[3]*tsrc[0] + tmp[6]*tsrc[1] + tmp[11]*tsrc[3];
+        dst[6] -= tmp[2]*tsrc[0] + tmp[7]*tsrc[1] + tmp[10]*tsrc[3];
+        dst[7] = tmp[4]*tsrc[0] + tmp[9]*tsrc[1] + tmp[10]*tsrc[2];
+        dst[7] -= tmp[5]*tsrc[0] + tmp[8]*tsrc[1] + tmp[11]*tsrc[2];
+
+        tmp[0] = tsrc[2]*tsrc[7];
+        tmp[1] = tsrc[3]*tsrc[6];
+        tmp[2] = tsrc[1]*tsrc[7];
+        tmp[3] = tsrc[3]*tsrc[5];
+        tmp[4] = tsrc[1]*tsrc[6];
+        tmp[5] = tsrc[2]*tsrc[5];
+        tmp[6] = tsrc[0]*tsrc[7];
+        tmp[7] = tsrc[3]*tsrc[4];
+        tmp[8] = tsrc[0]*tsrc[6];
+        tmp[9] = tsrc[2]*tsrc[4];
+        tmp[10] = tsrc[0]*tsrc[5];
+        tmp[11] = tsrc[1]*tsrc[4];
+
+        dst[8] = tmp[0]*tsrc[13] + tmp[3]*tsrc[14] + tmp[4]*tsrc[15];
+        dst[8] -= tmp[1]*tsrc[13] + tmp[2]*tsrc[14] + tmp[5]*tsrc[15];
+        dst[9] = tmp[1]*tsrc[12] + tmp[6]*tsrc[14] + tmp[9]*tsrc[15];
+        dst[9] -= tmp[0]*tsrc[12] + tmp[7]*tsrc[14] + tmp[8]*tsrc[15];
+        dst[10] = tmp[2]*tsrc[12] + tmp[7]*tsrc[13] + tmp[10]*tsrc[15];
+        dst[10]-= tmp[3]*tsrc[12] + tmp[6]*tsrc[13] + tmp[11]*tsrc[15];
+        dst[11] = tmp[5]*tsrc[12] + tmp[8]*tsrc[13] + tmp[11]*tsrc[14];
+        dst[11]-= tmp[4]*tsrc[12] + tmp[9]*tsrc[13] + tmp[10]*tsrc[14];
+        dst[12] = tmp[2]*tsrc[10] + tmp[5]*tsrc[11] + tmp[1]*tsrc[9];
+        dst[12]-= tmp[4]*tsrc[11] + tmp[0]*tsrc[9] + tmp[3]*tsrc[10];
+        dst[13] = tmp[8]*tsrc[11] + tmp[0]*tsrc[8] + tmp[7]*tsrc[10];
+        dst[13]-= tmp[6]*tsrc[10] + tmp[9]*tsrc[11] + tmp[1]*tsrc[8];
+        dst[14] = tmp[6]*tsrc[9] + tmp[11]*tsrc[11] + tmp[3]*tsrc[8];
+        dst[14]-= tmp[10]*tsrc[11] + tmp[2]*tsrc[8] + tmp[7]*tsrc[9];
+        dst[15] = tmp[10]*tsrc[10] + tmp[4]*tsrc[8] + tmp[9]*tsrc[9];
+        dst[15]-= tmp[8]*tsrc[9] + tmp[11]*tsrc[10] + tmp[5]*tsrc[8];
+
+        const mf8 det = mfSplat(1.f) / (tsrc[0]*dst[0] + tsrc[1]*dst[1] + tsrc[2]*dst[2] + tsrc[3]*dst[3]);
+        for(int j = 0; j < 16; j++){dst[j] *= det;}
+        for(unsigned l = 0; l < lanes; l++)
+            for(int j = 0; j < 16; j++)
+                r[b+l].m[j/4][j%4] = dst[j][l];
+    }
+}
+
+#ifndef NOSSE
+__attribute__((target("avx2,fma"))) void mMulNAVX2(mat *r, const mat *a, const mat *b, const unsigned n)
+{
+    // mMulAVX2 with the rows of b loaded once
+    const __m256 b0 = _mm256_broadcast_ps((const __m128*)b->m[0]);
+    const __m256 b1 = _mm256_broadcast_ps((const __m128*)b->m[1]);
+    const __m256 b2 = _mm256_broadcast_ps((const __m128*)b->m[2]);
+    const __m256 b3 = _mm256_broadcast_ps((const __m128*)b->m[3]);
+    for(unsigned i = 0; i < n; i++)
+    {
+        // rows 0 and 1 splat by shuffles, 2 and 3 by broadcast loads, so neither port does all of it
+        const __m256 a01 = _mm256_loadu_ps(a[i].m[0]);
+        const float* a2 = a[i].m[2];
+        const float* a3 = a[i].m[3];
+        __m256 o01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+        __m128 o2 = _mm_mul_ps(_mm_broadcast_ss(&a2[0]), _mm256_castps256_ps128(b0));
+        __m128 o3 = _mm_mul_ps(_mm_broadcast_ss(&a3[0]), _mm256_castps256_ps128(b0));
+        o01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1, o01);
+        o2 = _mm_fmadd_ps(_mm_broadcast_ss(&a2[1]), _mm256_castps256_ps128(b1), o2);
+        o3 = _mm_fmadd_ps(_mm_broadcast_ss(&a3[1]), _mm256_castps256_ps128(b1), o3);
+        o01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xAA), b2, o01);
+        o2 = _mm_fmadd_ps(_mm_broadcast_ss(&a2[2]), _mm256_castps256_ps128(b2), o2);
+        o3 = _mm_fmadd_ps(_mm_broadcast_ss(&a3[2]), _mm256_castps256_ps128(b2), o3);
+        o01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xFF), b3, o01);
+        o2 = _mm_fmadd_ps(_mm_broadcast_ss(&a2[3]), _mm256_castps256_ps128(b3), o2);
+        o3 = _mm_fmadd_ps(_mm_broadcast_ss(&a3[3]), _mm256_castps256_ps128(b3), o3);
+        _mm256_storeu_ps(r[i].m[0], o01);
+        _mm_storeu_ps(r[i].m[2], o2);
+        _mm_storeu_ps(r[i].m[3], o3);
+    }
+}
+__attribute__((target("avx2,fma"))) void mMulPNAVX2(float *rx, float *ry, float *rz, float *rw, const mat *a, const float *x, const float *y, const float *z, const unsigned n){mMulPNKernel(rx, ry, rz, rw, a, x, y, z, n);}
+__attribute__((target("avx2,fma"))) void mInvertNAVX2(mat *r, const mat *m, const unsigned n)
+{
+    // the Intel kernel of mInvert() on two matrices at a time, one in each lane, the shuffles stay in their lane
+    unsigned i = 0;
+    for(; i + 2 <= n; i += 2)
+    {
+        __m256 minor0, minor1, minor2, minor3, det, tmp1;
+        const __m256 m0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[i].m[0])), _mm_loadu_ps(m[i+1].m[0]), 1);
+        const __m256 m1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[i].m[1])), _mm_loadu_ps(m[i+1].m[1]), 1);
+        const __m256 m2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[i].m[2])), _mm_loadu_ps(m[i+1].m[2]), 1);
+        const __m256 m3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[i].m[3])), _mm_loadu_ps(m[i+1].m[3]), 1);
+
+        tmp1 = _mm256_shuffle_ps(m0, m1, 0x44);
+        __m256 row1 = _mm256_shuffle_ps(m2, m3, 0x44);
+        __m256 row0 = _mm256_shuffle_ps(tmp1, row1, 0x88);
+        row1 = _mm256_shuffle_ps(row1, tmp1, 0xDD);
+        tmp1 = _mm256_shuffle_ps(m0, m1, 0xEE);
+        __m256 row3 = _mm256_shuffle_ps(m2, m3, 0xEE);
+        __m256 row2 = _mm256_shuffle_ps(tmp1, row3, 0x88);
+        row3 = _mm256_shuffle_ps(row3, tmp1, 0xDD);
+
+        tmp1 = _mm256_mul_ps(row2, row3);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0xB1);
+        minor0 = _mm256_mul_ps(row1, tmp1);
+        minor1 = _mm256_mul_ps(row0, tmp1);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0x4E);
+        minor0 = _mm256_sub_ps(_mm256_mul_ps(row1, tmp1), minor0);
+        minor1 = _mm256_sub_ps(_mm256_mul_ps(row0, tmp1), minor1);
+        minor1 = _mm256_shuffle_ps(minor1, minor1, 0x4E);
+
+        tmp1 = _mm256_mul_ps(row1, row2);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0xB1);
+        minor0 = _mm256_add_ps(_mm256_mul_ps(row3, tmp1), minor0);
+        minor3 = _mm256_mul_ps(row0, tmp1);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0x4E);
+        minor0 = _mm256_sub_ps(minor0, _mm256_mul_ps(row3, tmp1));
+        minor3 = _mm256_sub_ps(_mm256_mul_ps(row0, tmp1), minor3);
+        minor3 = _mm256_shuffle_ps(minor3, minor3, 0x4E);
+
+        tmp1 = _mm256_mul_ps(_mm256_shuffle_ps(row1, row1, 0x4E), row3);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0xB1);
+        row2 = _mm256_shuffle_ps(row2, row2, 0x4E);
+        minor0 = _mm256_add_ps(_mm256_mul_ps(row2, tmp1), minor0);
+        minor2 = _mm256_mul_ps(row0, tmp1);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0x4E);
+        minor0 = _mm256_sub_ps(minor0, _mm256_mul_ps(row2, tmp1));
+        minor2 = _mm256_sub_ps(_mm256_mul_ps(row0, tmp1), minor2);
+        minor2 = _mm256_shuffle_ps(minor2, minor2, 0x4E);
+
+        tmp1 = _mm256_mul_ps(row0, row1);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0xB1);
+        minor2 = _mm256_add_ps(_mm256_mul_ps(row3, tmp1), minor2);
+        minor3 = _mm256_sub_ps(_mm256_mul_ps(row2, tmp1), minor3);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0x4E);
+        minor2 = _mm256_sub_ps(_mm256_mul_ps(row3, tmp1), minor2);
+        minor3 = _mm256_sub_ps(minor3, _mm256_mul_ps(row2, tmp1));
+
+        tmp1 = _mm256_mul_ps(row0, row3);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0xB1);
+        minor1 = _mm256_sub_ps(minor1, _mm256_mul_ps(row2, tmp1));
+        minor2 = _mm256_add_ps(_mm256_mul_ps(row1, tmp1), minor2);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0x4E);
+        minor1 = _mm256_add_ps(_mm256_mul_ps(row2, tmp1), minor1);
+        minor2 = _mm256_sub_ps(minor2, _mm256_mul_ps(row1, tmp1));
+
+        tmp1 = _mm256_mul_ps(row0, row2);
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0xB1);
+        minor1 = _mm256_add_ps(_mm256_mul_ps(row3, tmp1), minor1);
+        minor3 = _mm256_sub_ps(minor3, _mm256_mul_ps(row1, tmp1));
+        tmp1 = _mm256_shuffle_ps(tmp1, tmp1, 0x4E);
+        minor1 = _mm256_sub_ps(minor1, _mm256_mul_ps(row3, tmp1));
+        minor3 = _mm256_add_ps(_mm256_mul_ps(row1, tmp1), minor3);
+
+        // the full horizontal sum leaves the determinant in every element of its lane
+        det = _mm256_mul_ps(row0, minor0);
+        det = _mm256_add_ps(_mm256_shuffle_ps(det, det, 0x4E), det);
+        det = _mm256_add_ps(_mm256_shuffle_ps(det, det, 0xB1), det);
+        tmp1 = _mm256_rcp_ps(det);
+        det = _mm256_sub_ps(_mm256_add_ps(tmp1, tmp1), _mm256_mul_ps(det, _mm256_mul_ps(tmp1, tmp1)));
+        minor0 = _mm256_mul_ps(det, minor0);
+        minor1 = _mm256_mul_ps(det, minor1);
+        minor2 = _mm256_mul_ps(det, minor2);
+        minor3 = _mm256_mul_ps(det, minor3);
+        _mm_storeu_ps(r[i].m[0], _mm256_castps256_ps128(minor0));
+        _mm_storeu_ps(r[i].m[1], _mm256_castps256_ps128(minor1));
+        _mm_storeu_ps(r[i].m[2], _mm256_castps256_ps128(minor2));
+        _mm_storeu_ps(r[i].m[3], _mm256_castps256_ps128(minor3));
+        _mm_storeu_ps(r[i+1].m[0], _mm256_extractf128_ps(minor0, 1));
+        _mm_storeu_ps(r[i+1].m[1], _mm256_extractf128_ps(minor1, 1));
+        _mm_storeu_ps(r[i+1].m[2], _mm256_extractf128_ps(minor2, 1));
+        _mm_storeu_ps(r[i+1].m[3], _mm256_extractf128_ps(minor3, 1));
+    }
+    if(i < n)
+    {
+        const mat t = m[i];
+        mInvert(&r[i].m[0][0], &t.m[0][0]);
+    }
+}
+#endif
+void mMulNBase(mat *r, const mat *a, const mat *b, const unsigned n){mMulNKernel(r, a, b, n);}
+void mMulPNBase(float *rx, float *ry, float *rz, float *rw, const mat *a, const float *x, const float *y, const float *z, const unsigned n){mMulPNKernel(rx, ry, rz, rw, a, x, y, z, n);}
+void mInvertNBase(mat *r, const mat *m, const unsigned n)
+{
+#ifdef NOSSE
+    mInvertNKernel(r, m, n);
+#else
+    // the SSE mInvert() one at a time is faster than 8 lanes of Cramer in two SSE halves
+    for(unsigned i = 0; i < n; i++)
+    {
+        const mat t = m[i];
+        mInvert(&r[i].m[0][0], &t.m[0][0]);
+    }
+#endif
+}
+
+void (*mMulN)(mat *r, const mat *a, const mat *b, const unsigned n) = mMulNBase;
+void (*mMulPN)(float *rx, float *ry, float *rz, float *rw, const mat *a, const float *x, const float *y, const float *z, const unsigned n) = mMulPNBase;
+void (*mInvertN)(mat *r, const mat *m, const unsigned n) = mInvertNBase;
+
+void mInit()
+{
+#ifndef NOSSE
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        mMul = mMulAVX2;
+        mMulN = mMulNAVX2;
+        mMulPN = mMulPNAVX2;
+        mInvertN = mInvertNAVX2;
+    }
+#endif
+}
+
 #endif
@@ -0,0 +1,573 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Procedural Menger sponge mesh generator.
+
+    A level L sponge lives on a 3^L integer lattice, a lattice cell is
+    solid when no base-3 digit position has a 1 on two or more of its
+    axes. The mesh is built by sweeping every axis aligned lattice plane:
+
+        1. a face is only kept when a solid cell borders an empty cell or
+           the outside, faces shared by two sub-cubes never get emitted.
+        2. (MENGER_MERGE) the kept faces of each plane are greedy merged
+           into the largest rectangles that cover them, corners shared
+           inside a plane are welded into one vertex.
+        3. (MENGER_CACHE) the triangles are reordered for post-transform
+           vertex cache hits (Tom Forsyth's linear-speed optimiser) and
+           the vertices renumbered in order of first use.
+
+    Every vertex is a lattice point so merged rectangles cover exactly
+    the same area as the unit faces they replace, but their long edges
+    leave T-junctions against the neighbouring faces and the rasterizer
+    will round those differently along silhouettes. Without MENGER_MERGE
+    the output is pixel-identical to drawing every exposed unit face.
+
+    The sweep runs once to count and once to write, so the vertex and
+    index arrays are allocated exactly once at their final size.
+
+    mengerPack() converts the float vertices to 4 unsigned bytes each,
+    the lattice xyz and the face id (0-5 = +x,-x,+y,-y,+z,-z), for the
+    Lambert4/Phong4 shaders in esAux3.h. Lattice coordinates reach 243 at
+    level 5 so a byte per axis is enough for every supported level.
+
+    (MENGER_WELD) for the Lambert5/Phong5 shaders, which derive the
+    normal from screen-space derivatives, vertices are welded across
+    planes too: every lattice point becomes one vertex, there are no
+    normals and the packed face id byte is 0.
+
+    (MENGER_CELLS) for the per sub-cube GPU wiggle every level 1 sub-cube
+    is swept as a sponge of its own: the faces between two sub-cubes are
+    kept, rectangles and corners never cross a sub-cube boundary and each
+    vertex records its sub-cube (x + y*3 + z*9) in cells[]. mengerPack()
+    then stores the face id in the low 3 bits of the 4th byte and the
+    sub-cube above them, so the shader can move each one rigidly. It is
+    ignored with MENGER_WELD and below level 1.
+
+    Requires gl.h (for the GL types).
+*/
+
+#ifndef MENGER_H
+#define MENGER_H
+
+#include <stdlib.h>
+#include <float.h>
+
+#define MENGER_MAX_LEVEL 5
+#define MENGER_SIZE 6.f // edge length of the sponge in world units
+
+#define MENGER_MERGE 1
+#define MENGER_CACHE 2
+#define MENGER_WELD 4
+#define MENGER_CELLS 8
+#define MENGER_OPTIMISE MENGER_CACHE // pixel-identical default
+
+#define MENGER_CACHE_SIZE 32
+
+typedef struct
+{
+    GLfloat* vertices;  // xyz per vertex
+    GLfloat* normals;   // xyz per vertex, NULL when welded
+    GLuint*  indices;   // GL_TRIANGLES
+    GLubyte* cells;     // level 1 sub-cube per vertex, NULL without MENGER_CELLS
+    GLuint   numvert;
+    GLuint   numind;
+    GLuint   level;
+    GLfloat  quant[2];  // lattice to world: scale, offset
+} MengerMesh;
+
+GLuint mengerCountFaces(const GLuint level); // exposed unit faces
+int    mengerGenerate(MengerMesh* m, const GLuint level, const GLuint flags); // returns 0 on failure
+void   mengerFree(MengerMesh* m);
+GLubyte* mengerPack(const MengerMesh* m); // numvert*4 bytes, caller frees
+void   mengerCacheOptimise(GLuint* indices, const GLuint numind, const GLuint numvert);
+void   mengerReorderVertices(MengerMesh* m);
+int    mengerWeld(MengerMesh* m); // returns 0 on failure
+float  mengerACMR(const GLuint* indices, const GLuint numind, const GLuint numvert, const GLuint cachesize); // average cache miss ratio of a FIFO cache
+
+//
+
+// bitmask of the base-3 digit positions of c that are 1
+static inline GLuint mengerDigitMask(GLuint c, const GLuint level)
+{
+    GLuint mask = 0;
+    for(GLuint i = 0; i < level; i++)
+    {
+        if(c % 3 == 1){mask |= 1 << i;}
+        c /= 3;
+    }
+    return mask;
+}
+
+// the digit masks are precomputed per axis so the solid test is O(1)
+static inline int mengerSolid(const GLuint* dm, const int n, const int x, const int y, const int z)
+{
+    if(x < 0 || y < 0 || z < 0 || x >= n || y >= n || z >= n){return 0;}
+    const GLuint mx = dm[x], my = dm[y], mz = dm[z];
+    return ((mx & my) | (my & mz) | (mx & mz)) == 0;
+}
+
+static GLuint* mengerMasks(const GLuint level, int* n)
+{
+    *n = 1;
+    for(GLuint i = 0; i < level; i++){*n *= 3;}
+    GLuint* dm = malloc(*n * sizeof(GLuint));
+    if(dm == NULL){return NULL;}
+    for(int i = 0; i < *n; i++){dm[i] = mengerDigitMask(i, level);}
+    return dm;
+}
+
+GLuint mengerCountFaces(const GLuint level)
+{
+    int n;
+    GLuint* dm = mengerMasks(level, &n);
+    if(dm == NULL){return 0;}
+
+    GLuint faces = 0;
+    for(int z = 0; z < n; z++)
+    for(int y = 0; y < n; y++)
+    for(int x = 0; x < n; x++)
+    {
+        if(mengerSolid(dm, n, x, y, z) == 0){continue;}
+        faces += !mengerSolid(dm, n, x+1, y, z) + !mengerSolid(dm, n, x-1, y, z) +
+                 !mengerSolid(dm, n, x, y+1, z) + !mengerSolid(dm, n, x, y-1, z) +
+                 !mengerSolid(dm, n, x, y, z+1) + !mengerSolid(dm, n, x, y, z-1);
+    }
+
+    free(dm);
+    return faces;
+}
+
+// sweeps every lattice plane, counts into numvert/numind and when
+// m is not NULL also writes the vertices and indices into m
+static int mengerSweep(const GLuint level, const GLuint flags, MengerMesh* m, GLuint* numvert, GLuint* numind)
+{
+    int n;
+    GLuint* dm = mengerMasks(level, &n);
+    if(dm == NULL){return 0;}
+    const int n1 = n+1;
+    unsigned char* mask = malloc(n*n);
+    GLuint* corner = malloc(n1*n1 * sizeof(GLuint)); // vertex id of each plane corner
+    GLuint* stamp  = calloc(n1*n1, sizeof(GLuint));  // plane id that set corner[]
+    if(mask == NULL || corner == NULL || stamp == NULL)
+    {
+        free(dm), free(mask), free(corner), free(stamp);
+        return 0;
+    }
+
+    const GLfloat s = MENGER_SIZE / (GLfloat)n;
+    const GLfloat o = MENGER_SIZE * -0.5f;
+    const int sub = (flags & MENGER_CELLS) && n >= 3 ? n/3 : n; // sub-cube edge in lattice cells
+    GLuint vi = 0, ii = 0, plane = 0;
+
+    for(int a = 0; a < 3; a++)
+    for(int d = 1; d >= -1; d -= 2)
+    for(int p = 0; p <= n; p++)
+    {
+        // exposed faces of this plane
+        const int u = (a+1) % 3, v = (a+2) % 3;
+        const int front = d > 0 ? p-1 : p; // solid side
+        const int back  = d > 0 ? p : p-1; // empty side
+        int any = 0;
+        for(int j = 0; j < n; j++)
+        for(int i = 0; i < n; i++)
+        {
+            int c0[3], c1[3];
+            c0[a] = front, c0[u] = i, c0[v] = j;
+            c1[a] = back,  c1[u] = i, c1[v] = j;
+            mask[i + j*n] = mengerSolid(dm, n, c0[0], c0[1], c0[2]) &&
+                (!mengerSolid(dm, n, c1[0], c1[1], c1[2]) || front/sub != back/sub);
+            any |= mask[i + j*n];
+        }
+        if(any == 0){continue;}
+
+        // cover them with rectangles, one sub-cube block at a time
+        for(int bj = 0; bj < n; bj += sub)
+        for(int bi = 0; bi < n; bi += sub)
+        {
+            plane++; // corners are only shared inside a block
+            GLubyte cell = 0;
+            if(sub != n)
+            {
+                int cc[3];
+                cc[a] = front/sub, cc[u] = bi/sub, cc[v] = bj/sub;
+                cell = cc[0] + cc[1]*3 + cc[2]*9;
+            }
+            for(int j = bj; j < bj+sub; j++)
+            for(int i = bi; i < bi+sub; i++)
+            {
+                if(mask[i + j*n] == 0){continue;}
+                int w = 1, h = 1;
+                if(flags & MENGER_MERGE)
+                {
+                    while(i+w < bi+sub && mask[i+w + j*n] == 1){w++;}
+                    for(; j+h < bj+sub; h++)
+                    {
+                        int row = 1;
+                        for(int k = 0; k < w; k++){if(mask[i+k + (j+h)*n] == 0){row = 0; break;}}
+                        if(row == 0){break;}
+                    }
+                }
+                for(int jj = 0; jj < h; jj++){memset(&mask[i + (j+jj)*n], 0, w);}
+
+                // counter-clockwise when viewed from outside
+                const int cu[4] = {i, i+w, i+w, i};
+                const int cv[4] = {j, j, j+h, j+h};
+                GLuint id[4];
+                for(int k = 0; k < 4; k++)
+                {
+                    const int kk = d > 0 ? k : 3-k;
+                    const int ci = cu[kk] + cv[kk]*n1;
+                    if(stamp[ci] == plane){id[k] = corner[ci]; continue;}
+                    stamp[ci] = plane;
+                    corner[ci] = id[k] = vi;
+                    if(m != NULL)
+                    {
+                        int lp[3];
+                        lp[a] = p, lp[u] = cu[kk], lp[v] = cv[kk];
+                        GLfloat* vp = &m->vertices[vi*3];
+                        GLfloat* np = &m->normals[vi*3];
+                        vp[0] = o + lp[0]*s, vp[1] = o + lp[1]*s, vp[2] = o + lp[2]*s;
+                        np[0] = 0.f, np[1] = 0.f, np[2] = 0.f;
+                        np[a] = (GLfloat)d;
+                        if(m->cells != NULL){m->cells[vi] = cell;}
+                    }
+                    vi++;
+                }
+                if(m != NULL)
+                {
+                    GLuint* ip = &m->indices[ii];
+                    ip[0] = id[0], ip[1] = id[1], ip[2] = id[2];
+                    ip[3] = id[0], ip[4] = id[2], ip[5] = id[3];
+                }
+                ii += 6;
+            }
+        }
+    }
+
+    free(dm), free(mask), free(corner), free(stamp);
+    *numvert = vi;
+    *numind = ii;
+    return 1;
+}
+
+int mengerGenerate(MengerMesh* m, const GLuint level, const GLuint flags)
+{
+    memset(m, 0x0, sizeof(MengerMesh));
+    if(level > MENGER_MAX_LEVEL)
+    {
+        printf("!!! menger level %u exceeds maximum of %u !!!\n", level, MENGER_MAX_LEVEL);
+        return 0;
+    }
+
+    int n = 1;
+    for(GLuint i = 0; i < level; i++){n *= 3;}
+    m->quant[0] = MENGER_SIZE / (GLfloat)n;
+    m->quant[1] = MENGER_SIZE * -0.5f;
+
+    GLuint fl = flags;
+    if((fl & MENGER_WELD) || level == 0){fl &= ~MENGER_CELLS;}
+
+    GLuint numvert = 0, numind = 0;
+    if(mengerSweep(level, fl, NULL, &numvert, &numind) == 1)
+    {
+        m->level = level;
+        m->vertices = malloc(numvert * 3 * sizeof(GLfloat));
+        m->normals = malloc(numvert * 3 * sizeof(GLfloat));
+        m->indices = malloc(numind * sizeof(GLuint));
+        if(fl & MENGER_CELLS){m->cells = malloc(numvert);}
+    }
+    if(m->vertices == NULL || m->normals == NULL || m->indices == NULL || ((fl & MENGER_CELLS) && m->cells == NULL) ||
+        mengerSweep(level, fl, m, &m->numvert, &m->numind) == 0)
+    {
+        printf("!!! failed to allocate menger level %u mesh !!!\n", level);
+        mengerFree(m);
+        return 0;
+    }
+
+    if((fl & MENGER_WELD) && mengerWeld(m) == 0)
+    {
+        printf("!!! failed to weld menger level %u mesh !!!\n", level);
+        mengerFree(m);
+        return 0;
+    }
+
+    if(fl & MENGER_CACHE)
+    {
+        mengerCacheOptimise(m->indices, m->numind, m->numvert);
+        mengerReorderVertices(m);
+    }
+    return 1;
+}
+
+void mengerFree(MengerMesh* m)
+{
+    free(m->vertices);
+    free(m->normals);
+    free(m->indices);
+    free(m->cells);
+    m->vertices = NULL;
+    m->normals = NULL;
+    m->indices = NULL;
+    m->cells = NULL;
+    m->numvert = 0;
+    m->numind = 0;
+}
+
+GLubyte* mengerPack(const MengerMesh* m)
+{
+    GLubyte* q = malloc(m->numvert * 4);
+    if(q == NULL){return NULL;}
+    const GLfloat rs = 1.f / m->quant[0];
+    for(GLuint i = 0; i < m->numvert; i++)
+    {
+        const GLfloat* vp = &m->vertices[i*3];
+        const GLfloat* np = m->normals != NULL ? &m->normals[i*3] : NULL;
+        GLubyte* qp = &q[i*4];
+        qp[3] = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            qp[k] = (GLubyte)((vp[k] - m->quant[1]) * rs + 0.5f);
+            if(np != NULL && np[k] != 0.f){qp[3] = k*2 + (np[k] < 0.f);}
+        }
+        if(m->cells != NULL){qp[3] |= m->cells[i] << 3;}
+    }
+    return q;
+}
+
+int mengerWeld(MengerMesh* m)
+{
+    GLuint n1 = 1;
+    for(GLuint i = 0; i < m->level; i++){n1 *= 3;}
+    n1++;
+    GLuint* point = malloc(n1*n1*n1 * sizeof(GLuint)); // vertex id of each lattice point
+    GLuint* remap = malloc(m->numvert * sizeof(GLuint));
+    if(point == NULL || remap == NULL)
+    {
+        free(point), free(remap);
+        return 0;
+    }
+    memset(point, 0xFF, n1*n1*n1 * sizeof(GLuint));
+
+    const GLfloat rs = 1.f / m->quant[0];
+    GLuint next = 0;
+    for(GLuint i = 0; i < m->numvert; i++)
+    {
+        const GLfloat* vp = &m->vertices[i*3];
+        const GLuint x = (GLuint)((vp[0] - m->quant[1]) * rs + 0.5f);
+        const GLuint y = (GLuint)((vp[1] - m->quant[1]) * rs + 0.5f);
+        const GLuint z = (GLuint)((vp[2] - m->quant[1]) * rs + 0.5f);
+        GLuint* pp = &point[x + (y + z*n1)*n1];
+        if(*pp == UINT32_MAX)
+        {
+            *pp = next;
+            memmove(&m->vertices[next*3], vp, 3 * sizeof(GLfloat));
+            next++;
+        }
+        remap[i] = *pp;
+    }
+    for(GLuint i = 0; i < m->numind; i++){m->indices[i] = remap[m->indices[i]];}
+    m->numvert = next;
+
+    free(point);
+    free(remap);
+    free(m->normals);
+    m->normals = NULL;
+    return 1;
+}
+
+//*************************************
+// vertex cache optimisation
+//*************************************
+
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+static float mengerVertexScore(const int cachepos, const GLuint valence)
+{
+    if(valence == 0){return -1.f;}
+    float score = 0.f;
+    if(cachepos >= 0)
+    {
+        if(cachepos < 3)
+            score = 0.75f;
+        else
+            score = powf(1.f - (float)(cachepos-3) / (float)(MENGER_CACHE_SIZE-3), 1.5f);
+    }
+    return score + 2.f * powf((float)valence, -0.5f);
+}
+
+void mengerCacheOptimise(GLuint* indices, const GLuint numind, const GLuint numvert)
+{
+    const GLuint numtri = numind / 3;
+    if(numtri == 0){return;}
+
+    GLuint* valence  = calloc(numvert, sizeof(GLuint));
+    GLuint* adjstart = malloc((numvert+1) * sizeof(GLuint));
+    GLuint* adj      = malloc(numind * sizeof(GLuint));
+    int*    cachepos = malloc(numvert * sizeof(int));
+    float*  vscore   = malloc(numvert * sizeof(float));
+    float*  tscore   = malloc(numtri * sizeof(float));
+    unsigned char* added = calloc(numtri, 1);
+    GLuint* out      = malloc(numind * sizeof(GLuint));
+    if(valence == NULL || adjstart == NULL || adj == NULL || cachepos == NULL ||
+        vscore == NULL || tscore == NULL || added == NULL || out == NULL)
+    {
+        printf("!!! failed to allocate vertex cache optimiser, order unchanged !!!\n");
+        free(valence), free(adjstart), free(adj), free(cachepos);
+        free(vscore), free(tscore), free(added), free(out);
+        return;
+    }
+
+    // triangle adjacency per vertex, valence doubles as the live count
+    for(GLuint i = 0; i < numind; i++){valence[indices[i]]++;}
+    adjstart[0] = 0;
+    for(GLuint i = 0; i < numvert; i++){adjstart[i+1] = adjstart[i] + valence[i];}
+    for(GLuint i = 0; i < numvert; i++){valence[i] = 0;}
+    for(GLuint i = 0; i < numind; i++)
+    {
+        const GLuint vv = indices[i];
+        adj[adjstart[vv] + valence[vv]++] = i/3;
+    }
+    for(GLuint i = 0; i < numvert; i++)
+    {
+        cachepos[i] = -1;
+        vscore[i] = mengerVertexScore(-1, valence[i]);
+    }
+    for(GLuint i = 0; i < numtri; i++)
+        tscore[i] = vscore[indices[i*3]] + vscore[indices[i*3+1]] + vscore[indices[i*3+2]];
+
+    GLuint cache[MENGER_CACHE_SIZE+3];
+    GLuint cachelen = 0;
+    GLuint scan = 0; // lowest triangle that may not have been added
+    GLuint best = 0;
+    for(GLuint i = 1; i < numtri; i++){if(tscore[i] > tscore[best]){best = i;}}
+
+    for(GLuint o = 0; o < numtri; o++)
+    {
+        if(best == UINT32_MAX)
+        {
+            // nothing in the cache has triangles left, resume from the
+            // first unused triangle to keep this linear time
+            while(added[scan] == 1){scan++;}
+            best = scan;
+        }
+
+        const GLuint* tri = &indices[best*3];
+        added[best] = 1;
+        out[o*3] = tri[0], out[o*3+1] = tri[1], out[o*3+2] = tri[2];
+
+        // retire the triangle from its vertices
+        for(int k = 0; k < 3; k++)
+        {
+            const GLuint vv = tri[k];
+            GLuint* list = &adj[adjstart[vv]];
+            for(GLuint j = 0; j < valence[vv]; j++)
+            {
+                if(list[j] == best)
+                {
+                    list[j] = list[valence[vv]-1];
+                    break;
+                }
+            }
+            valence[vv]--;
+        }
+
+        // push its vertices to the front of the lru cache
+        GLuint ncache[MENGER_CACHE_SIZE+3];
+        GLuint nlen = 0;
+        for(int k = 0; k < 3; k++){ncache[nlen++] = tri[k];}
+        for(GLuint j = 0; j < cachelen; j++)
+        {
+            const GLuint vv = cache[j];
+            if(vv != tri[0] && vv != tri[1] && vv != tri[2]){ncache[nlen++] = vv;}
+        }
+        for(GLuint j = 0; j < nlen; j++)
+            cachepos[ncache[j]] = j < MENGER_CACHE_SIZE ? (int)j : -1;
+
+        // rescore everything the cache touched and pick the next triangle
+        best = UINT32_MAX;
+        float bs = -FLT_MAX;
+        for(GLuint j = 0; j < nlen; j++)
+        {
+            const GLuint vv = ncache[j];
+            vscore[vv] = mengerVertexScore(cachepos[vv], valence[vv]);
+        }
+        for(GLuint j = 0; j < nlen; j++)
+        {
+            const GLuint vv = ncache[j];
+            const GLuint* list = &adj[adjstart[vv]];
+            for(GLuint t = 0; t < valence[vv]; t++)
+            {
+                const GLuint ti = list[t];
+                const GLuint* tv = &indices[ti*3];
+                tscore[ti] = vscore[tv[0]] + vscore[tv[1]] + vscore[tv[2]];
+                if(tscore[ti] > bs){bs = tscore[ti], best = ti;}
+            }
+        }
+
+        cachelen = nlen < MENGER_CACHE_SIZE ? nlen : MENGER_CACHE_SIZE;
+        memcpy(cache, ncache, cachelen * sizeof(GLuint));
+    }
+
+    memcpy(indices, out, numind * sizeof(GLuint));
+    free(valence), free(adjstart), free(adj), free(cachepos);
+    free(vscore), free(tscore), free(added), free(out);
+}
+
+// renumber vertices in order of first use so fetches walk memory forwards
+void mengerReorderVertices(MengerMesh* m)
+{
+    GLuint* remap = malloc(m->numvert * sizeof(GLuint));
+    GLfloat* nv = malloc(m->numvert * 3 * sizeof(GLfloat));
+    GLfloat* nn = m->normals != NULL ? malloc(m->numvert * 3 * sizeof(GLfloat)) : NULL;
+    GLubyte* nc = m->cells != NULL ? malloc(m->numvert) : NULL;
+    if(remap == NULL || nv == NULL || (nn == NULL && m->normals != NULL) || (nc == NULL && m->cells != NULL))
+    {
+        free(remap), free(nv), free(nn), free(nc);
+        return;
+    }
+    memset(remap, 0xFF, m->numvert * sizeof(GLuint));
+
+    GLuint next = 0;
+    for(GLuint i = 0; i < m->numind; i++)
+    {
+        const GLuint vv = m->indices[i];
+        if(remap[vv] == UINT32_MAX)
+        {
+            remap[vv] = next;
+            memcpy(&nv[next*3], &m->vertices[vv*3], 3 * sizeof(GLfloat));
+            if(nn != NULL){memcpy(&nn[next*3], &m->normals[vv*3], 3 * sizeof(GLfloat));}
+            if(nc != NULL){nc[next] = m->cells[vv];}
+            next++;
+        }
+        m->indices[i] = remap[vv];
+    }
+
+    free(m->vertices);
+    free(m->normals);
+    free(m->cells);
+    free(remap);
+    m->vertices = nv;
+    m->normals = nn;
+    m->cells = nc;
+}
+
+float mengerACMR(const GLuint* indices, const GLuint numind, const GLuint numvert, const GLuint cachesize)
+{
+    if(numind == 0){return 0.f;}
+    GLuint* stamp = calloc(numvert, sizeof(GLuint)); // time each vertex entered the fifo
+    if(stamp == NULL){return 0.f;}
+    GLuint misses = 0;
+    for(GLuint i = 0; i < numind; i++)
+    {
+        const GLuint vv = indices[i];
+        if(stamp[vv] == 0 || misses - stamp[vv] >= cachesize)
+        {
+            misses++;
+            stamp[vv] = misses;
+        }
+    }
+    free(stamp);
+    return (float)misses / (float)(numind/3);
+}
+
+#endif
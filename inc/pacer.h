@@ -0,0 +1,165 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Frame pacer on CLOCK_MONOTONIC absolute deadlines.
+
+    Deadlines advance by a fixed interval from the first frame, so a late
+    frame does not push every later frame back with it. The wait sleeps with
+    clock_nanosleep(TIMER_ABSTIME) to within spin ns of the deadline and then
+    spins on the clock for the rest, OS wake-up slack is larger than a frame
+    at high rates.
+
+    An overrun is handled by policy:
+        PACER_CATCHUP - late frames run back to back until they are on time
+                        again, the frame count keeps up with the wall clock
+                        (unless it falls PACER_MAX_BEHIND intervals behind)
+        PACER_DROP    - missed deadlines are skipped, the next frame waits
+                        for the next deadline still in the future
+
+    The achieved frame intervals of the last PACER_SAMPLES frames are kept
+    for p50/p99/max statistics. With trace.h included first the sleep, the
+    spin and how late the wake was (late_ns) go to the trace.
+*/
+
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#define PACER_CATCHUP 0
+#define PACER_DROP 1
+#define PACER_MAX_BEHIND 8
+#define PACER_SPIN_NS 200000
+#define PACER_SAMPLES 1024
+
+typedef struct
+{
+    int64_t next;       // next deadline ns
+    int64_t last;       // last wake ns
+    int64_t interval;   // ns per frame
+    int64_t spin;       // ns spent spinning before a deadline
+    unsigned policy;
+    uint64_t frames;
+    uint64_t dropped;   // deadlines skipped
+    float samples[PACER_SAMPLES]; // achieved intervals in ms
+} Pacer;
+
+int64_t pacerNow(); // CLOCK_MONOTONIC ns
+void    pacerInit(Pacer* p, const double fps, const unsigned policy);
+void    pacerSetRate(Pacer* p, const double fps);
+void    pacerWait(Pacer* p); // returns at the next deadline
+void    pacerMark(Pacer* p); // records a frame without waiting, for uncapped loops
+void    pacerStats(const Pacer* p, float* p50, float* p99, float* max); // of the last PACER_SAMPLES frames, ms
+void    pacerPrint(const Pacer* p);
+
+//
+
+int64_t pacerNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void pacerSetRate(Pacer* p, const double fps)
+{
+    p->interval = fps > 0.0 ? (int64_t)(1e9 / fps) : 0;
+    if(p->interval < 100000){p->interval = 100000;} // limited to 10,000 FPS maximum
+}
+
+void pacerInit(Pacer* p, const double fps, const unsigned policy)
+{
+    memset(p, 0, sizeof(Pacer));
+    pacerSetRate(p, fps);
+    p->spin = PACER_SPIN_NS;
+    p->policy = policy;
+    p->last = pacerNow();
+    p->next = p->last + p->interval;
+}
+
+void pacerWait(Pacer* p)
+{
+    int64_t now = pacerNow();
+    if(now < p->next)
+    {
+        const int64_t wake = p->next - p->spin;
+        if(now < wake)
+        {
+#ifdef TRACE_H
+            traceBegin("sleep");
+#endif
+            const struct timespec ts = {wake / 1000000000, wake % 1000000000};
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR){} // any other error falls through to the spin
+#ifdef TRACE_H
+            traceEndArg("late_ns", pacerNow() - wake); // overshoot past the spin window shows here
+#endif
+        }
+#ifdef TRACE_H
+        traceBegin("spin");
+#endif
+        do{now = pacerNow();}while(now < p->next);
+#ifdef TRACE_H
+        traceEndArg("late_ns", now - p->next);
+#endif
+    }
+
+    p->samples[p->frames % PACER_SAMPLES] = (float)(now - p->last) * 1e-6f;
+    p->frames++;
+    p->last = now;
+
+    // next deadline, late frames either catch up or skip what they missed
+    p->next += p->interval;
+    const int64_t behind = now - p->next;
+    if(behind > 0 && (p->policy == PACER_DROP || behind > p->interval * PACER_MAX_BEHIND))
+    {
+        const int64_t missed = behind / p->interval + 1;
+        p->next += missed * p->interval;
+        p->dropped += missed;
+#ifdef TRACE_H
+        traceInstant("dropped", "deadlines", missed);
+#endif
+    }
+}
+
+void pacerMark(Pacer* p)
+{
+    const int64_t now = pacerNow();
+    p->samples[p->frames % PACER_SAMPLES] = (float)(now - p->last) * 1e-6f;
+    p->frames++;
+    p->last = now;
+}
+
+int pacerCmp(const void* a, const void* b)
+{
+    const float fa = *(const float*)a, fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void pacerStats(const Pacer* p, float* p50, float* p99, float* max)
+{
+    *p50 = 0.f, *p99 = 0.f, *max = 0.f;
+    const unsigned n = p->frames < PACER_SAMPLES ? (unsigned)p->frames : PACER_SAMPLES;
+    if(n == 0){return;}
+    float s[PACER_SAMPLES];
+    memcpy(s, p->samples, n * sizeof(float));
+    qsort(s, n, sizeof(float), pacerCmp);
+    *p50 = s[n/2];
+    *p99 = s[(n*99)/100];
+    *max = s[n-1];
+}
+
+void pacerPrint(const Pacer* p)
+{
+    float p50, p99, max;
+    pacerStats(p, &p50, &p99, &max);
+    printf("frame interval target %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms, %lu frames, %lu dropped\n",
+        (double)p->interval * 1e-6, p50, p99, max, (unsigned long)p->frames, (unsigned long)p->dropped);
+}
+
+#endif
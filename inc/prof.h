@@ -0,0 +1,237 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Per frame stage timing.
+
+    CPU time is CLOCK_MONOTONIC, each profMark() gives the time since the
+    last mark to a stage, so a stage can be marked more than once a frame
+    and its pieces add up. GPU time is a GL_TIME_ELAPSED query around the
+    draw, from a ring of PROF_QUERIES queries that are only read back once
+    GL_QUERY_RESULT_AVAILABLE says so, never waited on. A frame whose query
+    has not come back by the time the ring wraps has no GPU time, and nor
+    does the first, llvmpipe times it from its epoch.
+
+    The last PROF_FRAMES frames are kept for profPrint() and profDump(),
+    a CSV with one row a frame, milliseconds, gpu_ms empty when unknown.
+
+    Usage:
+        profInit(0);                // first frame number, with the GL context current
+        profBegin();                // top of the frame
+        profMark(PROF_CAMERA);      // after each stage
+        profGPUBegin(); profGPUEnd();
+        profEnd();                  // bottom of the frame
+        profDump("out.csv");
+*/
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define PROF_CAMERA 0
+#define PROF_WIGGLE 1
+#define PROF_NORMAL 2
+#define PROF_UPLOAD 3
+#define PROF_DRAW 4
+#define PROF_RECORD 5
+#define PROF_SWAP 6
+#define PROF_STAGES 7
+
+#define PROF_FRAMES 4096
+#define PROF_QUERIES 8
+
+typedef struct
+{
+    uint64_t frame;
+    double t;                   // seconds since profInit()
+    float cpu[PROF_STAGES];     // ms
+    float total;                // ms, begin to end
+    float gpu;                  // ms, < 0 unknown
+} ProfFrame;
+
+struct
+{
+    int on, gpu;
+    int64_t start, begin, last;
+    uint64_t first, frame;      // first frame number, next frame number
+    ProfFrame* ring;
+    GLuint query[PROF_QUERIES];
+    uint64_t qframe[PROF_QUERIES];
+    uint64_t qissued, qread;    // ring counters, query = counter % PROF_QUERIES
+    int qopen;
+} prof;
+
+const char* prof_names[PROF_STAGES] = {"camera", "wiggle", "normal", "upload", "draw", "record", "swap"};
+
+int  profInit(const uint64_t first); // returns 0 on failure
+void profBegin();
+void profMark(const unsigned stage);
+void profGPUBegin();
+void profGPUEnd();
+void profEnd();
+void profPrint();
+int  profDump(const char* path); // returns 0 on failure
+void profFree();
+
+//
+
+static inline int64_t profNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int profInit(const uint64_t first)
+{
+    memset(&prof, 0, sizeof(prof));
+    prof.first = prof.frame = first;
+    prof.ring = calloc(PROF_FRAMES, sizeof(ProfFrame));
+    if(prof.ring == NULL){return 0;}
+
+    // GL 3.3 or GL_ARB_timer_query, a core context has no GL_EXTENSIONS string
+    const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+    prof.gpu = glGetQueryObjectui64v != NULL && glGenQueries != NULL &&
+        (GLAD_GL_VERSION_3_3 || (ext != NULL && strstr(ext, "GL_ARB_timer_query") != NULL));
+    if(prof.gpu == 1){glGenQueries(PROF_QUERIES, &prof.query[0]);}
+
+    prof.start = profNow();
+    prof.on = 1;
+    printf("profile: %d stages, last %d frames kept, GPU time %s\n", PROF_STAGES, PROF_FRAMES, prof.gpu == 1 ? "from GL_TIME_ELAPSED" : "unavailable");
+    return 1;
+}
+
+void profCollect()
+{
+    // every finished query, oldest first, stops at the first still in flight
+    while(prof.qread < prof.qissued)
+    {
+        const unsigned q = prof.qread % PROF_QUERIES;
+        GLint ready = 0;
+        glGetQueryObjectiv(prof.query[q], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if(ready == 0){break;}
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(prof.query[q], GL_QUERY_RESULT, &ns);
+        ProfFrame* f = &prof.ring[prof.qframe[q] % PROF_FRAMES];
+        if(prof.qread > 0 && f->frame == prof.qframe[q]){f->gpu = (float)((double)ns * 1e-6);}
+        prof.qread++;
+    }
+}
+
+void profBegin()
+{
+    if(prof.on == 0){return;}
+    ProfFrame* f = &prof.ring[prof.frame % PROF_FRAMES];
+    memset(f, 0, sizeof(ProfFrame));
+    f->frame = prof.frame;
+    f->gpu = -1.f;
+    prof.begin = prof.last = profNow();
+    f->t = (double)(prof.begin - prof.start) * 1e-9;
+    if(prof.gpu == 1){profCollect();}
+}
+
+void profMark(const unsigned stage)
+{
+    if(prof.on == 0){return;}
+    const int64_t now = profNow();
+    prof.ring[prof.frame % PROF_FRAMES].cpu[stage] += (float)((double)(now - prof.last) * 1e-6);
+    prof.last = now;
+}
+
+void profGPUBegin()
+{
+    // a full ring skips the frame rather than wait on the oldest query
+    if(prof.on == 0 || prof.gpu == 0 || prof.qissued - prof.qread == PROF_QUERIES){return;}
+    const unsigned q = prof.qissued % PROF_QUERIES;
+    prof.qframe[q] = prof.frame;
+    glBeginQuery(GL_TIME_ELAPSED, prof.query[q]);
+    prof.qopen = 1;
+}
+
+void profGPUEnd()
+{
+    if(prof.qopen == 0){return;}
+    glEndQuery(GL_TIME_ELAPSED);
+    prof.qopen = 0;
+    prof.qissued++;
+}
+
+void profEnd()
+{
+    if(prof.on == 0){return;}
+    ProfFrame* f = &prof.ring[prof.frame % PROF_FRAMES];
+    f->total = (float)((double)(profNow() - prof.begin) * 1e-6);
+    prof.frame++;
+}
+
+int profCmp(const void* a, const void* b)
+{
+    const float fa = *(const float*)a, fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void profPrint()
+{
+    if(prof.on == 0 || prof.frame == prof.first){return;}
+    const unsigned n = prof.frame - prof.first < PROF_FRAMES ? (unsigned)(prof.frame - prof.first) : PROF_FRAMES;
+    float* s = malloc(n * sizeof(float));
+    if(s == NULL){return;}
+    printf("stage    | mean ms  | p50 ms   | p99 ms   | max ms   (last %u frames)\n", n);
+    for(int k = 0; k <= PROF_STAGES+1; k++)
+    {
+        // the stages, then the whole frame, then the GPU of the frames that have it
+        unsigned m = 0;
+        double sum = 0.0;
+        for(unsigned i = 0; i < n; i++)
+        {
+            const ProfFrame* f = &prof.ring[(prof.frame - 1 - i) % PROF_FRAMES];
+            const float v = k < PROF_STAGES ? f->cpu[k] : (k == PROF_STAGES ? f->total : f->gpu);
+            if(v < 0.f){continue;}
+            s[m++] = v, sum += v;
+        }
+        if(m == 0){continue;}
+        qsort(s, m, sizeof(float), profCmp);
+        printf("%-8s | %-8.3f | %-8.3f | %-8.3f | %-8.3f\n", k < PROF_STAGES ? prof_names[k] : (k == PROF_STAGES ? "frame" : "gpu"),
+            sum / m, s[m/2], s[(m*99)/100], s[m-1]);
+    }
+    free(s);
+}
+
+int profDump(const char* path)
+{
+    if(prof.on == 0){return 0;}
+    if(prof.gpu == 1){profCollect();}
+    FILE* f = fopen(path, "w");
+    if(f == NULL){printf("profile: could not open %s\n", path); return 0;}
+    fprintf(f, "frame,t");
+    for(int k = 0; k < PROF_STAGES; k++){fprintf(f, ",%s_ms", prof_names[k]);}
+    fprintf(f, ",frame_ms,gpu_ms\n");
+    const uint64_t first = prof.frame - prof.first > PROF_FRAMES ? prof.frame - PROF_FRAMES : prof.first;
+    for(uint64_t i = first; i < prof.frame; i++)
+    {
+        const ProfFrame* p = &prof.ring[i % PROF_FRAMES];
+        fprintf(f, "%lu,%.6f", (unsigned long)p->frame, p->t);
+        for(int k = 0; k < PROF_STAGES; k++){fprintf(f, ",%.4f", p->cpu[k]);}
+        fprintf(f, ",%.4f,", p->total);
+        if(p->gpu >= 0.f){fprintf(f, "%.4f", p->gpu);}
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    printf("profile: %lu frames to %s\n", (unsigned long)(prof.frame - first), path);
+    return 1;
+}
+
+void profFree()
+{
+    if(prof.on == 0){return;}
+    if(prof.gpu == 1){glDeleteQueries(PROF_QUERIES, &prof.query[0]);}
+    free(prof.ring);
+    memset(&prof, 0, sizeof(prof));
+}
+
+#endif
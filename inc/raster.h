@@ -0,0 +1,564 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Multithreaded CPU rasteriser for the Menger mesh.
+
+    Shades like esAux3.h Lambert1 (f1) and Phong1 (f2) per pixel, so it
+    takes the same float positions, flat normals, modelview, normalmat,
+    projection, light, colour and opacity as the GL path. Back faces are
+    culled, triangles are clipped to the near plane, depth is GL_LESS and
+    blending is GL_SRC_ALPHA, GL_ONE like main.c.
+
+    A frame runs in three phases on a pool of threads, all of which are
+    released together by one barrier per phase:
+        1. vertices are transformed, each thread takes a slice
+        2. triangles are set up and binned into RASTER_TILE square screen
+           tiles, each thread takes a slice into its own bins
+        3. tiles are claimed from an atomic counter and rasterised with
+           edge functions 8 pixels at a time, reading the bins of every
+           thread in order so the draw order is the submission order
+
+    The 8 wide span code is GCC vector extensions compiled twice, once for
+    AVX2 + FMA and once for the baseline (SSE2, or NEON / scalar with
+    NOSSE), picked at rasterInit() by CPUID.
+
+    Usage:
+        rasterInit(&r, threads);
+        rasterMesh(&r, vertices, normals, indices, numvert, numind);
+        rasterResize(&r, w, h);
+        rasterDraw(&r, &modelview, &normalmat, &projection, light, color, opacity, shading, blend);
+        r.color is w x h RGBA8 bottom up, a row is r.stride pixels
+        rasterFree(&r);
+
+    Requires a GL header and mat.h
+*/
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define RASTER_TILE 64
+#define RASTER_MAX_THREADS 64
+#define RASTER_LAMBERT 0
+#define RASTER_PHONG 1
+
+typedef float    rv8 __attribute__((vector_size(32)));
+typedef int32_t  ri8 __attribute__((vector_size(32)));
+typedef uint32_t ru8 __attribute__((vector_size(32)));
+
+typedef struct
+{
+    float ex[3], ey[3], ec[3];  // edge functions ex*x + ey*y + ec of x, y from x0, y0, inside when above et
+    float et[3];                // 0, or just below 0 for top-left edges
+    float zx, zy, zc;           // window depth plane
+    float wx, wy, wc;           // 1/w plane
+    float px[3], py[3], pc[3];  // view position / w planes
+    float n[3];                 // flat view space normal, normalised
+    int x0, y0, x1, y1;         // pixel bounds, exclusive max, x0, y0 is the origin of the planes
+} RasterTri;
+
+typedef struct
+{
+    uint32_t* idx;
+    uint32_t num, max;
+} RasterBin;
+
+typedef struct Raster Raster;
+struct Raster
+{
+    // mesh
+    const GLfloat* vertices;
+    const GLfloat* normals;
+    const GLuint* indices;
+    GLuint numvert, numind;
+
+    // frame
+    float mv[4][4], nm[4][4], proj[4][4];
+    float light[3], col[3], opacity;
+    int shading, blend;
+
+    // target, the stride is padded to whole tiles
+    GLuint w, h, stride, tw, th;
+    uint32_t* color;
+    float* depth;
+    uint32_t clear;
+
+    // transformed vertices, clip xyzw + view position xyz
+    float* clip;
+    float* view;
+    GLuint maxvert;
+
+    // per thread triangles and bins
+    RasterTri* tris[RASTER_MAX_THREADS];
+    uint32_t numtri[RASTER_MAX_THREADS], maxtri[RASTER_MAX_THREADS];
+    RasterBin* bins[RASTER_MAX_THREADS];
+
+    // pool, thread 0 is the caller of rasterDraw()
+    unsigned threads;
+    pthread_t pool[RASTER_MAX_THREADS];
+    pthread_barrier_t barrier;
+    atomic_uint tile;
+    atomic_int quit;
+    void (*rasterTile)(Raster*, const unsigned);
+};
+
+int  rasterInit(Raster* r, unsigned threads); // returns 0 on failure, threads 0 = one per core
+void rasterMesh(Raster* r, const GLfloat* vertices, const GLfloat* normals, const GLuint* indices, const GLuint numvert, const GLuint numind);
+int  rasterResize(Raster* r, const GLuint w, const GLuint h); // returns 0 on failure
+void rasterDraw(Raster* r, const mat* modelview, const mat* normalmat, const mat* projection, const float light[3], const float col[3], const float opacity, const int shading, const int blend);
+void rasterFree(Raster* r);
+
+//
+
+// the rv8 helpers are macros, passing or returning a 32 byte vector from the baseline
+// rasterTileBase() would be an AVX ABI change that GCC warns about (-Wpsabi)
+#define rvSplat(f) ({const float rvSplat_f = (f); (rv8){rvSplat_f, rvSplat_f, rvSplat_f, rvSplat_f, rvSplat_f, rvSplat_f, rvSplat_f, rvSplat_f};})
+#define rvRsqrt(x) ({const rv8 rvRsqrt_x = (x); rv8 rvRsqrt_r; for(int i = 0; i < 8; i++){rvRsqrt_r[i] = 1.f / sqrtf(rvRsqrt_x[i]);} rvRsqrt_r;})
+#define rvSel(m, a, b) ({const ri8 rvSel_m = (m); (rv8)(((ri8)(a) & rvSel_m) | ((ri8)(b) & ~rvSel_m));}) // m ? a : b, C has no vector ?:
+#define rvMax(a, b) ({const rv8 rvMax_a = (a), rvMax_b = (b); rvSel(rvMax_a > rvMax_b, rvMax_a, rvMax_b);})
+#define rvClamp01(a) ({const rv8 rvClamp01_a = (a), rvClamp01_z = rvSplat(0.f), rvClamp01_o = rvSplat(1.f); \
+    rvSel(rvClamp01_a < rvClamp01_z, rvClamp01_z, rvSel(rvClamp01_a > rvClamp01_o, rvClamp01_o, rvClamp01_a));})
+
+static inline __attribute__((always_inline)) void rasterSpan(Raster* r, const RasterTri* t, const int x, const int y, const int xe)
+{
+    // 8 pixel centres of row y from x, lanes at or past xe are masked off
+    const rv8 lane = {0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f};
+    const rv8 px = lane + rvSplat((float)(x - t->x0) + 0.5f);
+    const float py = (float)(y - t->y0) + 0.5f;
+
+    ri8 in = (lane < rvSplat((float)(xe - x)));
+    for(int i = 0; i < 3; i++)
+        in &= (rvSplat(t->ex[i]) * px + rvSplat(t->ey[i] * py + t->ec[i])) > rvSplat(t->et[i]);
+    if((in[0]|in[1]|in[2]|in[3]|in[4]|in[5]|in[6]|in[7]) == 0){return;}
+
+    const uint32_t o = y * r->stride + x;
+    rv8 dz;
+    memcpy(&dz, &r->depth[o], sizeof(rv8));
+    const rv8 z = rvSplat(t->zx) * px + rvSplat(t->zy * py + t->zc);
+    in &= (z < dz) & (z <= rvSplat(1.f));
+    if((in[0]|in[1]|in[2]|in[3]|in[4]|in[5]|in[6]|in[7]) == 0){return;}
+    dz = rvSel(in, z, dz);
+    memcpy(&r->depth[o], &dz, sizeof(rv8));
+
+    // perspective correct view position
+    const rv8 w = rvSplat(1.f) / (rvSplat(t->wx) * px + rvSplat(t->wy * py + t->wc));
+    const rv8 vx = (rvSplat(t->px[0]) * px + rvSplat(t->py[0] * py + t->pc[0])) * w;
+    const rv8 vy = (rvSplat(t->px[1]) * px + rvSplat(t->py[1] * py + t->pc[1])) * w;
+    const rv8 vz = (rvSplat(t->px[2]) * px + rvSplat(t->py[2] * py + t->pc[2])) * w;
+
+    // lightDir = normalize(vlightPos - vertPos)
+    rv8 lx = rvSplat(r->light[0]) - vx, ly = rvSplat(r->light[1]) - vy, lz = rvSplat(r->light[2]) - vz;
+    const rv8 li = rvRsqrt(lx*lx + ly*ly + lz*lz);
+    lx *= li, ly *= li, lz *= li;
+    const rv8 nx = rvSplat(t->n[0]), ny = rvSplat(t->n[1]), nz = rvSplat(t->n[2]);
+    const rv8 ndl = lx*nx + ly*ny + lz*nz;
+
+    rv8 cr, cg, cb;
+    if(r->shading == RASTER_LAMBERT)
+    {
+        // f1
+        const rv8 lam = rvMax(ndl, rvSplat(0.f));
+        cr = rvSplat(r->col[0] * 0.148f) + lam * rvSplat(r->col[0]);
+        cg = rvSplat(r->col[1] * 0.148f) + lam * rvSplat(r->col[1]);
+        cb = rvSplat(r->col[2] * 0.148f) + lam * rvSplat(r->col[2]);
+    }
+    else
+    {
+        // f2
+        rv8 ex = -vx, ey = -vy, ez = -vz;
+        const rv8 ei = rvRsqrt(ex*ex + ey*ey + ez*ez);
+        ex *= ei, ey *= ei, ez *= ei;
+#ifdef REGULAR_PHONG
+        const rv8 rx = rvSplat(2.f)*ndl*nx - lx, ry = rvSplat(2.f)*ndl*ny - ly, rz = rvSplat(2.f)*ndl*nz - lz;
+        const rv8 sa = rvMax(rx*ex + ry*ey + rz*ez, rvSplat(0.f));
+#else
+        rv8 hx = ex + lx, hy = ey + ly, hz = ez + lz;
+        const rv8 hi = rvRsqrt(hx*hx + hy*hy + hz*hz);
+        hx *= hi, hy *= hi, hz *= hi;
+        const rv8 sa = rvMax(hx*nx + hy*ny + hz*nz, rvSplat(0.f));
+#endif
+        const rv8 sa2 = sa*sa;
+        const rv8 spec = rvSel(ndl > rvSplat(0.f), sa2*sa2, rvSplat(0.f)); // pow(specAngle, 4.0)
+        cr = rvSplat(r->col[0] * 0.14f) + rvMax((rvSplat(r->col[0]) + spec) * ndl, rvSplat(0.f));
+        cg = rvSplat(r->col[1] * 0.14f) + rvMax((rvSplat(r->col[1]) + spec) * ndl, rvSplat(0.f));
+        cb = rvSplat(r->col[2] * 0.14f) + rvMax((rvSplat(r->col[2]) + spec) * ndl, rvSplat(0.f));
+    }
+
+    // a fixed point target clamps the fragment before blending
+    ru8 dc;
+    memcpy(&dc, &r->color[o], sizeof(ru8));
+    rv8 ca = rvClamp01(rvSplat(r->opacity));
+    cr = rvClamp01(cr), cg = rvClamp01(cg), cb = rvClamp01(cb);
+    if(r->blend == 1)
+    {
+        // GL_SRC_ALPHA, GL_ONE
+        const rv8 s = rvSplat(1.f/255.f);
+        cr = cr * ca + __builtin_convertvector(dc & 0xff, rv8) * s;
+        cg = cg * ca + __builtin_convertvector((dc >> 8) & 0xff, rv8) * s;
+        cb = cb * ca + __builtin_convertvector((dc >> 16) & 0xff, rv8) * s;
+        ca = ca * ca + __builtin_convertvector(dc >> 24, rv8) * s;
+    }
+    const rv8 h = rvSplat(0.5f), f = rvSplat(255.f);
+    const ru8 pr = __builtin_convertvector(rvClamp01(cr) * f + h, ru8);
+    const ru8 pg = __builtin_convertvector(rvClamp01(cg) * f + h, ru8);
+    const ru8 pb = __builtin_convertvector(rvClamp01(cb) * f + h, ru8);
+    const ru8 pa = __builtin_convertvector(rvClamp01(ca) * f + h, ru8);
+    dc = (ru8)(((ri8)(pr | (pg << 8) | (pb << 16) | (pa << 24)) & in) | ((ri8)dc & ~in));
+    memcpy(&r->color[o], &dc, sizeof(ru8));
+}
+
+static inline __attribute__((always_inline)) void rasterTileKernel(Raster* r, const unsigned tile)
+{
+    const int tx0 = (tile % r->tw) * RASTER_TILE, ty0 = (tile / r->tw) * RASTER_TILE;
+    const int tx1 = tx0 + RASTER_TILE, ty1 = ty0 + RASTER_TILE;
+
+    for(int y = ty0; y < ty1; y++)
+    {
+        const uint32_t o = y * r->stride + tx0;
+        for(int x = 0; x < RASTER_TILE; x++)
+        {
+            r->color[o+x] = r->clear;
+            r->depth[o+x] = 1.f;
+        }
+    }
+
+    for(unsigned k = 0; k < r->threads; k++)
+    {
+        const RasterBin* b = &r->bins[k][tile];
+        for(uint32_t i = 0; i < b->num; i++)
+        {
+            const RasterTri* t = &r->tris[k][b->idx[i]];
+            const int x0 = t->x0 > tx0 ? t->x0 & ~7 : tx0; // spans stay 8 aligned, tiles are multiples of 8
+            const int x1 = t->x1 < tx1 ? t->x1 : tx1;
+            const int y0 = t->y0 > ty0 ? t->y0 : ty0;
+            const int y1 = t->y1 < ty1 ? t->y1 : ty1;
+            for(int y = y0; y < y1; y++)
+                for(int x = x0; x < x1; x += 8)
+                    rasterSpan(r, t, x, y, x1);
+        }
+    }
+}
+
+#ifndef NOSSE
+__attribute__((target("avx2,fma"))) void rasterTileAVX2(Raster* r, const unsigned tile)
+{
+    rasterTileKernel(r, tile);
+}
+#endif
+
+void rasterTileBase(Raster* r, const unsigned tile)
+{
+    rasterTileKernel(r, tile);
+}
+
+void rasterEmit(Raster* r, const unsigned tid, const float* c[3], const float* v[3], const float n[3])
+{
+    // window coordinates, y up like GL
+    float sx[3], sy[3], sz[3], iw[3];
+    for(int i = 0; i < 3; i++)
+    {
+        iw[i] = 1.f / c[i][3];
+        sx[i] = (c[i][0] * iw[i] * 0.5f + 0.5f) * (float)r->w;
+        sy[i] = (c[i][1] * iw[i] * 0.5f + 0.5f) * (float)r->h;
+        sz[i] = c[i][2] * iw[i] * 0.5f + 0.5f;
+    }
+
+    // counter clockwise is front facing
+    const float area = (sx[1]-sx[0])*(sy[2]-sy[0]) - (sx[2]-sx[0])*(sy[1]-sy[0]);
+    if(area <= 0.f){return;}
+
+    float fx0 = sx[0], fx1 = sx[0], fy0 = sy[0], fy1 = sy[0];
+    for(int i = 1; i < 3; i++)
+    {
+        if(sx[i] < fx0){fx0 = sx[i];} if(sx[i] > fx1){fx1 = sx[i];}
+        if(sy[i] < fy0){fy0 = sy[i];} if(sy[i] > fy1){fy1 = sy[i];}
+    }
+    int x0 = (int)floorf(fx0), y0 = (int)floorf(fy0), x1 = (int)ceilf(fx1) + 1, y1 = (int)ceilf(fy1) + 1;
+    if(x0 < 0){x0 = 0;} if(y0 < 0){y0 = 0;}
+    if(x1 > (int)r->w){x1 = r->w;} if(y1 > (int)r->h){y1 = r->h;}
+    if(x0 >= x1 || y0 >= y1){return;}
+
+    // planes about the corner of the bounds, at the screen origin the constants cancel to depth noise
+    for(int i = 0; i < 3; i++){sx[i] -= (float)x0, sy[i] -= (float)y0;}
+
+    if(r->numtri[tid] == r->maxtri[tid])
+    {
+        const uint32_t nm = r->maxtri[tid] == 0 ? 4096 : r->maxtri[tid] * 2;
+        RasterTri* nt = realloc(r->tris[tid], nm * sizeof(RasterTri));
+        if(nt == NULL){return;}
+        r->tris[tid] = nt, r->maxtri[tid] = nm;
+    }
+    RasterTri* t = &r->tris[tid][r->numtri[tid]];
+
+    // edge i is opposite vertex i, its value over the area is the barycentric of vertex i
+    const float ra = 1.f / area;
+    for(int i = 0; i < 3; i++)
+    {
+        const int a = (i+1)%3, b = (i+2)%3;
+        const float dx = sx[b] - sx[a], dy = sy[b] - sy[a];
+        t->ex[i] = -dy;
+        t->ey[i] = dx;
+        t->ec[i] = dy*sx[a] - dx*sy[a];
+        t->et[i] = (dy < 0.f || (dy == 0.f && dx < 0.f)) ? -1e-30f : 0.f; // top-left rule, shared edges draw once
+    }
+
+    // planes of values interpolated linearly in screen space
+    #define RASTER_PLANE(q0, q1, q2, qx, qy, qc) \
+        qx = (t->ex[0]*(q0) + t->ex[1]*(q1) + t->ex[2]*(q2)) * ra; \
+        qy = (t->ey[0]*(q0) + t->ey[1]*(q1) + t->ey[2]*(q2)) * ra; \
+        qc = (t->ec[0]*(q0) + t->ec[1]*(q1) + t->ec[2]*(q2)) * ra;
+    RASTER_PLANE(sz[0], sz[1], sz[2], t->zx, t->zy, t->zc)
+    RASTER_PLANE(iw[0], iw[1], iw[2], t->wx, t->wy, t->wc)
+    for(int j = 0; j < 3; j++)
+    {
+        RASTER_PLANE(v[0][j]*iw[0], v[1][j]*iw[1], v[2][j]*iw[2], t->px[j], t->py[j], t->pc[j])
+    }
+    #undef RASTER_PLANE
+
+    memcpy(t->n, n, sizeof(float)*3);
+    t->x0 = x0, t->y0 = y0, t->x1 = x1, t->y1 = y1;
+
+    // bin
+    for(int ty = y0 / RASTER_TILE; ty <= (y1-1) / RASTER_TILE; ty++)
+    {
+        for(int tx = x0 / RASTER_TILE; tx <= (x1-1) / RASTER_TILE; tx++)
+        {
+            RasterBin* b = &r->bins[tid][ty * r->tw + tx];
+            if(b->num == b->max)
+            {
+                const uint32_t nm = b->max == 0 ? 256 : b->max * 2;
+                uint32_t* ni = realloc(b->idx, nm * sizeof(uint32_t));
+                if(ni == NULL){continue;}
+                b->idx = ni, b->max = nm;
+            }
+            b->idx[b->num++] = r->numtri[tid];
+        }
+    }
+    r->numtri[tid]++;
+}
+
+void rasterSetup(Raster* r, const unsigned tid, const GLuint tri)
+{
+    const GLuint* ip = &r->indices[tri*3];
+    const float* c[3] = {&r->clip[ip[0]*4], &r->clip[ip[1]*4], &r->clip[ip[2]*4]};
+    const float* v[3] = {&r->view[ip[0]*3], &r->view[ip[1]*3], &r->view[ip[2]*3]};
+
+    // trivially outside one clip plane
+    for(int j = 0; j < 3; j++)
+    {
+        if(c[0][j] > c[0][3] && c[1][j] > c[1][3] && c[2][j] > c[2][3]){return;}
+        if(c[0][j] < -c[0][3] && c[1][j] < -c[1][3] && c[2][j] < -c[2][3]){return;}
+    }
+
+    // flat normal, Lambert1 uses the modelview and Phong1 the normal matrix
+    const GLfloat* on = &r->normals[ip[0]*3];
+    const float (*m)[4] = r->shading == RASTER_LAMBERT ? r->mv : r->nm;
+    float n[3];
+    for(int j = 0; j < 3; j++){n[j] = m[0][j]*on[0] + m[1][j]*on[1] + m[2][j]*on[2];}
+    const float nl = 1.f / sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    n[0] *= nl, n[1] *= nl, n[2] *= nl;
+
+    // near plane z >= -w, clipping one corner off makes a quad
+    const float d[3] = {c[0][2] + c[0][3], c[1][2] + c[1][3], c[2][2] + c[2][3]};
+    if(d[0] >= 0.f && d[1] >= 0.f && d[2] >= 0.f)
+    {
+        rasterEmit(r, tid, c, v, n);
+        return;
+    }
+    float pc[4][4], pv[4][3];
+    int np = 0;
+    for(int i = 0; i < 3; i++)
+    {
+        const int k = (i+1)%3;
+        if(d[i] >= 0.f)
+        {
+            memcpy(pc[np], c[i], sizeof(float)*4);
+            memcpy(pv[np], v[i], sizeof(float)*3);
+            np++;
+        }
+        if((d[i] >= 0.f) != (d[k] >= 0.f))
+        {
+            const float s = d[i] / (d[i] - d[k]);
+            for(int j = 0; j < 4; j++){pc[np][j] = c[i][j] + (c[k][j] - c[i][j]) * s;}
+            for(int j = 0; j < 3; j++){pv[np][j] = v[i][j] + (v[k][j] - v[i][j]) * s;}
+            np++;
+        }
+    }
+    for(int i = 1; i+1 < np; i++)
+    {
+        const float* fc[3] = {pc[0], pc[i], pc[i+1]};
+        const float* fv[3] = {pv[0], pv[i], pv[i+1]};
+        rasterEmit(r, tid, fc, fv, n);
+    }
+}
+
+void rasterWork(Raster* r, const unsigned tid)
+{
+    // 1. transform a slice of the vertices
+    const GLuint v0 = (GLuint)((uint64_t)r->numvert * tid / r->threads);
+    const GLuint v1 = (GLuint)((uint64_t)r->numvert * (tid+1) / r->threads);
+    for(GLuint i = v0; i < v1; i++)
+    {
+        const GLfloat* p = &r->vertices[i*3];
+        float e[4];
+        for(int j = 0; j < 4; j++)
+            e[j] = r->mv[0][j]*p[0] + r->mv[1][j]*p[1] + r->mv[2][j]*p[2] + r->mv[3][j];
+        float* c = &r->clip[i*4];
+        for(int j = 0; j < 4; j++)
+            c[j] = r->proj[0][j]*e[0] + r->proj[1][j]*e[1] + r->proj[2][j]*e[2] + r->proj[3][j]*e[3];
+        float* v = &r->view[i*3];
+        const float rw = 1.f / e[3]; // vertPos = vertPos4.xyz / vertPos4.w
+        v[0] = e[0]*rw, v[1] = e[1]*rw, v[2] = e[2]*rw;
+    }
+    pthread_barrier_wait(&r->barrier);
+
+    // 2. set up and bin a slice of the triangles
+    r->numtri[tid] = 0;
+    for(unsigned i = 0; i < r->tw * r->th; i++){r->bins[tid][i].num = 0;}
+    const GLuint numtri = r->numind / 3;
+    const GLuint t0 = (GLuint)((uint64_t)numtri * tid / r->threads);
+    const GLuint t1 = (GLuint)((uint64_t)numtri * (tid+1) / r->threads);
+    for(GLuint i = t0; i < t1; i++)
+        rasterSetup(r, tid, i);
+    pthread_barrier_wait(&r->barrier);
+
+    // 3. rasterise tiles until there are none left
+    const unsigned nt = r->tw * r->th;
+    unsigned tile;
+    while((tile = atomic_fetch_add(&r->tile, 1)) < nt)
+        r->rasterTile(r, tile);
+}
+
+void* rasterThread(void* arg)
+{
+    Raster* r = ((void**)arg)[0];
+    const unsigned tid = (unsigned)(uintptr_t)((void**)arg)[1];
+    free(arg);
+    while(1)
+    {
+        pthread_barrier_wait(&r->barrier); // go
+        if(atomic_load(&r->quit) == 1){break;}
+        rasterWork(r, tid);
+        pthread_barrier_wait(&r->barrier); // done
+    }
+    return NULL;
+}
+
+int rasterInit(Raster* r, unsigned threads)
+{
+    memset(r, 0, sizeof(Raster));
+    if(threads == 0){threads = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);}
+    if(threads < 1){threads = 1;}
+    if(threads > RASTER_MAX_THREADS){threads = RASTER_MAX_THREADS;}
+    r->threads = threads;
+    r->clear = 0x00212121; // glClearColor(0.13f, 0.13f, 0.13f, 0.0f)
+
+    r->rasterTile = rasterTileBase;
+#ifndef NOSSE
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){r->rasterTile = rasterTileAVX2;}
+#endif
+
+    if(pthread_barrier_init(&r->barrier, NULL, threads) != 0){return 0;}
+    for(unsigned i = 1; i < threads; i++)
+    {
+        void** arg = malloc(sizeof(void*) * 2);
+        if(arg == NULL){return 0;}
+        arg[0] = r, arg[1] = (void*)(uintptr_t)i;
+        if(pthread_create(&r->pool[i], NULL, rasterThread, arg) != 0){free(arg); return 0;}
+    }
+    return 1;
+}
+
+void rasterMesh(Raster* r, const GLfloat* vertices, const GLfloat* normals, const GLuint* indices, const GLuint numvert, const GLuint numind)
+{
+    r->vertices = vertices, r->normals = normals, r->indices = indices;
+    r->numvert = numvert, r->numind = numind;
+}
+
+int rasterResize(Raster* r, const GLuint w, const GLuint h)
+{
+    // only call between frames, the workers are parked on the barrier
+    for(unsigned k = 0; k < r->threads; k++)
+    {
+        if(r->bins[k] == NULL){continue;}
+        for(unsigned i = 0; i < r->tw * r->th; i++){free(r->bins[k][i].idx);}
+        free(r->bins[k]);
+        r->bins[k] = NULL;
+    }
+    free(r->color);
+    free(r->depth);
+    r->w = w, r->h = h;
+    r->tw = (w + RASTER_TILE - 1) / RASTER_TILE;
+    r->th = (h + RASTER_TILE - 1) / RASTER_TILE;
+    r->stride = r->tw * RASTER_TILE;
+    r->color = malloc(r->stride * r->th * RASTER_TILE * sizeof(uint32_t));
+    r->depth = malloc(r->stride * r->th * RASTER_TILE * sizeof(float));
+    if(r->color == NULL || r->depth == NULL){return 0;}
+    for(unsigned k = 0; k < r->threads; k++)
+    {
+        r->bins[k] = calloc(r->tw * r->th, sizeof(RasterBin));
+        if(r->bins[k] == NULL){return 0;}
+    }
+    return 1;
+}
+
+void rasterDraw(Raster* r, const mat* modelview, const mat* normalmat, const mat* projection, const float light[3], const float col[3], const float opacity, const int shading, const int blend)
+{
+    if(r->numvert > r->maxvert)
+    {
+        free(r->clip);
+        free(r->view);
+        r->clip = malloc(r->numvert * 4 * sizeof(float));
+        r->view = malloc(r->numvert * 3 * sizeof(float));
+        if(r->clip == NULL || r->view == NULL){r->maxvert = 0; return;}
+        r->maxvert = r->numvert;
+    }
+    memcpy(r->mv, modelview->m, sizeof(r->mv));
+    memcpy(r->nm, normalmat->m, sizeof(r->nm));
+    memcpy(r->proj, projection->m, sizeof(r->proj));
+    memcpy(r->light, light, sizeof(r->light));
+    memcpy(r->col, col, sizeof(r->col));
+    r->opacity = opacity;
+    r->shading = shading;
+    r->blend = blend;
+    atomic_store(&r->tile, 0);
+
+    if(r->threads > 1){pthread_barrier_wait(&r->barrier);} // go
+    rasterWork(r, 0);
+    if(r->threads > 1){pthread_barrier_wait(&r->barrier);} // done
+}
+
+void rasterFree(Raster* r)
+{
+    atomic_store(&r->quit, 1);
+    if(r->threads > 1)
+    {
+        pthread_barrier_wait(&r->barrier);
+        for(unsigned i = 1; i < r->threads; i++){pthread_join(r->pool[i], NULL);}
+    }
+    pthread_barrier_destroy(&r->barrier);
+    for(unsigned k = 0; k < r->threads; k++)
+    {
+        free(r->tris[k]);
+        if(r->bins[k] == NULL){continue;}
+        for(unsigned i = 0; i < r->tw * r->th; i++){free(r->bins[k][i].idx);}
+        free(r->bins[k]);
+    }
+    free(r->color);
+    free(r->depth);
+    free(r->clip);
+    free(r->view);
+    memset(r, 0, sizeof(Raster));
+}
+
+#endif
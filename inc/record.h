@@ -0,0 +1,514 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Frame capture through a ring of pixel buffer objects.
+
+    Every frame is read back into the next free PBO with glReadPixels(),
+    which only queues a copy, and a fence is placed behind it. Later frames
+    poll the fences of the copies in flight without waiting, a signalled
+    buffer is mapped and handed to a worker thread that converts it and
+    writes it out. The worker marks it done and the render thread unmaps
+    it for reuse. So the render loop never waits on the GPU or the disk,
+    and with no GL_ARB_sync a copy is taken to be ready two frames after
+    it was issued.
+
+    When the ring is full the frame is not captured, the next captured
+    frame writes the previous one again for every frame missed so the
+    stream keeps the frame rate. Unless it is lossless, then the render
+    thread waits for the worker and every frame is its own.
+
+    With trace.h included first the worker traces its convert and write.
+
+    Outputs:
+        *.y4m - YUV4MPEG2 4:2:0, BT.601 limited range, converted 8 pixels
+                at a time, AVX2 or baseline picked by CPUID like raster.h
+        -     - raw top down rgb24 to stdout, console output goes to
+                stderr, e.g; | ffmpeg -f rawvideo -pix_fmt rgb24 -s 1920x1080 -r 144 -i - out.mp4
+        *%*   - an image sequence, the path is a printf() pattern of the
+                frame number, e.g; frames/%05u.ppm, PPM or with .png an
+                uncompressed PNG (stored deflate, no zlib needed)
+        other - raw top down rgb24 to that file
+
+    Usage:
+        recordOpen(&rec, path, lossless);   // before any console output if path is -
+        recordStart(&rec, w, h, fps);       // with the GL context current
+        recordFrame(&rec);                  // after each draw, before the swap
+        recordClose(&rec);                  // drains the ring, prints stats
+*/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define RECORD_RING 4
+
+#define RECORD_RGB 0
+#define RECORD_Y4M 1
+#define RECORD_PPM 2
+#define RECORD_PNG 3
+
+#define RECORD_FREE 0
+#define RECORD_READING 1
+#define RECORD_MAPPED 2
+#define RECORD_DONE 3
+
+typedef struct
+{
+    GLuint pbo;
+    GLsync fence;
+    uint64_t frame;         // issue order
+    uint32_t repeat;        // frames missed before this one, written as the previous frame
+    const uint8_t* pixels;  // while mapped
+    atomic_int state;
+} RecordSlot;
+
+typedef struct
+{
+    FILE* f;
+    int kind;
+    char pattern[256];      // image sequences
+    int lossless;           // wait rather than miss frames
+    GLuint w, h;
+    RecordSlot slot[RECORD_RING];
+    uint64_t issued, mapped, unmapped, written; // ring counters, slot = counter % RECORD_RING
+    uint32_t owed;          // frames missed since the last capture
+    uint64_t missed;
+    uint64_t frames;        // output frames, repeats included
+    int fences;
+    uint8_t* out;           // the converted frame, kept to repeat
+    size_t outsize;
+    double convert;         // worker seconds spent converting
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int quit;
+    void (*yuv)(const uint8_t*, uint8_t*, const GLuint, const GLuint);
+} Recorder;
+
+int  recordOpen(Recorder* rec, const char* path, const int lossless); // returns 0 on failure
+int  recordStart(Recorder* rec, const GLuint w, const GLuint h, const double fps); // returns 0 on failure
+void recordFrame(Recorder* rec);
+void recordClose(Recorder* rec);
+
+//
+
+typedef int32_t rci8 __attribute__((vector_size(32)));
+typedef uint8_t rcb8 __attribute__((vector_size(8)));
+
+static inline __attribute__((always_inline)) void recordYUVKernel(const uint8_t* rgba, uint8_t* yuv, const GLuint w, const GLuint h)
+{
+    // rgba is bottom up, the output planes top down, chroma is the 2x2 average
+    const GLuint cw = (w+1)/2, ch = (h+1)/2;
+    uint8_t* py = yuv;
+    uint8_t* pu = yuv + w*h;
+    uint8_t* pv = pu + cw*ch;
+    for(GLuint y = 0; y < h; y += 2)
+    {
+        const uint32_t* r0 = (const uint32_t*)rgba + (h-1-y) * w;
+        const uint32_t* r1 = y+1 < h ? r0 - w : r0;
+        uint8_t* y0 = py + y*w;
+        uint8_t* y1 = y+1 < h ? y0 + w : y0;
+        uint8_t* u = pu + (y/2)*cw;
+        uint8_t* v = pv + (y/2)*cw;
+        GLuint x = 0;
+        for(; x+8 <= w; x += 8)
+        {
+            rci8 a, b;
+            memcpy(&a, &r0[x], sizeof(rci8));
+            memcpy(&b, &r1[x], sizeof(rci8));
+            const rci8 ar = a & 0xff, ag = (a >> 8) & 0xff, ab = (a >> 16) & 0xff;
+            const rci8 br = b & 0xff, bg = (b >> 8) & 0xff, bb = (b >> 16) & 0xff;
+            const rci8 ya = ((66*ar + 129*ag + 25*ab + 128) >> 8) + 16;
+            const rci8 yb = ((66*br + 129*bg + 25*bb + 128) >> 8) + 16;
+            const rcb8 na = __builtin_convertvector(ya, rcb8), nb = __builtin_convertvector(yb, rcb8);
+            memcpy(&y0[x], &na, 8);
+            memcpy(&y1[x], &nb, 8);
+
+            // the chroma weights are linear, so weight the column sums and add the pairs
+            const rci8 sr = ar + br, sg = ag + bg, sb = ab + bb;
+            const rci8 cu = -38*sr - 74*sg + 112*sb;
+            const rci8 cv = 112*sr - 94*sg - 18*sb;
+            for(int i = 0; i < 4; i++)
+            {
+                u[x/2+i] = (uint8_t)(((cu[i*2] + cu[i*2+1] + 512) >> 10) + 128);
+                v[x/2+i] = (uint8_t)(((cv[i*2] + cv[i*2+1] + 512) >> 10) + 128);
+            }
+        }
+        for(; x < w; x += 2)
+        {
+            const GLuint x1 = x+1 < w ? x+1 : x;
+            const uint32_t p[4] = {r0[x], r0[x1], r1[x], r1[x1]};
+            int sr = 0, sg = 0, sb = 0;
+            for(int i = 0; i < 4; i++)
+            {
+                const int pr = p[i] & 0xff, pg = (p[i] >> 8) & 0xff, pb = (p[i] >> 16) & 0xff;
+                sr += pr, sg += pg, sb += pb;
+                const uint8_t yy = (uint8_t)(((66*pr + 129*pg + 25*pb + 128) >> 8) + 16);
+                if(i == 0){y0[x] = yy;} else if(i == 1){y0[x1] = yy;} else if(i == 2){y1[x] = yy;} else{y1[x1] = yy;}
+            }
+            u[x/2] = (uint8_t)(((-38*sr - 74*sg + 112*sb + 512) >> 10) + 128);
+            v[x/2] = (uint8_t)(((112*sr - 94*sg - 18*sb + 512) >> 10) + 128);
+        }
+    }
+}
+
+#ifndef NOSSE
+__attribute__((target("avx2"))) void recordYUVAVX2(const uint8_t* rgba, uint8_t* yuv, const GLuint w, const GLuint h)
+{
+    recordYUVKernel(rgba, yuv, w, h);
+}
+#endif
+
+void recordYUVBase(const uint8_t* rgba, uint8_t* yuv, const GLuint w, const GLuint h)
+{
+    recordYUVKernel(rgba, yuv, w, h);
+}
+
+void recordRGB(const uint8_t* rgba, uint8_t* rgb, const GLuint w, const GLuint h)
+{
+    for(GLuint y = 0; y < h; y++)
+    {
+        const uint8_t* s = rgba + (h-1-y) * w * 4;
+        uint8_t* d = rgb + y * w * 3;
+        for(GLuint x = 0; x < w; x++, s += 4, d += 3){d[0] = s[0], d[1] = s[1], d[2] = s[2];}
+    }
+}
+
+uint32_t record_crc[256];
+
+void recordPut(FILE* f, uint32_t* crc, const void* data, const size_t len)
+{
+    const uint8_t* p = data;
+    for(size_t i = 0; i < len; i++){*crc = record_crc[(*crc ^ p[i]) & 0xff] ^ (*crc >> 8);}
+    fwrite(data, 1, len, f);
+}
+
+void recordPutBE(FILE* f, uint32_t* crc, const uint32_t v)
+{
+    const uint8_t b[4] = {v >> 24, v >> 16, v >> 8, v};
+    recordPut(f, crc, b, 4);
+}
+
+typedef struct
+{
+    uint32_t raw, done, left; // deflate input bytes, bytes out, left in this block
+    uint32_t a, b;            // adler32
+} RecordStored;
+
+void recordStored(FILE* f, uint32_t* crc, RecordStored* st, const uint8_t* data, uint32_t len)
+{
+    // stored deflate blocks of at most 65535 bytes, a block header whenever one is full
+    while(len > 0)
+    {
+        if(st->left == 0)
+        {
+            st->left = st->raw - st->done < 65535 ? st->raw - st->done : 65535;
+            const uint8_t bh[5] = {st->done + st->left == st->raw, st->left, st->left >> 8, ~st->left, ~st->left >> 8};
+            recordPut(f, crc, bh, 5);
+        }
+        const uint32_t n = len < st->left ? len : st->left;
+        recordPut(f, crc, data, n);
+        for(uint32_t k = 0; k < n; k += 5552) // the most bytes before the adler32 sums can overflow
+        {
+            const uint32_t e = k + 5552 < n ? k + 5552 : n;
+            for(uint32_t q = k; q < e; q++){st->a += data[q], st->b += st->a;}
+            st->a %= 65521, st->b %= 65521;
+        }
+        st->done += n, st->left -= n, data += n, len -= n;
+    }
+}
+
+void recordPNG(FILE* f, const uint8_t* rgb, const GLuint w, const GLuint h)
+{
+    // one IDAT of stored deflate, each row is a 0 filter byte and the pixels
+    RecordStored st = {h * (w*3 + 1), 0, 0, 1, 0};
+    const uint32_t blocks = (st.raw + 65534) / 65535;
+    uint32_t crc = 0;
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, f);
+    recordPutBE(f, &crc, 13);
+    crc = 0xffffffff;
+    recordPut(f, &crc, "IHDR", 4);
+    recordPutBE(f, &crc, w);
+    recordPutBE(f, &crc, h);
+    recordPut(f, &crc, "\x08\x02\x00\x00\x00", 5); // 8 bit RGB
+    recordPutBE(f, &crc, ~crc);
+
+    recordPutBE(f, &crc, 2 + st.raw + blocks*5 + 4);
+    crc = 0xffffffff;
+    recordPut(f, &crc, "IDAT", 4);
+    recordPut(f, &crc, "\x78\x01", 2);
+    const uint8_t filter = 0;
+    for(GLuint y = 0; y < h; y++)
+    {
+        recordStored(f, &crc, &st, &filter, 1);
+        recordStored(f, &crc, &st, &rgb[y*w*3], w*3);
+    }
+    recordPutBE(f, &crc, (st.b << 16) | st.a);
+    recordPutBE(f, &crc, ~crc);
+
+    recordPutBE(f, &crc, 0);
+    crc = 0xffffffff;
+    recordPut(f, &crc, "IEND", 4);
+    recordPutBE(f, &crc, ~crc);
+}
+
+void recordEmit(Recorder* rec)
+{
+    // the converted frame as the next frame of the output
+    if(rec->kind == RECORD_PPM || rec->kind == RECORD_PNG)
+    {
+        char name[512];
+        snprintf(name, sizeof(name), rec->pattern, (unsigned)rec->frames);
+        FILE* f = fopen(name, "wb");
+        if(f == NULL){printf("record: could not open %s\n", name);}
+        else
+        {
+            if(rec->kind == RECORD_PNG)
+                recordPNG(f, rec->out, rec->w, rec->h);
+            else
+            {
+                fprintf(f, "P6\n%u %u\n255\n", rec->w, rec->h);
+                fwrite(rec->out, 1, rec->outsize, f);
+            }
+            fclose(f);
+        }
+    }
+    else
+    {
+        if(rec->kind == RECORD_Y4M){fputs("FRAME\n", rec->f);}
+        fwrite(rec->out, 1, rec->outsize, rec->f);
+    }
+    rec->frames++;
+}
+
+void* recordWorker(void* arg)
+{
+    Recorder* rec = arg;
+#ifdef TRACE_H
+    traceThread("record");
+#endif
+    while(1)
+    {
+        RecordSlot* s = &rec->slot[rec->written % RECORD_RING];
+        pthread_mutex_lock(&rec->lock);
+        while(atomic_load(&s->state) != RECORD_MAPPED && rec->quit == 0)
+            pthread_cond_wait(&rec->cond, &rec->lock);
+        const int quit = atomic_load(&s->state) != RECORD_MAPPED;
+        pthread_mutex_unlock(&rec->lock);
+        if(quit == 1){break;}
+
+        // missed frames repeat the last one out
+        for(uint32_t i = 0; i < s->repeat && rec->written > 0; i++)
+            recordEmit(rec);
+
+#ifdef TRACE_H
+        traceBegin("convert");
+#endif
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if(rec->kind == RECORD_Y4M)
+            rec->yuv(s->pixels, rec->out, rec->w, rec->h);
+        else
+            recordRGB(s->pixels, rec->out, rec->w, rec->h);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        rec->convert += (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+        atomic_store(&s->state, RECORD_DONE); // the pixels are no longer read
+#ifdef TRACE_H
+        traceEnd();
+        traceBegin("write");
+#endif
+
+        recordEmit(rec);
+        rec->written++;
+#ifdef TRACE_H
+        traceEndArg("frame", (int64_t)rec->frames - 1);
+#endif
+    }
+    return NULL;
+}
+
+int recordOpen(Recorder* rec, const char* path, const int lossless)
+{
+    memset(rec, 0, sizeof(Recorder));
+    rec->lossless = lossless;
+    const size_t len = strlen(path);
+    if(strchr(path, '%') != NULL)
+    {
+        // files are opened per frame by the worker
+        if(len >= sizeof(rec->pattern)){printf("record: pattern too long.\n"); return 0;}
+        strcpy(rec->pattern, path);
+        rec->kind = len > 4 && strcmp(path + len - 4, ".png") == 0 ? RECORD_PNG : RECORD_PPM;
+        return 1;
+    }
+    if(strcmp(path, "-") == 0)
+    {
+        // the stream keeps the real stdout, printf() moves to stderr
+        fflush(stdout);
+        const int fd = dup(STDOUT_FILENO);
+        if(fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1){printf("record: could not take stdout.\n"); return 0;}
+        rec->f = fdopen(fd, "wb");
+    }
+    else
+    {
+        rec->kind = len > 4 && strcmp(path + len - 4, ".y4m") == 0 ? RECORD_Y4M : RECORD_RGB;
+        rec->f = fopen(path, "wb");
+    }
+    if(rec->f == NULL){printf("record: could not open %s\n", path); return 0;}
+    setvbuf(rec->f, NULL, _IOFBF, 1 << 20);
+    return 1;
+}
+
+int recordStart(Recorder* rec, const GLuint w, const GLuint h, const double fps)
+{
+    rec->w = w, rec->h = h;
+    rec->outsize = rec->kind == RECORD_Y4M ? w*h + ((w+1)/2)*((h+1)/2)*2 : w*h*3;
+    rec->out = malloc(rec->outsize);
+    if(rec->out == NULL){return 0;}
+    rec->fences = glFenceSync != NULL && glClientWaitSync != NULL && glDeleteSync != NULL;
+
+    rec->yuv = recordYUVBase;
+#ifndef NOSSE
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){rec->yuv = recordYUVAVX2;}
+#endif
+
+    for(int i = 0; i < RECORD_RING; i++)
+    {
+        glGenBuffers(1, &rec->slot[i].pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rec->slot[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, w*h*4, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++){c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;}
+        record_crc[i] = c;
+    }
+
+    if(rec->kind == RECORD_Y4M)
+        fprintf(rec->f, "YUV4MPEG2 W%u H%u F%u:1000 Ip A1:1 C420jpeg XYSCSS=420JPEG\n", w, h, (unsigned)(fps * 1000.0 + 0.5));
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->cond, NULL);
+    if(pthread_create(&rec->worker, NULL, recordWorker, rec) != 0){printf("record: pthread_create() failed.\n"); return 0;}
+
+    const char* kinds[] = {"rgb24", "y4m", "ppm sequence", "png sequence"};
+    printf("record: %ux%u %s, %d buffer ring, %s, %s\n", w, h, kinds[rec->kind], RECORD_RING,
+        rec->fences == 1 ? "fenced" : "no fences", rec->yuv == recordYUVBase ? "baseline" : "AVX2");
+    return 1;
+}
+
+void recordPoll(Recorder* rec, const int wait)
+{
+    // hand every finished copy to the worker in issue order, waiting only if asked
+    while(rec->mapped < rec->issued)
+    {
+        RecordSlot* s = &rec->slot[rec->mapped % RECORD_RING];
+        if(rec->fences == 1)
+        {
+            const GLenum r = glClientWaitSync(s->fence, wait == 1 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait == 1 ? 1000000000 : 0);
+            if(r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED){break;}
+            glDeleteSync(s->fence);
+            s->fence = NULL;
+        }
+        else if(wait == 0 && rec->issued - s->frame < 2){break;}
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+        s->pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pthread_mutex_lock(&rec->lock);
+        atomic_store(&s->state, RECORD_MAPPED);
+        pthread_cond_signal(&rec->cond);
+        pthread_mutex_unlock(&rec->lock);
+        rec->mapped++;
+    }
+
+    // give converted buffers back to the ring
+    while(rec->unmapped < rec->mapped)
+    {
+        RecordSlot* s = &rec->slot[rec->unmapped % RECORD_RING];
+        if(atomic_load(&s->state) != RECORD_DONE)
+        {
+            if(wait == 0){break;}
+            pthread_mutex_lock(&rec->lock);
+            pthread_cond_signal(&rec->cond);
+            pthread_mutex_unlock(&rec->lock);
+            usleep(100);
+            continue;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        s->pixels = NULL;
+        atomic_store(&s->state, RECORD_FREE);
+        rec->unmapped++;
+    }
+}
+
+void recordFrame(Recorder* rec)
+{
+    recordPoll(rec, 0);
+
+    RecordSlot* s = &rec->slot[rec->issued % RECORD_RING];
+    if(rec->lossless == 1 && rec->issued - rec->unmapped == RECORD_RING)
+    {
+        glFlush();
+        while(rec->issued - rec->unmapped == RECORD_RING)
+        {
+            usleep(100);
+            recordPoll(rec, 0);
+        }
+    }
+    if(rec->issued - rec->unmapped == RECORD_RING)
+    {
+        rec->owed++, rec->missed++; // the ring is full, this frame is written as a repeat instead
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+    glReadPixels(0, 0, rec->w, rec->h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if(rec->fences == 1){s->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);}
+    s->frame = rec->issued;
+    s->repeat = rec->owed;
+    rec->owed = 0;
+    atomic_store(&s->state, RECORD_READING);
+    rec->issued++;
+}
+
+void recordClose(Recorder* rec)
+{
+    if(rec->f == NULL && rec->pattern[0] == 0){return;}
+    if(rec->out != NULL)
+    {
+        recordPoll(rec, 1);
+        pthread_mutex_lock(&rec->lock);
+        rec->quit = 1;
+        pthread_cond_signal(&rec->cond);
+        pthread_mutex_unlock(&rec->lock);
+        pthread_join(rec->worker, NULL);
+        for(uint32_t i = 0; i < rec->owed && rec->written > 0; i++) // missed since the last capture
+            recordEmit(rec);
+        for(int i = 0; i < RECORD_RING; i++){glDeleteBuffers(1, &rec->slot[i].pbo);}
+        printf("record: %lu frames written, %lu missed and repeated, convert %.3f ms/frame\n", (unsigned long)(rec->written + rec->missed),
+            (unsigned long)rec->missed, rec->written > 0 ? rec->convert * 1000.0 / rec->written : 0.0);
+        pthread_mutex_destroy(&rec->lock);
+        pthread_cond_destroy(&rec->cond);
+        free(rec->out);
+    }
+    if(rec->f != NULL){fclose(rec->f);}
+    memset(rec, 0, sizeof(Recorder));
+}
+
+#endif
@@ -0,0 +1,195 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Trace events for chrome://tracing and ui.perfetto.dev.
+
+    Each thread that calls traceThread() gets its own buffer, a ring of
+    TRACE_EVENTS complete events of which the newest are kept, allocated
+    then and never again, so traceBegin() / traceEnd() only read the clock
+    and write to memory no other thread touches. A thread that has not
+    called traceThread(), or any thread when tracing is off, records
+    nothing. Spans nest up to TRACE_DEPTH deep, the names are string
+    literals and are kept by pointer.
+
+    traceWrite() writes the Trace Event Format JSON, call it once every
+    traced thread has stopped.
+
+    Usage:
+        traceInit();
+        traceThread("main");        // on each thread to trace
+        traceBegin("frame");
+        traceEnd();                 // or traceEndArg("n", 42)
+        traceWrite("out.json");
+        traceFree();
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#define TRACE_EVENTS 65536 // per thread, 40 bytes each
+#define TRACE_THREADS 64
+#define TRACE_DEPTH 16
+
+typedef struct
+{
+    const char* name;
+    const char* arg;    // NULL no argument
+    int64_t ts, dur;    // ns, dur < 0 is an instant
+    int64_t val;
+} TraceEvent;
+
+typedef struct
+{
+    const char* name;
+    uint64_t n;         // events recorded, the ring holds the last TRACE_EVENTS
+    unsigned depth;
+    const char* open[TRACE_DEPTH];
+    int64_t opents[TRACE_DEPTH];
+    TraceEvent ev[TRACE_EVENTS];
+} TraceBuf;
+
+struct
+{
+    int on;
+    int64_t start;
+    atomic_uint threads;
+    TraceBuf* buf[TRACE_THREADS];
+} trace;
+
+static __thread TraceBuf* trace_self = NULL;
+
+void traceInit();
+void traceThread(const char* name); // the calling thread records from now on
+void traceBegin(const char* name);
+void traceEnd();
+void traceEndArg(const char* arg, const int64_t val); // the span ends with one integer argument
+void traceInstant(const char* name, const char* arg, const int64_t val);
+int  traceWrite(const char* path); // returns 0 on failure
+void traceFree();
+
+//
+
+static inline int64_t traceNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void traceInit()
+{
+    memset(&trace, 0, sizeof(trace));
+    trace.start = traceNow();
+    trace.on = 1;
+}
+
+void traceThread(const char* name)
+{
+    if(trace.on == 0 || trace_self != NULL){return;}
+    const unsigned i = atomic_fetch_add(&trace.threads, 1);
+    if(i >= TRACE_THREADS){printf("trace: more than %d threads, %s is not traced\n", TRACE_THREADS, name); return;}
+    TraceBuf* b = malloc(sizeof(TraceBuf));
+    if(b == NULL){printf("trace: no memory for thread %s\n", name); return;}
+    b->name = name, b->n = 0, b->depth = 0;
+    trace.buf[i] = b;
+    trace_self = b;
+}
+
+static inline void tracePush(TraceBuf* b, const char* name, const int64_t ts, const int64_t dur, const char* arg, const int64_t val)
+{
+    TraceEvent* e = &b->ev[b->n % TRACE_EVENTS];
+    e->name = name, e->ts = ts, e->dur = dur, e->arg = arg, e->val = val;
+    b->n++;
+}
+
+void traceBegin(const char* name)
+{
+    TraceBuf* b = trace_self;
+    if(b == NULL){return;}
+    if(b->depth < TRACE_DEPTH)
+    {
+        b->open[b->depth] = name;
+        b->opents[b->depth] = traceNow();
+    }
+    b->depth++; // past TRACE_DEPTH the span is only counted, so the ends still pair up
+}
+
+void traceEndArg(const char* arg, const int64_t val)
+{
+    TraceBuf* b = trace_self;
+    if(b == NULL || b->depth == 0){return;}
+    b->depth--;
+    if(b->depth < TRACE_DEPTH)
+        tracePush(b, b->open[b->depth], b->opents[b->depth], traceNow() - b->opents[b->depth], arg, val);
+}
+
+void traceEnd()
+{
+    traceEndArg(NULL, 0);
+}
+
+void traceInstant(const char* name, const char* arg, const int64_t val)
+{
+    TraceBuf* b = trace_self;
+    if(b == NULL){return;}
+    tracePush(b, name, traceNow(), -1, arg, val);
+}
+
+int traceWrite(const char* path)
+{
+    if(trace.on == 0){return 0;}
+    FILE* f = fopen(path, "w");
+    if(f == NULL){printf("trace: could not open %s\n", path); return 0;}
+    const int pid = (int)getpid();
+    uint64_t total = 0, lost = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"wiggle %d\"}}", pid, pid);
+    unsigned threads = atomic_load(&trace.threads);
+    if(threads > TRACE_THREADS){threads = TRACE_THREADS;}
+    for(unsigned t = 0; t < threads; t++)
+    {
+        const TraceBuf* b = trace.buf[t];
+        if(b == NULL){continue;}
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", pid, t+1, b->name);
+        fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"sort_index\":%u}}", pid, t+1, t);
+        const uint64_t first = b->n > TRACE_EVENTS ? b->n - TRACE_EVENTS : 0;
+        for(uint64_t i = first; i < b->n; i++)
+        {
+            const TraceEvent* e = &b->ev[i % TRACE_EVENTS];
+            fprintf(f, ",\n{\"name\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f", e->name, pid, t+1, (double)(e->ts - trace.start) * 1e-3);
+            if(e->dur < 0)
+                fprintf(f, ",\"ph\":\"i\",\"s\":\"t\"");
+            else
+                fprintf(f, ",\"ph\":\"X\",\"dur\":%.3f", (double)e->dur * 1e-3);
+            if(e->arg != NULL){fprintf(f, ",\"args\":{\"%s\":%ld}", e->arg, (long)e->val);}
+            fprintf(f, "}");
+        }
+        total += b->n - first, lost += first;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    printf("trace: %lu events from %u threads to %s", (unsigned long)total, threads, path);
+    if(lost > 0){printf(", %lu older events overwritten", (unsigned long)lost);}
+    printf("\n");
+    return 1;
+}
+
+void traceFree()
+{
+    unsigned threads = atomic_load(&trace.threads);
+    if(threads > TRACE_THREADS){threads = TRACE_THREADS;}
+    for(unsigned t = 0; t < threads; t++){free(trace.buf[t]);}
+    memset(&trace, 0, sizeof(trace));
+    trace_self = NULL;
+}
+
+#endif
@@ -0,0 +1,269 @@
+/*
+    James William Fletcher (github.com/mrbid)
+        December 2022
+
+    Structure of arrays companion to vec_ts.h
+
+    vec3x8 is 8 vectors, one GCC vector per axis, for kernels that keep
+    them in registers. vec3xN is n vectors as three 32 byte aligned float
+    streams, the array functions work 8 at a time and finish the last
+    n % 8 one at a time, r may be a or b.
+
+    vnDot, vnMag, vnCross and vnNorm are compiled once for AVX2 + FMA and
+    once for the baseline and picked by vnInit() like raster.h, the rest
+    are a load, an op and a store that the baseline already does at the
+    speed of memory. vnNorm is rsqrtps and one Newton step, 22 bits or so
+    where vNorm() is rsqrtss alone, 12 bits. See: ./wiggle --bench vec
+
+    Usage:
+        vnInit();
+        vec3xN v;
+        vnAlloc(&v, n);
+        vnFromVec(&v, aos, n);
+        vnNorm(&v);
+        vnToVec(aos, &v);
+        vnFree(&v);
+*/
+
+#ifndef VEC_SOA_H
+#define VEC_SOA_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "vec_ts.h"
+
+typedef float vf8 __attribute__((vector_size(32)));
+
+typedef struct
+{
+    vf8 x, y, z;
+} vec3x8;
+
+typedef struct
+{
+    float *x, *y, *z;   // 32 byte aligned, room for n rounded up to 8
+    size_t n;
+} vec3xN;
+
+void vnInit(); // picks the AVX2 kernels by CPUID
+int  vnAlloc(vec3xN* v, const size_t n); // returns 0 on failure
+void vnFree(vec3xN* v);
+void vnFromVec(vec3xN* r, const vec* v, const size_t n); // n no more than r->n
+void vnToVec(vec* r, const vec3xN* v); // w = 0
+
+void vnAdd(vec3xN* r, const vec3xN* a, const vec3xN* b);
+void vnSub(vec3xN* r, const vec3xN* a, const vec3xN* b);
+void vnMul(vec3xN* r, const vec3xN* a, const vec3xN* b);
+void vnMulS(vec3xN* r, const vec3xN* a, const float s);
+void vnDot(float* r, const vec3xN* a, const vec3xN* b); // r holds a->n floats
+void vnMag(float* r, const vec3xN* a);
+void vnCross(vec3xN* r, const vec3xN* a, const vec3xN* b);
+void vnNorm(vec3xN* v);
+
+//
+
+// none of these is a function: outside target("avx2") a vf8 or vec3x8 argument or
+// return value is an ABI change that GCC reports (-Wpsabi), vf8Rsqrt() takes pointers
+#define vf8Splat(f) ({const float vf8Splat_f = (f); (vf8){vf8Splat_f, vf8Splat_f, vf8Splat_f, vf8Splat_f, vf8Splat_f, vf8Splat_f, vf8Splat_f, vf8Splat_f};})
+
+static inline __attribute__((always_inline)) void vf8Rsqrt(vf8* r, const vf8* px, const int ymm)
+{
+    // rsqrtps on each half, ymm = 1 in the AVX2 build joins them with a
+    // shuffle, the baseline keeps an xmm pair that a shuffle would scalarise
+    const vf8 x = *px;
+    vf8 e;
+#ifndef NOSSE
+    if(ymm == 1)
+    {
+        const __m128 lo = _mm_rsqrt_ps(__builtin_shufflevector(x, x, 0, 1, 2, 3));
+        const __m128 hi = _mm_rsqrt_ps(__builtin_shufflevector(x, x, 4, 5, 6, 7));
+        e = __builtin_shufflevector(lo, hi, 0, 1, 2, 3, 4, 5, 6, 7);
+    }
+    else
+    {
+        union {vf8 v; __m128 h[2];} u = {x};
+        u.h[0] = _mm_rsqrt_ps(u.h[0]);
+        u.h[1] = _mm_rsqrt_ps(u.h[1]);
+        e = u.v;
+    }
+    e = e * (1.5f - 0.5f * x * e * e); // one Newton step
+#else
+    (void)ymm;
+    for(int i = 0; i < 8; i++){e[i] = 1.f / sqrtf(x[i]);}
+#endif
+    *r = e;
+}
+
+#define v8Load(v, i) ({const vec3xN* v8Load_v = (v); const size_t v8Load_i = (i); vec3x8 v8Load_a; \
+    memcpy(&v8Load_a.x, &v8Load_v->x[v8Load_i], sizeof(vf8)); \
+    memcpy(&v8Load_a.y, &v8Load_v->y[v8Load_i], sizeof(vf8)); \
+    memcpy(&v8Load_a.z, &v8Load_v->z[v8Load_i], sizeof(vf8)); \
+    v8Load_a;})
+
+#define v8Store(v, i, a) ({vec3xN* v8Store_v = (v); const size_t v8Store_i = (i); const vec3x8 v8Store_a = (a); \
+    memcpy(&v8Store_v->x[v8Store_i], &v8Store_a.x, sizeof(vf8)); \
+    memcpy(&v8Store_v->y[v8Store_i], &v8Store_a.y, sizeof(vf8)); \
+    memcpy(&v8Store_v->z[v8Store_i], &v8Store_a.z, sizeof(vf8));})
+
+#define v8Splat(v) ({const vec v8Splat_v = (v); (vec3x8){vf8Splat(v8Splat_v.x), vf8Splat(v8Splat_v.y), vf8Splat(v8Splat_v.z)};})
+#define v8Add(a, b) ({const vec3x8 v8Add_a = (a), v8Add_b = (b); (vec3x8){v8Add_a.x + v8Add_b.x, v8Add_a.y + v8Add_b.y, v8Add_a.z + v8Add_b.z};})
+#define v8Sub(a, b) ({const vec3x8 v8Sub_a = (a), v8Sub_b = (b); (vec3x8){v8Sub_a.x - v8Sub_b.x, v8Sub_a.y - v8Sub_b.y, v8Sub_a.z - v8Sub_b.z};})
+#define v8Mul(a, b) ({const vec3x8 v8Mul_a = (a), v8Mul_b = (b); (vec3x8){v8Mul_a.x * v8Mul_b.x, v8Mul_a.y * v8Mul_b.y, v8Mul_a.z * v8Mul_b.z};})
+#define v8MulS(a, s) ({const vec3x8 v8MulS_a = (a); const vf8 v8MulS_s = (s); (vec3x8){v8MulS_a.x * v8MulS_s, v8MulS_a.y * v8MulS_s, v8MulS_a.z * v8MulS_s};})
+#define v8Dot(a, b) ({const vec3x8 v8Dot_a = (a), v8Dot_b = (b); v8Dot_a.x * v8Dot_b.x + v8Dot_a.y * v8Dot_b.y + v8Dot_a.z * v8Dot_b.z;})
+#define v8Cross(a, b) ({const vec3x8 v8Cross_a = (a), v8Cross_b = (b); \
+    (vec3x8){v8Cross_a.y * v8Cross_b.z - v8Cross_b.y * v8Cross_a.z, v8Cross_b.x * v8Cross_a.z - v8Cross_a.x * v8Cross_b.z, v8Cross_a.x * v8Cross_b.y - v8Cross_b.x * v8Cross_a.y};})
+#define v8Norm(a, ymm) ({const vec3x8 v8Norm_a = (a); const vf8 v8Norm_d = v8Dot(v8Norm_a, v8Norm_a); vf8 v8Norm_e; \
+    vf8Rsqrt(&v8Norm_e, &v8Norm_d, (ymm)); v8MulS(v8Norm_a, v8Norm_e);})
+
+// one at a time for the tails, the same arithmetic as a lane
+static inline vec vnGet(const vec3xN* v, const size_t i)
+{
+    return (vec){v->x[i], v->y[i], v->z[i], 0.f};
+}
+
+static inline void vnSet(vec3xN* v, const size_t i, const vec a)
+{
+    v->x[i] = a.x, v->y[i] = a.y, v->z[i] = a.z;
+}
+
+//
+
+int vnAlloc(vec3xN* v, const size_t n)
+{
+    const size_t bytes = ((n + 7) & ~(size_t)7) * sizeof(float);
+    v->n = n;
+    v->x = aligned_alloc(32, bytes > 0 ? bytes : 32);
+    v->y = aligned_alloc(32, bytes > 0 ? bytes : 32);
+    v->z = aligned_alloc(32, bytes > 0 ? bytes : 32);
+    if(v->x == NULL || v->y == NULL || v->z == NULL){vnFree(v); return 0;}
+    return 1;
+}
+
+void vnFree(vec3xN* v)
+{
+    free(v->x);
+    free(v->y);
+    free(v->z);
+    memset(v, 0, sizeof(vec3xN));
+}
+
+void vnFromVec(vec3xN* r, const vec* v, const size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+        r->x[i] = v[i].x, r->y[i] = v[i].y, r->z[i] = v[i].z;
+}
+
+void vnToVec(vec* r, const vec3xN* v)
+{
+    for(size_t i = 0; i < v->n; i++)
+        r[i] = vnGet(v, i);
+}
+
+void vnAdd(vec3xN* r, const vec3xN* a, const vec3xN* b)
+{
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8){v8Store(r, i, v8Add(v8Load(a, i), v8Load(b, i)));}
+    for(; i < a->n; i++){vec t; vAdd(&t, vnGet(a, i), vnGet(b, i)); vnSet(r, i, t);}
+}
+
+void vnSub(vec3xN* r, const vec3xN* a, const vec3xN* b)
+{
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8){v8Store(r, i, v8Sub(v8Load(a, i), v8Load(b, i)));}
+    for(; i < a->n; i++){vec t; vSub(&t, vnGet(a, i), vnGet(b, i)); vnSet(r, i, t);}
+}
+
+void vnMul(vec3xN* r, const vec3xN* a, const vec3xN* b)
+{
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8){v8Store(r, i, v8Mul(v8Load(a, i), v8Load(b, i)));}
+    for(; i < a->n; i++){vec t; vMul(&t, vnGet(a, i), vnGet(b, i)); vnSet(r, i, t);}
+}
+
+void vnMulS(vec3xN* r, const vec3xN* a, const float s)
+{
+    const vf8 s8 = vf8Splat(s);
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8){v8Store(r, i, v8MulS(v8Load(a, i), s8));}
+    for(; i < a->n; i++){vec t; vMulS(&t, vnGet(a, i), s); vnSet(r, i, t);}
+}
+
+static inline __attribute__((always_inline)) void vnDotKernel(float* r, const vec3xN* a, const vec3xN* b)
+{
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8)
+    {
+        const vf8 d = v8Dot(v8Load(a, i), v8Load(b, i));
+        memcpy(&r[i], &d, sizeof(vf8)); // r has no alignment promise
+    }
+    for(; i < a->n; i++){r[i] = vDot(vnGet(a, i), vnGet(b, i));}
+}
+
+static inline __attribute__((always_inline)) void vnMagKernel(float* r, const vec3xN* a)
+{
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8)
+    {
+        const vec3x8 v = v8Load(a, i);
+        const vf8 d = v8Dot(v, v);
+        vf8 m;
+        for(int j = 0; j < 8; j++){m[j] = sqrtf(d[j]);}
+        memcpy(&r[i], &m, sizeof(vf8));
+    }
+    for(; i < a->n; i++){r[i] = vMag(vnGet(a, i));}
+}
+
+static inline __attribute__((always_inline)) void vnCrossKernel(vec3xN* r, const vec3xN* a, const vec3xN* b)
+{
+    size_t i = 0;
+    for(; i + 8 <= a->n; i += 8){v8Store(r, i, v8Cross(v8Load(a, i), v8Load(b, i)));}
+    for(; i < a->n; i++){vec t; vCross(&t, vnGet(a, i), vnGet(b, i)); vnSet(r, i, t);}
+}
+
+static inline __attribute__((always_inline)) void vnNormKernel(vec3xN* v, const int ymm)
+{
+    // the tail goes through a padded block, vNorm() would be the 12 bit rsqrtss
+    size_t i = 0;
+    for(; i + 8 <= v->n; i += 8){v8Store(v, i, v8Norm(v8Load(v, i), ymm));}
+    if(i == v->n){return;}
+    vec3x8 t = {vf8Splat(1.f), vf8Splat(1.f), vf8Splat(1.f)};
+    for(size_t j = i; j < v->n; j++){t.x[j-i] = v->x[j], t.y[j-i] = v->y[j], t.z[j-i] = v->z[j];}
+    t = v8Norm(t, ymm);
+    for(size_t j = i; j < v->n; j++){v->x[j] = t.x[j-i], v->y[j] = t.y[j-i], v->z[j] = t.z[j-i];}
+}
+
+#ifndef NOSSE
+__attribute__((target("avx2,fma"))) void vnDotAVX2(float* r, const vec3xN* a, const vec3xN* b){vnDotKernel(r, a, b);}
+__attribute__((target("avx2,fma"))) void vnMagAVX2(float* r, const vec3xN* a){vnMagKernel(r, a);}
+__attribute__((target("avx2,fma"))) void vnCrossAVX2(vec3xN* r, const vec3xN* a, const vec3xN* b){vnCrossKernel(r, a, b);}
+__attribute__((target("avx2,fma"))) void vnNormAVX2(vec3xN* v){vnNormKernel(v, 1);}
+#endif
+void vnDotBase(float* r, const vec3xN* a, const vec3xN* b){vnDotKernel(r, a, b);}
+void vnMagBase(float* r, const vec3xN* a){vnMagKernel(r, a);}
+void vnCrossBase(vec3xN* r, const vec3xN* a, const vec3xN* b){vnCrossKernel(r, a, b);}
+void vnNormBase(vec3xN* v){vnNormKernel(v, 0);}
+
+int vn_avx2 = 0;
+
+void vnInit()
+{
+#ifndef NOSSE
+    __builtin_cpu_init();
+    vn_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#ifndef NOSSE
+void vnDot(float* r, const vec3xN* a, const vec3xN* b){if(vn_avx2 == 1){vnDotAVX2(r, a, b);}else{vnDotBase(r, a, b);}}
+void vnMag(float* r, const vec3xN* a){if(vn_avx2 == 1){vnMagAVX2(r, a);}else{vnMagBase(r, a);}}
+void vnCross(vec3xN* r, const vec3xN* a, const vec3xN* b){if(vn_avx2 == 1){vnCrossAVX2(r, a, b);}else{vnCrossBase(r, a, b);}}
+void vnNorm(vec3xN* v){if(vn_avx2 == 1){vnNormAVX2(v);}else{vnNormBase(v);}}
+#else
+void vnDot(float* r, const vec3xN* a, const vec3xN* b){vnDotBase(r, a, b);}
+void vnMag(float* r, const vec3xN* a){vnMagBase(r, a);}
+void vnCross(vec3xN* r, const vec3xN* a, const vec3xN* b){vnCrossBase(r, a, b);}
+void vnNorm(vec3xN* v){vnNormBase(v);}
+#endif
+
+#endif
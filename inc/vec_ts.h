@@ -12,6 +12,7 @@
 
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
 
 #ifndef NOSSE
     #include <x86intrin.h>
@@ -37,6 +38,14 @@ static inline float sqrtps(float f);
 float randf(int *seed);  // uniform [0 to 1]
 float randfc(int *seed); // uniform [-1 to 1]
 float randfn(int *seed); // box-muller normal [bi-directional]
+
+// counter based, the same key and counter always give the same number on any machine
+// each call consumes one counter, so independent streams just need their own key
+uint64_t crandKey(const uint64_t seed, const uint64_t stream); // key for stream n of a seed
+uint32_t crand(const uint64_t key, uint64_t *ctr);                 // uniform [0 to 2^32-1]
+uint32_t crandr(const uint64_t key, uint64_t *ctr, const uint32_t n); // uniform [0 to n-1]
+float crandf(const uint64_t key, uint64_t *ctr);                   // uniform [0 to 1]
+float crandfc(const uint64_t key, uint64_t *ctr);                  // uniform [-1 to 1]
 int vec_ftoi(float f); // float to integer quantise
 
 // normalising the result is optional / at the callers responsibility
@@ -105,12 +114,12 @@ static inline float sqrtps(float f)
 // moc.liamg@seir.kinimod
 float randf(int *seed)
 {
-    *seed *= 16807;
+    *seed = (int)((unsigned)*seed * 16807u); // same sequence, without signed overflow
     return (float)(*seed & 0x7FFFFFFF) * 4.6566129e-010f;
 }
 float randfc(int *seed)
 {
-    *seed *= 16807;
+    *seed = (int)((unsigned)*seed * 16807u);
     return ((float)(*seed)) * 4.6566129e-010f;
 }
 float randfn(int *seed)
@@ -127,6 +136,36 @@ float randfn(int *seed)
     return u * sqrtps(-2.f * logf(r) / r);
 }
 
+// splitmix64 finaliser of key + counter * golden ratio, a stateless counter based generator
+// http://prng.di.unimi.it/splitmix64.c
+static inline uint64_t crandMix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+uint64_t crandKey(const uint64_t seed, const uint64_t stream)
+{
+    return crandMix(crandMix(seed) + stream * 0x9e3779b97f4a7c15ULL);
+}
+uint32_t crand(const uint64_t key, uint64_t *ctr)
+{
+    return (uint32_t)(crandMix(key + (*ctr)++ * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+uint32_t crandr(const uint64_t key, uint64_t *ctr, const uint32_t n)
+{
+    // multiply shift instead of modulo, the bias is below n / 2^32
+    return (uint32_t)(((uint64_t)crand(key, ctr) * n) >> 32);
+}
+float crandf(const uint64_t key, uint64_t *ctr)
+{
+    return (float)(crand(key, ctr) >> 8) * 5.9604645e-08f; // 24 bits, exact in a float
+}
+float crandfc(const uint64_t key, uint64_t *ctr)
+{
+    return (float)(crand(key, ctr) >> 8) * 1.1920929e-07f - 1.f;
+}
+
 void vRuv(int *seed, vec* v)
 {
     v->x = randfc(seed);
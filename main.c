@@ -2,20 +2,16 @@
     James William Fletcher (github.com/mrbid)
         December 2022
 
-    L45: #define FUN
-    - Comment this out and any deviation from the
-    intended maxfps of 144 will cause the simulation
-    speed to change. Going over the maximum frame
-    rate the computer can render will slow down
-    the simulation but upto that point it will be
-    speeding up. Reducing the framerate from 144
-    will also slow down the simulation.
-    - Don't comment it out and the simulation speed
-    should be stable at all framerates, even auto-
-    correcting at high framerates. But less fun.
-
-    Most people don't detect their delta time step
-    they just use the current frame delta.
+    #define FUN
+    - Leave it in for the original integrator, yrot
+    swings wider and wider as ss grows. Comment it
+    out for the bounded sine swing. But less fun.
+    - Either way the simulation runs on its own
+    thread at a fixed SIM_HZ of 144, the intended
+    maxfps of the original, and the renderer draws
+    an interpolation of the last two ticks. So the
+    speed no longer depends on the frame rate or a
+    GPU stall.
 
     #$%*(*(*&%^&*()&^%%$#$%^&*()(&*^%$#$$%^&^%$#%^&*^%$#%^&*()(*&^%$#@$%^&*()*&^%$#%^&*(
         original git: https://github.com/mrbid/MengerCube
@@ -31,8 +27,12 @@
 #include <time.h>
 
 #include <sys/file.h>
+#include <sys/random.h>
+#include <sys/wait.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #pragma GCC diagnostic ignored "-Wunused-result"
 
@@ -49,11 +49,22 @@
 #endif
 
 //#define REGULAR_PHONG   // or Blinn-Phong by default
-#define FUN             // uncomment this for stable simulation speed at different frame rates
+#define FUN             // comment this out for the bounded yrot swing
+//#define URAND_POOL 512  // urandf() from blocks of kernel entropy instead of a seeded xoshiro256**
 
 #include "inc/esAux3.h"
 #include "inc/res.h"
-#include "ncube.h"
+#include "inc/menger.h"
+#include "inc/trace.h" // first, pacer.h and record.h trace when it is there
+#include "inc/raster.h"
+#include "inc/vec_soa.h"
+#include "inc/fmath.h"
+#include "inc/bench.h"
+#include "inc/pacer.h"
+#include "inc/headless.h"
+#include "inc/record.h"
+#include "inc/prof.h"
+#include "inc/hud.h"
 
 //*************************************
 // globals
@@ -62,7 +73,6 @@ GLFWwindow* window;
 uint winw = 1024;
 uint winh = 768;
 double t = 0;   // time
-f32 dt = 0;     // delta time
 double fc = 0;  // frame count
 double lfct = 0;// last frame count time
 f32 aspect;
@@ -70,6 +80,26 @@ double x,y,lx,ly;
 double rww, ww, rwh, wh, ww2, wh2;
 double uw, uh, uw2, uh2; // normalised pixel dpi
 double maxfps = 144.0;
+GLuint headless = 0; // frames to render offscreen, 0 = window
+Pacer pacer;
+uint pacing = PACER_CATCHUP;
+int64_t spin = PACER_SPIN_NS;
+uint64_t seed = 0; // wiggle seed, --seed or the start time
+char* record_path = NULL; // --record, every frame is captured to it
+double render_fps = 0.0; // --render-frames, t is frame / render_fps instead of the clock
+#define MAX_WORKERS 64
+GLuint workers = 0; // --render-frames split across this many processes
+GLuint frame0 = 0; // first frame of this process, headless is the end
+Recorder recorder;
+char* profile_path = NULL; // --profile, per frame stage times to CSV on exit
+char* trace_path = NULL; // --trace, Chrome trace JSON on exit
+uint hud_on = 0; // --hud or H, the overlay
+uint phong = 1; // the lit program is Phong, else Lambert
+GLuint lit_program = 0; // bound by shadeLit(), what the overlays put back
+uint blend_on = 0; // A/S, GL_BLEND of the lit program
+GLfloat lit_opacity = 0.5f; // the opacity uniform of the lit program
+uint shader_cache = 1; // --no-shader-cache, linked programs are kept on disk
+char title[32] = "L3 Menger Cube";
 
 // render state id's
 GLint projection_id;
@@ -81,6 +111,10 @@ GLint solidcolor_id;
 GLint color_id;
 GLint opacity_id;
 GLint normal_id; // 
+GLint quant_id;
+GLint instance_id = -1;
+GLint wparams_id;
+GLint witer_id;
 
 // render state matrices
 mat projection;
@@ -88,10 +122,23 @@ mat view;
 
 // models
 ESModel mdlMenger;
+MengerMesh menger;
+GLuint level = 3;
+GLuint meshflags = MENGER_OPTIMISE;
+uint vformat = 2; // 0 = float positions + normals, 1 = lattice bytes + face id, 2 = lattice bytes + derivative normals
+GLuint instances = 0; // 0 = single draw, otherwise one instanced draw (OpenGL 3.3)
+GLuint instance_vbo;
+uint gpuwiggle = 0; // 0 = CPU wiggle, 1 = GPU per frame, 2 = GPU per vertex, 3 = GPU per level 1 sub-cube
+uint backend = 0; // 0 = OpenGL, 1 = CPU rasteriser presented as a texture
+Raster raster;
+GLuint raster_threads = 0; // 0 = one per core
+GLuint raster_tex = 0;
+GLuint raster_vbo = 0;
 
 // camera vars
 #define FAR_DISTANCE 333.f
-uint focus_cursor = 0;
+f32 far_distance = FAR_DISTANCE;
+_Atomic uint focus_cursor = 0; // also read by the simulation thread
 double sens = 0.001f;
 f32 xrot = 0.f;
 f32 yrot = d2PI; // face on until [1]
@@ -99,33 +146,103 @@ f32 zoom = -14.0f; // -6.0f / -26.0f
 
 // sim vars
 vec lightpos = {0.f, 0.f, 0.f};
-f32 r=0.f,g=0.f,b=0.f;
+f32 r=0.f,g=0.f,b=0.f; // render thread copy of the colour
+
+// simulation thread, publishes every tick to the slot the renderer is not reading
+#define SIM_HZ 144.0
+#define SIM_DT (1.f / (f32)SIM_HZ)
+typedef struct
+{
+    f32 xrot, yrot, ss, tft, r, g, b;
+    uint64_t ctr; // of sim_key, the colour drift
+} SimState;
+typedef struct
+{
+    atomic_uint seq;    // odd while the simulation writes
+    SimState a, b;      // previous and latest tick
+    int64_t tb;         // time of the latest tick, ns
+} SimSlot;
+SimSlot sim_slot[2];
+atomic_uint sim_latest;
+atomic_int sim_run;
+atomic_int sim_recolour;
+uint64_t sim_key; // its own stream of the seed
+_Atomic f32 sim_lookx, sim_looky; // total mouse look so far, the simulation applies what is new
+pthread_t sim_thread;
+Pacer sim_pacer;
 
 //*************************************
 // utility functions
 //*************************************
+double getTime()
+{
+    // glfw's timer needs glfwInit(), which needs a display
+    if(headless > 0)
+    {
+        static int64_t st = 0;
+        if(st == 0){st = pacerNow();}
+        return (double)(pacerNow() - st) * 1e-9;
+    }
+    return glfwGetTime();
+}
 void timestamp(char* ts)
 {
     const time_t tt = time(0);
     strftime(ts, 16, "%H:%M:%S", localtime(&tt));
 }
+void urandFill(void* buf, size_t len)
+{
+    // getrandom() is one syscall and needs no file descriptor, /dev/urandom for kernels before 3.17
+    unsigned char* p = buf;
+    while(len > 0)
+    {
+        const ssize_t n = getrandom(p, len, 0);
+        if(n <= 0){break;}
+        p += n, len -= n;
+    }
+    if(len > 0)
+    {
+        int f = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+        if(f != -1){read(f, p, len); close(f);}
+    }
+}
+uint64_t urand64()
+{
+#ifdef URAND_POOL
+    // raw kernel entropy, refilled a block at a time
+    static __thread uint64_t pool[URAND_POOL];
+    static __thread uint pp = URAND_POOL;
+    if(pp == URAND_POOL){urandFill(pool, sizeof(pool)); pp = 0;}
+    return pool[pp++];
+#else
+    // xoshiro256** seeded once per thread: https://prng.di.unimi.it/xoshiro256starstar.c
+    static __thread uint64_t s[4];
+    static __thread uint seeded = 0;
+    if(seeded == 0)
+    {
+        urandFill(s, sizeof(s));
+        if((s[0]|s[1]|s[2]|s[3]) == 0){s[0] = (uint64_t)time(0) | 1;} // all zero is the one bad state
+        seeded = 1;
+    }
+    const uint64_t r = s[1] * 5;
+    const uint64_t result = ((r << 7) | (r >> 57)) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+#endif
+}
 float urandf()
 {
-    static const float RECIP_FLOAT_UINT64_MAX = 1.f/(float)UINT64_MAX;
-    int f = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
-    uint64_t s = 0;
-    read(f, &s, sizeof(uint64_t));
-    close(f);
-    return ((float)s) * RECIP_FLOAT_UINT64_MAX;
+    return (float)(urand64() >> 40) * 5.9604645e-08f; // [0 to 1)
 }
 float urandfc()
 {
-    static const float RECIP_FLOAT_UINT64_MAX = 2.f/(float)UINT64_MAX;
-    int f = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
-    uint64_t s = 0;
-    read(f, &s, sizeof(uint64_t));
-    close(f);
-    return (((float)s) * RECIP_FLOAT_UINT64_MAX)-1.f;
+    return (float)(urand64() >> 40) * 1.1920929e-07f - 1.f; // [-1 to 1)
 }
 float clamp(float f, float min, float max)
 {
@@ -156,7 +273,7 @@ void stepTitle(float speed)
     {
         if(p == 0)
         {
-            glfwSetWindowTitle(window, "L3 Menger Cube");
+            glfwSetWindowTitle(window, title);
             lt = t+6.0;
             p++;
             return;
@@ -182,114 +299,443 @@ void stepTitle(float speed)
     }
 }
 
+// binds the Phong or Lambert program that fits the vertex format, instances and gpu wiggle
+void shadeLit()
+{
+    if(phong == 0)
+    {
+        if(instances > 0)
+            shadeLambert6(&position_id, &projection_id, &modelview_id, &lightpos_id, &quant_id, &instance_id, &wparams_id, &witer_id, &color_id, &opacity_id), lit_program = shdLambert6;
+        else if(gpuwiggle > 0)
+            shadeLambert7(&position_id, &projection_id, &modelview_id, &lightpos_id, &quant_id, &wparams_id, &witer_id, &color_id, &opacity_id), lit_program = shdLambert7;
+        else if(vformat == 2)
+            shadeLambert5(&position_id, &projection_id, &modelview_id, &lightpos_id, &quant_id, &color_id, &opacity_id), lit_program = shdLambert5;
+        else if(vformat == 1)
+            shadeLambert4(&position_id, &projection_id, &modelview_id, &lightpos_id, &quant_id, &color_id, &opacity_id), lit_program = shdLambert4;
+        else
+            shadeLambert1(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &opacity_id), lit_program = shdLambert1;
+        normalmat_id = -1;
+    }
+    else
+    {
+        if(instances > 0)
+            shadePhong6(&position_id, &projection_id, &modelview_id, &lightpos_id, &quant_id, &instance_id, &wparams_id, &witer_id, &color_id, &opacity_id), lit_program = shdPhong6, normalmat_id = -1;
+        else if(gpuwiggle > 0)
+            shadePhong7(&position_id, &projection_id, &modelview_id, &lightpos_id, &quant_id, &wparams_id, &witer_id, &color_id, &opacity_id), lit_program = shdPhong7, normalmat_id = -1;
+        else if(vformat == 2)
+            shadePhong5(&position_id, &projection_id, &modelview_id, &normalmat_id, &lightpos_id, &quant_id, &color_id, &opacity_id), lit_program = shdPhong5;
+        else if(vformat == 1)
+            shadePhong4(&position_id, &projection_id, &modelview_id, &normalmat_id, &lightpos_id, &quant_id, &color_id, &opacity_id), lit_program = shdPhong4;
+        else
+            shadePhong1(&position_id, &projection_id, &modelview_id, &normalmat_id, &lightpos_id, &normal_id, &color_id, &opacity_id), lit_program = shdPhong1;
+    }
+}
+
+void bindMenger()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, mdlMenger.vid);
+    if(vformat > 0)
+    {
+        glUniform2f(quant_id, menger.quant[0], menger.quant[1]);
+        glVertexAttribPointer(position_id, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(position_id);
+    }
+    else
+    {
+        glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(position_id);
+
+        glBindBuffer(GL_ARRAY_BUFFER, mdlMenger.nid);
+        glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(normal_id);
+    }
+    if(instances > 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        glVertexAttribPointer(instance_id, 4, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(instance_id);
+        glVertexAttribDivisor(instance_id, 1);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mdlMenger.iid);
+}
+
+int makeInstances()
+{
+    // cube grid of sponges spaced half a sponge apart, each with its own wiggle seed
+    const GLuint side = (GLuint)ceilf(cbrtf((float)instances));
+    const f32 spacing = MENGER_SIZE * 1.5f;
+    const f32 half = (f32)(side-1) * spacing * 0.5f;
+    GLfloat* inst = malloc(instances * 4 * sizeof(GLfloat));
+    if(inst == NULL){return 0;}
+    const uint64_t wkey = crandKey(seed, UINT64_MAX - 2);
+    uint64_t ctr = 0;
+    for(GLuint i = 0; i < instances; i++)
+    {
+        GLfloat* ip = &inst[i*4];
+        ip[0] = (f32)(i % side) * spacing - half;
+        ip[1] = (f32)((i / side) % side) * spacing - half;
+        ip[2] = (f32)(i / (side*side)) * spacing - half;
+        ip[3] = i == 0 ? 0.f : (f32)(crand(wkey, &ctr) & 0x3ff); // instance 0 wiggles exactly like the single sponge
+    }
+    esBind(GL_ARRAY_BUFFER, &instance_vbo, inst, instances * 4 * sizeof(GLfloat), GL_STATIC_DRAW);
+    free(inst);
+
+    // pull the camera back so the whole grid fits the frustum
+    const f32 radius = half * 1.7320508f + MENGER_SIZE;
+    if(zoom > -radius*1.5f){zoom = -radius*1.5f;}
+    far_distance = -zoom + radius*2.f;
+    if(far_distance < FAR_DISTANCE){far_distance = FAR_DISTANCE;}
+    return 1;
+}
+
+int rasterTarget()
+{
+    // the CPU frame is the size of the window, the texture too
+    if(rasterResize(&raster, winw, winh) == 0){return 0;}
+    if(raster_tex != 0){glDeleteTextures(1, &raster_tex);}
+    raster_tex = esLoadTextureA(winw, winh, NULL);
+    if(raster_vbo == 0)
+    {
+        // fullscreen strip, xy + uv
+        const GLfloat quad[] = {-1.f,-1.f, 0.f,0.f,  1.f,-1.f, 1.f,0.f,  -1.f,1.f, 0.f,1.f,  1.f,1.f, 1.f,1.f};
+        esBind(GL_ARRAY_BUFFER, &raster_vbo, quad, sizeof(quad), GL_STATIC_DRAW);
+    }
+    return 1;
+}
+
+void rasterPresent()
+{
+    // rows are bottom up like glReadPixels() so the texture needs no flip
+    glBindTexture(GL_TEXTURE_2D, raster_tex);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, raster.stride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, raster.w, raster.h, GL_RGBA, GL_UNSIGNED_BYTE, raster.color);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    // over the lit program, which keeps its uniforms for the next frame
+    GLint position, projection, modelview, texcoord, sampler;
+    shadeFullbrightT(&position, &projection, &modelview, &texcoord, &sampler);
+    mat ident;
+    mIdent(&ident);
+    glUniformMatrix4fv(projection, 1, GL_FALSE, (GLfloat*) &ident.m[0][0]);
+    glUniformMatrix4fv(modelview, 1, GL_FALSE, (GLfloat*) &ident.m[0][0]);
+    glUniform1i(sampler, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, raster_vbo);
+    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*4, 0);
+    glEnableVertexAttribArray(position);
+    glVertexAttribPointer(texcoord, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*4, (void*)(sizeof(GLfloat)*2));
+    glEnableVertexAttribArray(texcoord);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glEnable(GL_DEPTH_TEST);
+    if(blend_on == 1){glEnable(GL_BLEND);}
+    glUseProgram(lit_program);
+    bindMenger();
+}
+
+void drawHud(const uint mode, const uint iter, const f32 ws)
+{
+    // the numbers change four times a second so they can be read, the graph every frame
+    static char line[3][64];
+    static int64_t next = 0;
+    hudFrame();
+    if(hud.last >= next)
+    {
+        const unsigned n = hud.frames < HUD_GRAPH ? (unsigned)hud.frames : HUD_GRAPH;
+        float sum = 0.f, max = 0.f;
+        for(unsigned i = 0; i < n; i++)
+        {
+            sum += hud.graph[i];
+            if(hud.graph[i] > max){max = hud.graph[i];}
+        }
+        const float avg = n > 0 ? sum / n : 0.f;
+        snprintf(line[0], sizeof(line[0]), "frame avg %.2f ms max %.2f ms %.1f fps", avg, max, avg > 0.f ? 1000.f / avg : 0.f);
+        snprintf(line[1], sizeof(line[1]), "tris %u x %u  %s%u  %s", menger.numind/3, instances > 0 ? instances : 1,
+            phong == 1 ? "Phong" : "Lambert", instances > 0 ? 6 : (gpuwiggle > 0 ? 7 : (vformat == 2 ? 5 : (vformat == 1 ? 4 : 1))), backend == 1 ? "cpu" : "gl");
+        next = hud.last + 250000000;
+    }
+    hudBegin();
+    hudRect(8, 8, 8*HUD_GW + HUD_GRAPH, 4*HUD_GH + 64, HUD_SHADE);
+    hudText(12, 12, "%s", line[0]);
+    hudText(12, 12 + HUD_GH, "%s", line[1]);
+    hudText(12, 12 + 2*HUD_GH, "wiggle mode %u iter %u ws %.2f", mode, iter, ws);
+    hudGraph(12, 16 + 3*HUD_GH, HUD_GRAPH, 56, (f32)(1000.0 / maxfps));
+    hudDraw(winw, winh, lit_program, blend_on, GL_SRC_ALPHA, GL_ONE); // the state main() and the A/S keys left
+}
+
+//*************************************
+// simulation
+//*************************************
+void simStep(SimState* s, const f32 dt)
+{
+#ifdef FUN
+    s->tft += dt;
+    s->yrot += sinf(s->tft*0.001f)*-s->ss;
+    s->ss += dt*0.000001f;
+#else
+    s->tft += dt*s->ss;
+    s->yrot = sinf(s->tft)*100.f;
+    s->ss += dt*0.001f;
+#endif
+    s->xrot += dt*0.01f;
+    s->r = clamp(s->r + crandfc(sim_key, &s->ctr)*dt*1.6f, -1.f, 1.f);
+    s->g = clamp(s->g + crandfc(sim_key, &s->ctr)*dt*1.6f, -1.f, 1.f);
+    s->b = clamp(s->b + crandfc(sim_key, &s->ctr)*dt*1.6f, -1.f, 1.f);
+}
+
+void simPublish(const SimState* a, const SimState* b, const int64_t tb)
+{
+    // seqlock on the slot, the renderer retries if it catches a write
+    const unsigned i = 1 - atomic_load_explicit(&sim_latest, memory_order_relaxed);
+    SimSlot* sl = &sim_slot[i];
+    const unsigned seq = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+    atomic_store_explicit(&sl->seq, seq+1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    sl->a = *a, sl->b = *b, sl->tb = tb;
+    atomic_store_explicit(&sl->seq, seq+2, memory_order_release);
+    atomic_store_explicit(&sim_latest, i, memory_order_release);
+}
+
+void simRead(SimState* a, SimState* b, int64_t* tb)
+{
+    while(1)
+    {
+        SimSlot* sl = &sim_slot[atomic_load_explicit(&sim_latest, memory_order_acquire)];
+        const unsigned seq = atomic_load_explicit(&sl->seq, memory_order_acquire);
+        if(seq & 1){continue;}
+        *a = sl->a, *b = sl->b, *tb = sl->tb;
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&sl->seq, memory_order_relaxed) == seq){return;}
+    }
+}
+
+SimState simInit()
+{
+    SimState s = {xrot, yrot, 0.08f, 0.f, r, g, b, 3}; // the first 3 of the stream are the starting colour
+#ifndef FUN
+    s.tft = -1.3f;
+    s.yrot = sinf(s.tft)*100.f; // [1]
+#endif
+    return s;
+}
+
+void simVirtual(SimState* a, SimState* b, f32* alpha)
+{
+    // --render-frames steps the simulation here to the virtual time, no thread and no clock
+    static SimState s, p;
+    static uint64_t ticks = 0;
+    if(ticks == 0){s = simInit(); p = s;}
+    const double tt = t * SIM_HZ;
+    const uint64_t need = (uint64_t)tt + 1;
+
+    // a worker starting mid sequence replays every tick before its first frame, a closed
+    // form would not round the float sums the same and the colour walk clamps
+    const uint64_t from = ticks;
+    const int64_t st = pacerNow();
+    while(ticks < need)
+    {
+        p = s;
+        simStep(&s, SIM_DT);
+        ticks++;
+    }
+    if(from == 0 && need > 1)
+        printf("sim: fast-forwarded %lu ticks in %.3f ms\n", (unsigned long)need, (double)(pacerNow() - st) * 1e-6);
+    *a = p, *b = s;
+    *alpha = (f32)(tt - floor(tt));
+}
+
+void* simMain(void* arg)
+{
+    traceThread("sim");
+    SimState s = simInit();
+    f32 lookx = 0.f, looky = 0.f;
+    pacerInit(&sim_pacer, SIM_HZ, PACER_CATCHUP);
+    simPublish(&s, &s, sim_pacer.last);
+    while(atomic_load(&sim_run) == 1)
+    {
+        pacerWait(&sim_pacer);
+        traceBegin("tick");
+        const SimState p = s;
+        if(atomic_exchange(&sim_recolour, 0) == 1)
+            s.r = crandfc(sim_key, &s.ctr), s.g = crandfc(sim_key, &s.ctr), s.b = crandfc(sim_key, &s.ctr);
+        const f32 lx = sim_lookx, ly = sim_looky;
+        s.xrot += lx - lookx, s.yrot += ly - looky;
+        lookx = lx, looky = ly;
+        if(focus_cursor == 0)
+            simStep(&s, SIM_DT);
+        simPublish(&p, &s, sim_pacer.last);
+        traceEnd();
+    }
+    return NULL;
+}
+
 //*************************************
 // update & render
 //*************************************
-void main_loop(uint dotick)
+void main_loop()
 {
+    profBegin();
+
 //*************************************
 // camera
 //*************************************
     if(focus_cursor == 1)
     {
+        static f32 lookx = 0.f, looky = 0.f;
         glfwGetCursorPos(window, &x, &y);
-        xrot += (ww2-x)*sens;
-        yrot += (wh2-y)*sens;
+        lookx += (ww2-x)*sens;
+        looky += (wh2-y)*sens;
+        sim_lookx = lookx;
+        sim_looky = looky;
         glfwSetCursorPos(window, ww2, wh2);
     }
 
+    // draw the state one tick behind the simulation, blended between its last two ticks
+    SimState sa, sb;
+    f32 alpha;
+    if(render_fps > 0.0)
+        simVirtual(&sa, &sb, &alpha);
+    else
+    {
+        int64_t tb;
+        simRead(&sa, &sb, &tb);
+        alpha = clamp((f32)(pacerNow() - tb) * (f32)(SIM_HZ * 1e-9), 0.f, 1.f);
+    }
+    #define SIM_LERP(v) (sa.v + (sb.v - sa.v) * alpha)
+    xrot = SIM_LERP(xrot), yrot = SIM_LERP(yrot);
+    r = SIM_LERP(r), g = SIM_LERP(g), b = SIM_LERP(b);
+    const f32 ss = SIM_LERP(ss), tft = SIM_LERP(tft);
+    #undef SIM_LERP
+
     mIdent(&view);
     mTranslate(&view, 0.f, 0.f, zoom);
     mRotate(&view, yrot, 1.f, 0.f, 0.f);
     mRotate(&view, xrot, 0.f, 0.f, 1.f);
-    
-    static f32 ss = 0.08f;
-    if(focus_cursor == 0 && dotick == 1)
-    {
-#ifdef FUN
-        // this is not stable at different framerates
-        static f32 tft = 0.f;
-        tft += dt;
-        yrot += sinf(tft*0.001f)*-ss;
-        ss += dt*0.000001f;
-#else
-        // this is stable at different framerates
-        static f32 tft = -1.3f;
-        tft += dt*ss;
-        yrot = sinf(tft)*100.f;
-        ss += dt*0.001f;
-#endif
-        xrot += dt*0.01f;
-        r += urandfc()*dt*1.6f;
-        g += urandfc()*dt*1.6f;
-        b += urandfc()*dt*1.6f;
-        r = clamp(r, -1.f, 1.f);
-        g = clamp(g, -1.f, 1.f);
-        b = clamp(b, -1.f, 1.f);
-        glUniform3f(color_id, r, g, b);
-        const f32 ft = tft*0.5f;
-        glUniform3f(lightpos_id, sinf(ft) * 10.0f, cosf(ft) * 10.0f, sinf(ft) * 10.0f);
+    profMark(PROF_CAMERA);
+
+    glUniform3f(color_id, r, g, b);
+    const f32 ft = tft*0.5f;
+    lightpos = (vec){sinf(ft) * 10.0f, cosf(ft) * 10.0f, sinf(ft) * 10.0f};
+    glUniform3f(lightpos_id, lightpos.x, lightpos.y, lightpos.z);
+    if(focus_cursor == 0 && headless == 0 && hud_on == 0) // the overlay says more without a round trip to the window manager
         stepTitle(ss);
-    }
+    profMark(PROF_UPLOAD);
 
 //*************************************
 // render
 //*************************************
+    profGPUBegin();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    profMark(PROF_DRAW);
     
-    static int st = 0;
-    if(st == 0){st = time(0);}
-
-    int ts = st+(int)t;
+    // every second of the run is its own stream of the seed, each draw takes the next counter
+    const uint64_t ts = (uint64_t)t;
+    const uint64_t key = crandKey(seed, ts);
+    uint64_t ctr = 0;
     float frac = t-floorf(t);
     if(frac > 0.5f){frac -= 1.f; frac = fabsf(frac);}
-    srand(ts);
 
-    const float ws = esRandFloat(0.f, 3.f); //randf(&ts)*6.f;
-    const uint mode = esRand(0,1);
-    const uint iter = esRand(0,16);
+    const float ws = esRandFloatC(key, &ctr, 0.f, 3.f);
+    const uint mode = esRandC(key, &ctr, 0, 1);
+    const uint iter = esRandC(key, &ctr, 0, 16);
+    if(gpuwiggle > 0)
+    {
+        // the shader repeats the wiggle per vertex from these, floats hash exactly below 2^16
+        const f32 kseed = (f32)(crand(key, &ctr) & 0xffff);
+        const f32 kscale[] = {0.f, 0.f, 1.f, -1.f}; // -1 keys on the sub-cube packed by MENGER_CELLS
+        glUniform4f(wparams_id, kseed, frac, ws, (f32)mode);
+        glUniform2f(witer_id, (f32)iter, kscale[gpuwiggle]);
+    }
 
-    static int lp = 0.f;
+    static uint64_t lp = UINT64_MAX;
     if(ts != lp)
     {
         printf(":: %u %u %.2f\n", mode, iter, ws);
         lp = ts;
     }
 
-    for(uint i = 0; i < iter; i++)
+    for(uint i = 0; gpuwiggle == 0 && i < iter; i++)
     {
         if(mode == 0)
         {
-            const uint r = esRand(0,3), c = esRand(0,3);
+            const uint r = esRandC(key, &ctr, 0, 3), c = esRandC(key, &ctr, 0, 3);
             view.m[r][c] += view.m[r][c]*frac;
         }
         else
-            view.m[esRand(0,3)][esRand(0,3)] += (esRandFloat(-1.f, 1.f)*ws)*frac;
+        {
+            const uint r = esRandC(key, &ctr, 0, 3), c = esRandC(key, &ctr, 0, 3);
+            view.m[r][c] += (esRandFloatC(key, &ctr, -1.f, 1.f)*ws)*frac;
+        }
     }
 
+    profMark(PROF_WIGGLE);
+
     glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (GLfloat*) &view.m[0][0]);
+    profMark(PROF_UPLOAD);
+    mat normalmat = view;
     if(normalmat_id != -1)
     {
-        mat inverted, normalmat;
-        mInvert(&inverted.m[0][0], &view.m[0][0]);
-        mTranspose(&normalmat, &inverted);
+        mNormal(&normalmat, &view);
 
         for(uint i = 0; i < iter; i++)
         {
             if(mode == 0)
             {
-                const uint r = esRand(0,3), c = esRand(0,3);
+                const uint r = esRandC(key, &ctr, 0, 3), c = esRandC(key, &ctr, 0, 3);
                 normalmat.m[r][c] += normalmat.m[r][c]*frac;
             }
             else
-                normalmat.m[esRand(0,3)][esRand(0,3)] += (esRandFloat(-1.f, 1.f)*ws)*frac;
+            {
+                const uint r = esRandC(key, &ctr, 0, 3), c = esRandC(key, &ctr, 0, 3);
+                normalmat.m[r][c] += (esRandFloatC(key, &ctr, -1.f, 1.f)*ws)*frac;
+            }
         }
+        profMark(PROF_NORMAL);
         
         glUniformMatrix4fv(normalmat_id, 1, GL_FALSE, (GLfloat*) &normalmat.m[0][0]);
+        profMark(PROF_UPLOAD);
+    }
+    traceBegin("draw");
+    if(backend == 1)
+    {
+        // the same uniforms the lit program just took
+        const float light[] = {lightpos.x, lightpos.y, lightpos.z}, col[] = {r, g, b};
+        rasterDraw(&raster, &view, &normalmat, &projection, light, col, lit_opacity,
+            normalmat_id == -1 ? RASTER_LAMBERT : RASTER_PHONG, blend_on);
+        rasterPresent();
     }
-    glDrawElements(GL_TRIANGLES, ncube_numind, GL_UNSIGNED_INT, 0);
+    else if(instances > 0)
+        glDrawElementsInstanced(GL_TRIANGLES, menger.numind, GL_UNSIGNED_INT, 0, instances);
+    else
+        glDrawElements(GL_TRIANGLES, menger.numind, GL_UNSIGNED_INT, 0);
+    profGPUEnd();
+    traceEnd();
+    profMark(PROF_DRAW);
 
-    glfwSwapBuffers(window);
+    if(record_path != NULL)
+    {
+        traceBegin("record");
+        recordFrame(&recorder);
+        traceEnd();
+    }
+    profMark(PROF_RECORD);
+    if(hud_on == 1)
+    {
+        // after the capture, it is only for the screen
+        traceBegin("hud");
+        drawHud(mode, iter, ws);
+        bindMenger();
+        traceEnd();
+        profMark(PROF_DRAW);
+    }
+    traceBegin("swap");
+    if(headless > 0)
+        glFinish(); // so the frame times are render times, not queue times
+    else
+        glfwSwapBuffers(window);
+    traceEnd();
+    profMark(PROF_SWAP);
+    profEnd();
 }
 
 //*************************************
@@ -307,44 +753,58 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
                 timestamp(&strts[0]);
                 const double nfps = fc/(t-lfct);
                 printf("[%s] FPS: %g\n", strts, nfps);
-                maxfps = nfps;
-                dt = 1.0f / (float)maxfps;
+                pacerPrint(&pacer);
+                profPrint();
                 lfct = t;
                 fc = 0;
             }
         }
         else if(key == GLFW_KEY_Z)
         {
-            shadeLambert1(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &opacity_id);
+            phong = 0;
+            shadeLit();
             glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
             glUniform3f(lightpos_id, lightpos.x, lightpos.y, lightpos.z);
-            glUniform1f(opacity_id, 1.0f);
+            lit_opacity = 1.0f;
+            glUniform1f(opacity_id, lit_opacity);
             glUniform3f(color_id, r, g, b);
-            normalmat_id = -1;
+            bindMenger();
         }
         else if(key == GLFW_KEY_X)
         {
-            shadePhong1(&position_id, &projection_id, &modelview_id, &normalmat_id, &lightpos_id, &normal_id, &color_id, &opacity_id);
+            phong = 1;
+            shadeLit();
             glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
             glUniform3f(lightpos_id, lightpos.x, lightpos.y, lightpos.z);
-            glUniform1f(opacity_id, 1.0f);
+            lit_opacity = 1.0f;
+            glUniform1f(opacity_id, lit_opacity);
             glUniform3f(color_id, r, g, b);
+            bindMenger();
         }
         else if(key == GLFW_KEY_A)
-            glDisable(GL_BLEND);
+            glDisable(GL_BLEND), blend_on = 0;
         else if(key == GLFW_KEY_S)
-            glEnable(GL_BLEND);
+            glEnable(GL_BLEND), blend_on = 1;
         else if(key == GLFW_KEY_M)
         {
-            int ts = time(0);
-            srand(ts);
-            projection.m[esRand(0,3)][esRand(0,3)] += randfc(&ts)*0.3f;
+            // its own stream of the seed, past any second of the run
+            static uint64_t mctr = 0;
+            const uint64_t mkey = crandKey(seed, UINT64_MAX);
+            const uint r = esRandC(mkey, &mctr, 0, 3), c = esRandC(mkey, &mctr, 0, 3);
+            projection.m[r][c] += crandfc(mkey, &mctr)*0.3f;
             glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
         }
+        else if(key == GLFW_KEY_H)
+        {
+            if(hud_on == 0 && hud.tex == 0 && hudInit() == 0)
+                printf("!!! failed to start the overlay !!!\n");
+            else
+                hud_on = 1 - hud_on;
+        }
         else if(key == GLFW_KEY_N)
         {
             mIdent(&projection);
-            mPerspective(&projection, 60.0f, aspect, 0.01f, FAR_DISTANCE); 
+            mPerspective(&projection, 60.0f, aspect, 0.01f, far_distance); 
             glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
         }
     }
@@ -375,10 +835,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
             glfwGetCursorPos(window, &ww2, &wh2);
         }
         else if(button == GLFW_MOUSE_BUTTON_RIGHT)
-        {
-            r = urandfc(), g = urandfc(), b = urandfc();
-            glUniform3f(color_id, r, g, b);
-        }
+            sim_recolour = 1; // picked up by the next tick
     }
 }
 
@@ -401,8 +858,92 @@ void window_size_callback(GLFWwindow* window, int width, int height)
     uh2 = 1 / wh2;
 
     mIdent(&projection);
-    mPerspective(&projection, 60.0f, aspect, 0.01f, FAR_DISTANCE);
+    mPerspective(&projection, 60.0f, aspect, 0.01f, far_distance);
     glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
+
+    if(backend == 1 && raster.threads > 0 && rasterTarget() == 0)
+        printf("!!! failed to resize the CPU frame !!!\n");
+}
+
+void renderWorkers()
+{
+    // fork the frame ranges before any context exists, each child returns here to render its own
+    const GLuint frames = headless;
+    const uint stream = strchr(record_path, '%') == NULL; // or an image sequence, which needs no putting together
+    char part[MAX_WORKERS][512];
+    pid_t pid[MAX_WORKERS];
+    if(workers > MAX_WORKERS){workers = MAX_WORKERS;}
+    if(workers > frames){workers = frames;}
+    for(uint k = 0; k < workers; k++)
+    {
+        if(strcmp(record_path, "-") == 0)
+            snprintf(part[k], sizeof(part[k]), "/tmp/wiggle.%d.part%u", (int)getpid(), k);
+        else
+            snprintf(part[k], sizeof(part[k]), "%s.part%u%s", record_path, k, recorder.kind == RECORD_Y4M ? ".y4m" : ""); // the kind is by extension
+    }
+    const double wt = getTime();
+    fflush(stdout);
+    for(uint k = 0; k < workers; k++)
+    {
+        pid[k] = fork();
+        if(pid[k] == -1){printf("fork() failed.\n"); exit(EXIT_FAILURE);}
+        if(pid[k] == 0)
+        {
+            frame0 = (GLuint)((uint64_t)frames * k / workers);
+            headless = (GLuint)((uint64_t)frames * (k+1) / workers);
+            if(backend == 1 && raster_threads == 0)
+            {
+                raster_threads = (GLuint)(sysconf(_SC_NPROCESSORS_ONLN) / workers);
+                if(raster_threads == 0){raster_threads = 1;}
+            }
+            if(stream == 1)
+            {
+                recordClose(&recorder); // the parent's, this child writes a part
+                if(recordOpen(&recorder, part[k], 1) == 0){exit(EXIT_FAILURE);}
+            }
+            recorder.frames = frame0; // image sequences are numbered from the range start
+            if(profile_path != NULL)
+            {
+                static char ppart[512];
+                snprintf(ppart, sizeof(ppart), "%s.part%u", profile_path, k);
+                profile_path = ppart;
+            }
+            if(trace_path != NULL)
+            {
+                static char tpart[512];
+                snprintf(tpart, sizeof(tpart), "%s.part%u", trace_path, k);
+                trace_path = tpart;
+            }
+            printf("worker %u: frames %u to %u\n", k, frame0, headless-1);
+            return;
+        }
+    }
+
+    // put the stream parts back together in frame order, a Y4M part repeats the header
+    uint failed = 0;
+    for(uint k = 0; k < workers; k++)
+    {
+        int status;
+        if(waitpid(pid[k], &status, 0) == -1 || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0){failed++;}
+    }
+    const double st = getTime();
+    for(uint k = 0; stream == 1 && k < workers; k++)
+    {
+        FILE* f = fopen(part[k], "rb");
+        if(f == NULL){failed++; continue;}
+        if(k > 0 && recorder.kind == RECORD_Y4M){int c; while((c = fgetc(f)) != EOF && c != '\n'){}}
+        static char buf[1 << 20];
+        size_t n;
+        while((n = fread(buf, 1, sizeof(buf), f)) > 0){fwrite(buf, 1, n, recorder.f);}
+        fclose(f);
+        unlink(part[k]);
+    }
+    recordClose(&recorder);
+    if(failed > 0){printf("%u of %u workers failed.\n", failed, workers); exit(EXIT_FAILURE);}
+    const double et = getTime() - wt;
+    printf("%u workers done, %u frames%s in %.3f s, %.1f fps.\n", workers, frames, stream == 1 ? "" : " as images", et, frames/et);
+    if(stream == 1){printf("parts joined in %.3f s.\n", getTime() - st);}
+    exit(EXIT_SUCCESS);
 }
 
 //*************************************
@@ -410,37 +951,196 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 //*************************************
 int main(int argc, char** argv)
 {
-    // allow custom msaa level
+    // allow custom msaa level and framerate cap, plus --options
     int msaa = 16;
-    if(argc >= 2){msaa = atoi(argv[1]);}
-
-    // allow framerate cap
-    if(argc >= 3){maxfps = atof(argv[2]);}
+    uint argp = 0;
+    uint level_set = 0;
+    uint seed_set = 0;
+    uint render_set = 0;
+    mInit();
+    vnInit();
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--level") == 0 && i+1 < argc)
+            level = atoi(argv[++i]), level_set = 1;
+        else if(strcmp(argv[i], "--pacing") == 0 && i+1 < argc)
+        {
+            i++;
+            if(strcmp(argv[i], "catchup") == 0){pacing = PACER_CATCHUP;}
+            else if(strcmp(argv[i], "drop") == 0){pacing = PACER_DROP;}
+            else{printf("unknown --pacing policy: %s\n", argv[i]); exit(EXIT_FAILURE);}
+        }
+        else if(strcmp(argv[i], "--spin") == 0 && i+1 < argc)
+        {
+            spin = atoll(argv[++i]) * 1000;
+            if(spin < 0){printf("--spin wants 0 or more microseconds, got: %s\n", argv[i]); exit(EXIT_FAILURE);}
+        }
+        else if(strcmp(argv[i], "--headless") == 0 && i+1 < argc)
+            headless = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--render-frames") == 0 && i+1 < argc)
+            headless = atoi(argv[++i]), render_set = 1;
+        else if(strcmp(argv[i], "--workers") == 0 && i+1 < argc)
+            workers = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--fps") == 0 && i+1 < argc)
+            render_fps = atof(argv[++i]);
+        else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+            seed = strtoull(argv[++i], NULL, 10), seed_set = 1;
+        else if(strcmp(argv[i], "--instances") == 0 && i+1 < argc)
+            instances = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--gpu-wiggle") == 0 && i+1 < argc)
+        {
+            i++;
+            if(strcmp(argv[i], "frame") == 0){gpuwiggle = 1;}
+            else if(strcmp(argv[i], "vertex") == 0){gpuwiggle = 2;}
+            else if(strcmp(argv[i], "cube") == 0){gpuwiggle = 3;}
+            else{printf("unknown --gpu-wiggle mode: %s\n", argv[i]); exit(EXIT_FAILURE);}
+        }
+        else if(strcmp(argv[i], "--backend") == 0 && i+1 < argc)
+        {
+            i++;
+            if(strcmp(argv[i], "gl") == 0){backend = 0;}
+            else if(strcmp(argv[i], "cpu") == 0){backend = 1;}
+            else{printf("unknown --backend: %s\n", argv[i]); exit(EXIT_FAILURE);}
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+            raster_threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc)
+            record_path = argv[++i];
+        else if(strcmp(argv[i], "--profile") == 0 && i+1 < argc)
+            profile_path = argv[++i];
+        else if(strcmp(argv[i], "--trace") == 0 && i+1 < argc)
+            trace_path = argv[++i];
+        else if(strcmp(argv[i], "--hud") == 0)
+            hud_on = 1;
+        else if(strcmp(argv[i], "--no-shader-cache") == 0)
+            shader_cache = 0;
+        else if(strcmp(argv[i], "--size") == 0 && i+1 < argc)
+        {
+            i++;
+            uint w, h;
+            if(sscanf(argv[i], "%hux%hu", &w, &h) != 2 || w == 0 || h == 0){printf("--size wants WxH, got: %s\n", argv[i]); exit(EXIT_FAILURE);}
+            winw = w, winh = h;
+        }
+        else if(strcmp(argv[i], "--merge") == 0)
+            meshflags |= MENGER_MERGE;
+        else if(strcmp(argv[i], "--float") == 0)
+            vformat = 0;
+        else if(strcmp(argv[i], "--faceid") == 0)
+            vformat = 1;
+        else if(strcmp(argv[i], "--bench") == 0 && i+1 < argc)
+        {
+            const int r = benchRun(argv[++i]);
+            if(r == 0){printf("unknown benchmark: %s\n", argv[i]); exit(EXIT_FAILURE);}
+            if(r == 2){printf("benchmark %s failed its correctness check\n", argv[i]); exit(EXIT_FAILURE);}
+            exit(EXIT_SUCCESS);
+        }
+        else if(argp == 0){msaa = atoi(argv[i]); argp++;}
+        else if(argp == 1){maxfps = atof(argv[i]); argp++;}
+    }
+    if(backend == 1)
+    {
+        // the rasteriser reads the float mesh and shades like Lambert1 / Phong1
+        if(instances > 0 || gpuwiggle > 0){printf("--instances and --gpu-wiggle are ignored with --backend cpu.\n");}
+        instances = 0, gpuwiggle = 0, vformat = 0;
+    }
+    if(instances > 0)
+    {
+        if(level_set == 0){level = 1;} // ten thousand L3 sponges is 360 million triangles
+        if(gpuwiggle == 0){gpuwiggle = 1;} // each instance keys the gpu wiggle on its own seed
+    }
+    if(gpuwiggle > 0){vformat = 1;} // the kernel wiggles per vertex, derivative normals would need it per fragment
+    if(gpuwiggle == 3){meshflags |= MENGER_CELLS;} // unshared vertices and a sub-cube id per vertex
+    if(render_set == 1 && render_fps == 0.0){render_fps = maxfps;} // after the loop, --fps and a positional maxfps may follow
+    if(render_fps > 0.0)
+    {
+        // offline, every frame to an image unless --record says otherwise
+        if(headless == 0){printf("--fps needs --render-frames N.\n"); exit(EXIT_FAILURE);}
+        if(record_path == NULL){record_path = "frame_%05u.ppm";}
+        maxfps = render_fps;
+    }
+    if(seed_set == 0){seed = time(0);}
+    sim_key = crandKey(seed, UINT64_MAX - 1);
+    if(record_path != NULL && recordOpen(&recorder, record_path, render_fps > 0.0) == 0){exit(EXIT_FAILURE);} // before the help, - moves it to stderr
+    sprintf(title, "L%u Menger Cube", level);
 
     // help
     printf("----\n");
-    printf("L3 Menger Cube\n");
+    printf("%s\n", title);
     printf("----\n");
     printf("James William Fletcher (github.com/mrbid)\n");
     printf("----\n");
     printf("Argv(2): msaa, maxfps\n");
     printf("e.g; ./uc 16 60\n");
+    printf("--level N = Menger sponge level 0-%u.\n", MENGER_MAX_LEVEL);
+    printf("--merge = Merge coplanar faces into rectangles (not pixel exact).\n");
+    printf("--float = Upload float positions and normals instead of packed lattice bytes.\n");
+    printf("--faceid = Pack a face id per vertex instead of using derivative normals.\n");
+    printf("--instances N = Draw N sponges in one instanced draw call, each with its own GPU wiggle seed (OpenGL 3.3, default level 1).\n");
+    printf("--pacing catchup|drop = Late frames catch up with the clock (default) or skip missed deadlines.\n");
+    printf("--spin US = Spin this many microseconds before each deadline instead of sleeping (default %d).\n", PACER_SPIN_NS/1000);
+    printf("--headless N = Render N frames offscreen through EGL as fast as possible, print throughput and exit (no msaa).\n");
+    printf("--seed S = Wiggle seed, the same seed gives the same wiggle every run (%lu this run).\n", (unsigned long)seed);
+    printf("--gpu-wiggle frame|vertex|cube = Wiggle in the vertex shader, the same for the frame, each vertex or each sub-cube.\n");
+    printf("--backend gl|cpu = Draw with OpenGL (default) or the multithreaded CPU rasteriser, Lambert1 / Phong1 only.\n");
+    printf("--threads N = CPU rasteriser threads (default one per core).\n");
+    printf("--render-frames N = Render N frames offscreen on a virtual clock and save them (default frame_%%05u.ppm), exit.\n");
+    printf("--fps F = Virtual clock rate of --render-frames (default maxfps), the same seed and fps give the same frames.\n");
+    printf("--workers K = Split --render-frames into K ranges rendered by K processes, the output is put back in order.\n");
+    printf("--size WxH = Window or offscreen size (default 1024x768).\n");
+    printf("--record out.y4m|out.rgb|-|out%%05u.ppm|out%%05u.png = Capture every frame at the start size, Y4M, raw rgb24, - is rgb24 to stdout, %% is an image sequence.\n");
+    printf("--profile out.csv = Time the frame stages on the CPU and the draw on the GPU, CSV of the last %d frames on exit.\n", PROF_FRAMES);
+    printf("--trace out.json = Trace the frame loop, the sleep and spin of each wait, the polls and the swaps, for chrome://tracing or ui.perfetto.dev.\n");
+    printf("--hud = Start with the overlay of frame times, triangles, wiggle and shader on, H toggles it.\n");
+    printf("--no-shader-cache = Always compile the shaders, not load linked programs from $XDG_CACHE_HOME/wiggle.\n");
+    printf("--bench menger|rng|raster|mat|vec|math = Print benchmark and exit.\n");
     printf("----\n");
     printf("Left Click = Focus toggle camera control\n");
     printf("Right Click = Random Colour\n");
-    printf("F = FPS to console.\n");
+    printf("F = FPS to console, and stage times with --profile.\n");
     printf("A = Opaque.\n");
     printf("S = Transparent.\n");
     printf("Z = Lambertian Shading.\n");
     printf("X = Phong Shading.\n");
+    printf("H = Overlay of frame times, triangles, wiggle and shader.\n");
     printf("----\n");
 
+    if(render_fps > 0.0 && workers > 1)
+        renderWorkers();
+    if(trace_path != NULL)
+    {
+        traceInit();
+        traceThread("main");
+        traceBegin("startup");
+    }
+
+    int glversion;
+    GLADloadfunc glload;
+    if(headless > 0)
+    {
+        // offscreen, no glfw at all
+        if(hlInit() == 0){hlDestroy(); exit(EXIT_FAILURE);}
+        glload = hlGetProcAddress;
+        glversion = gladLoadGL(glload);
+        if(glversion == 0 || hlFramebuffer(winw, winh) == 0){hlDestroy(); exit(EXIT_FAILURE);}
+    }
+    else
+    {
+
     // init glfw
     if(!glfwInit()){printf("glfwInit() failed.\n"); exit(EXIT_FAILURE);}
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+    if(instances > 0)
+    {
+        // instanced arrays are core in 3.3, the compatibility profile keeps our #version 100 shaders working
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    }
+    else
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+    }
     glfwWindowHint(GLFW_SAMPLES, msaa);
-    window = glfwCreateWindow(winw, winh, "L3 Menger Cube", NULL, NULL);
+    window = glfwCreateWindow(winw, winh, title, NULL, NULL);
     if(!window)
     {
         printf("glfwCreateWindow() failed.\n");
@@ -454,12 +1154,21 @@ int main(int argc, char** argv)
     glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwMakeContextCurrent(window);
-    gladLoadGL(glfwGetProcAddress);
+    glload = (GLADloadfunc)glfwGetProcAddress;
+    glversion = gladLoadGL(glload);
     glfwSwapInterval(0); // 0 for immediate updates, 1 for updates synchronized with the vertical retrace, -1 for adaptive vsync
 
     // set icon
     glfwSetWindowIcon(window, 1, &(GLFWimage){16, 16, (unsigned char*)&icon_image.pixel_data});
 
+    }
+    if(instances > 0 && glversion < GLAD_MAKE_VERSION(3, 3))
+    {
+        printf("--instances needs OpenGL 3.3, got %d.%d.\n", GLAD_VERSION_MAJOR(glversion), GLAD_VERSION_MINOR(glversion));
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
 //*************************************
 // projection
 //*************************************
@@ -467,21 +1176,96 @@ int main(int argc, char** argv)
     window_size_callback(window, winw, winh);
 
 //*************************************
-// bind vertex and index buffers
+// compile & link shader programs
 //*************************************
 
-    // ***** BIND MENGER *****
-    esBind(GL_ARRAY_BUFFER, &mdlMenger.vid, ncube_vertices, sizeof(ncube_vertices), GL_STATIC_DRAW);
-    esBind(GL_ARRAY_BUFFER, &mdlMenger.nid, ncube_normals, sizeof(ncube_normals), GL_STATIC_DRAW);
-    esBind(GL_ELEMENT_ARRAY_BUFFER, &mdlMenger.iid, ncube_indices, sizeof(ncube_indices), GL_STATIC_DRAW);
+    traceBegin("shaders");
+    const int64_t sht = pacerNow();
+    if(shader_cache == 1 && esCacheInit(glload, "wiggle") == 0)
+        printf("shader cache: no program binaries here, shaders are compiled every start.\n");
+    const int parallel = esLinkInit(glload); // each program is waited for on its first use only
+    //makeAllShaders();
+    if(instances > 0)
+    {
+        makeLambert6();
+        makePhong6();
+    }
+    else if(gpuwiggle > 0)
+    {
+        makeLambert7();
+        makePhong7();
+    }
+    else if(vformat == 2)
+    {
+        // derivative normals need GL_OES_standard_derivatives and highp fragments
+        makeLambert5();
+        makePhong5();
+        esFinish(&shdLambert5);
+        esFinish(&shdPhong5);
+        if(glIsProgram(shdLambert5) == GL_FALSE || glIsProgram(shdPhong5) == GL_FALSE)
+        {
+            printf("Derivative normals unavailable, using face id normals.\n");
+            vformat = 1;
+        }
+    }
+    if(vformat == 1 && instances == 0 && gpuwiggle == 0)
+    {
+        makeLambert4();
+        makePhong4();
+    }
+    else if(vformat == 0)
+    {
+        makeLambert1();
+        makePhong1();
+    }
+    if(backend == 1)
+        makeFullbrightT();
+    traceEnd();
 
 //*************************************
-// compile & link shader programs
+// bind vertex and index buffers
 //*************************************
 
-    //makeAllShaders();
-    makeLambert1();
-    makePhong1();
+    // ***** BIND MENGER *****
+    if(vformat == 2){meshflags |= MENGER_WELD;}
+    if(mengerGenerate(&menger, level, meshflags) == 0)
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    if(vformat > 0)
+    {
+        GLubyte* q = mengerPack(&menger);
+        if(q == NULL){printf("!!! failed to pack menger vertices !!!\n"); glfwTerminate(); exit(EXIT_FAILURE);}
+        esBind(GL_ARRAY_BUFFER, &mdlMenger.vid, q, menger.numvert * 4, GL_STATIC_DRAW);
+        free(q);
+    }
+    else
+    {
+        esBind(GL_ARRAY_BUFFER, &mdlMenger.vid, menger.vertices, menger.numvert * sizeof(GLfloat) * 3, GL_STATIC_DRAW);
+        esBind(GL_ARRAY_BUFFER, &mdlMenger.nid, menger.normals, menger.numvert * sizeof(GLfloat) * 3, GL_STATIC_DRAW);
+    }
+    printf("L%u: %u triangles, %u vertices, %u vertex bytes, %zu index bytes.\n----\n", level, menger.numind/3, menger.numvert,
+        vformat > 0 ? menger.numvert * 4 : menger.numvert * 24, menger.numind * sizeof(GLuint));
+    esBind(GL_ELEMENT_ARRAY_BUFFER, &mdlMenger.iid, menger.indices, menger.numind * sizeof(GLuint), GL_STATIC_DRAW);
+    if(instances > 0)
+    {
+        if(makeInstances() == 0){printf("!!! failed to allocate instances !!!\n"); glfwTerminate(); exit(EXIT_FAILURE);}
+        window_size_callback(window, winw, winh); // far plane moved with the camera
+        printf("%u instances: %.0f triangles per frame in one draw call.\n----\n", instances, (double)instances * (menger.numind/3));
+    }
+    if(backend == 1)
+    {
+        if(rasterInit(&raster, raster_threads) == 0 || rasterTarget() == 0)
+        {
+            printf("!!! failed to start the CPU rasteriser !!!\n");
+            glfwTerminate();
+            exit(EXIT_FAILURE);
+        }
+        rasterMesh(&raster, menger.vertices, menger.normals, menger.indices, menger.numvert, menger.numind);
+        printf("CPU rasteriser: %u threads, %s spans, %ux%u tiles.\n----\n", raster.threads,
+            raster.rasterTile == rasterTileBase ? "baseline" : "AVX2", RASTER_TILE, RASTER_TILE);
+    }
 
 //*************************************
 // configure render options
@@ -494,86 +1278,141 @@ int main(int argc, char** argv)
     glClearColor(0.13f, 0.13f, 0.13f, 0.0f);
 
     // setup shader
-    shadePhong1(&position_id, &projection_id, &modelview_id, &normalmat_id, &lightpos_id, &normal_id, &color_id, &opacity_id);
+    shadeLit();
     glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
     glUniform3f(lightpos_id, lightpos.x, lightpos.y, lightpos.z);
-    glUniform1f(opacity_id, 0.5f);
+    glUniform1f(opacity_id, lit_opacity);
+    printf("shaders: %u from the cache, %u compiled", es_cache.hits, es_cache.built);
+    if(es_cache.rejected > 0){printf(" (%u cached binaries rejected by the driver)", es_cache.rejected);}
+    printf(", %u %s, %.2f ms to the first.\n----\n", es_link.waiting, parallel == 1 ? "linking in the background" : "left for their first use", (double)(pacerNow() - sht) * 1e-6);
     
     // bind menger to render
-    r = urandf(), g = urandf(), b = urandf();
+    uint64_t ctr = 0;
+    r = crandf(sim_key, &ctr), g = crandf(sim_key, &ctr), b = crandf(sim_key, &ctr);
     glUniform3f(color_id, r, g, b);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mdlMenger.vid);
-    glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(position_id);
+    if(hud_on == 1 && hudInit() == 0)
+    {
+        printf("!!! failed to start the overlay !!!\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, mdlMenger.nid);
-    glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(normal_id);
+    bindMenger();
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mdlMenger.iid);
+    if(record_path != NULL && recordStart(&recorder, winw, winh, maxfps) == 0)
+    {
+        printf("!!! failed to start recording !!!\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
 
 //*************************************
 // execute update / render loop
 //*************************************
 
     // init
-    t = glfwGetTime();
+    t = getTime();
     lfct = t;
-    dt = 1.0f / (float)maxfps; // fixed timestep delta-time
-
-#ifndef FUN
-    glfwSetWindowTitle(window, "Detecting frame rate...");
-    yrot = sinf(-1.3f)*100.f; // [1]
-    time_t ac = time(0) + 1;
-    uint fct = 0;
-#else
-    const uint fct = 1;
-#endif
+    sim_run = 1;
+    if(render_fps == 0.0 && pthread_create(&sim_thread, NULL, simMain, NULL) != 0)
+    {
+        printf("pthread_create() failed.\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
     
+    if(profile_path != NULL && profInit(frame0) == 0)
+    {
+        printf("!!! failed to start the profiler !!!\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
     // fps accurate event loop
-    useconds_t wait_interval = 1000000 / maxfps; // fixed timestep
-    if(wait_interval == 0){wait_interval = 100;} // limited to 10,000 FPS maximum
-    useconds_t wait = wait_interval;
-    while(!glfwWindowShouldClose(window))
+    pacerInit(&pacer, maxfps, pacing); // fixed timestep
+    pacer.spin = spin;
+    fc = frame0;
+    traceEnd(); // startup
+    while(headless > 0 ? fc < headless : !glfwWindowShouldClose(window))
     {
-        usleep(wait);
-        t = glfwGetTime();
+        traceBegin("frame");
+        if(headless == 0)
+        {
+            traceBegin("wait");
+            pacerWait(&pacer);
+            traceEnd();
+            traceBegin("poll");
+            glfwPollEvents();
+            traceEnd();
+        }
+        esPoll(); // programs still linking that have finished
+        const double rt = getTime();
+        t = render_fps > 0.0 ? fc / render_fps : rt;
+        traceBegin("main_loop");
+        main_loop();
+        traceEnd();
+        if(headless > 0)
+            pacerMark(&pacer); // uncapped, the pacer only keeps the statistics
 
-#ifndef FUN
-        // auto correct max fps
-        if(time(0) > ac)
+        // frame time readout, the cost of main_loop() including the swap
+        if(instances > 0)
         {
-            const double nfps = fc/(t-lfct);
-            if(fabs(nfps - maxfps) > 6.f)
+            static double ft = 0.0, ftmax = 0.0, ftlt = 0.0;
+            static uint ftc = 0;
+            const double ms = (getTime() - rt) * 1000.0;
+            ft += ms, ftc++;
+            if(ms > ftmax){ftmax = ms;}
+            if(ftlt == 0.0){ftlt = rt;}
+            if(rt - ftlt >= 1.0)
             {
-                char strts[16];
-                timestamp(&strts[0]);
-                printf("[%s] maxfps auto corrected from %.2f to %.2f.\n", strts, maxfps, nfps);
+                printf("[%u instances] frame %.2f ms avg, %.2f ms max, %.1f fps\n", instances, ft/ftc, ftmax, ftc/(rt - ftlt));
+                ft = 0.0, ftmax = 0.0, ftc = 0, ftlt = rt;
             }
-            maxfps = nfps;
-            dt = 1.0f / (float)maxfps;
-            ac = time(0) + 6;
-            fct = 1;
         }
-#endif
-        
-        // don't tick our internal state until we know we have a decent delta-time [dt]
-        glfwPollEvents();
-        main_loop(fct);
-
-        // accurate fps
-        wait = wait_interval - (useconds_t)((glfwGetTime() - t) * 1000000.0);
-        if(wait > wait_interval)
-            wait = wait_interval;
-        //printf("%u: %u - %u\n", wait_interval, wait, (useconds_t)((glfwGetTime() - t) * 1000000.0));
-        
+
+        traceEndArg("frame", (int64_t)fc);
         fc++;
     }
 
     // done
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    sim_run = 0;
+    if(render_fps == 0.0)
+        pthread_join(sim_thread, NULL);
+    if(backend == 1)
+        rasterFree(&raster);
+    if(hud.tex != 0)
+        hudFree();
+    if(record_path != NULL)
+        recordClose(&recorder);
+    if(profile_path != NULL)
+    {
+        profPrint();
+        profDump(profile_path);
+        profFree();
+    }
+    if(trace_path != NULL)
+    {
+        traceWrite(trace_path); // every traced thread has stopped
+        traceFree();
+    }
+    if(headless > 0)
+    {
+        float p50, p99, max;
+        pacerStats(&pacer, &p50, &p99, &max);
+        const double et = getTime() - lfct;
+        const GLuint frames = headless - frame0;
+        printf("headless: %u frames in %.3f s, %.1f fps, %.0f triangles/s, frame p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            frames, et, frames/et, (double)frames * (instances > 0 ? instances : 1) * (menger.numind/3) / et, p50, p99, max);
+        hlDestroy();
+    }
+    else
+        pacerPrint(&pacer);
+    if(headless == 0) // glfw never ran headless
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
     exit(EXIT_SUCCESS);
     return 0;
 }
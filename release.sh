@@ -1,3 +1,3 @@
-clang main.c glad_gl.c -I inc -Ofast -lglfw -lm -o wiggle
+clang main.c glad_gl.c -I inc -Ofast -lglfw -lm -lpthread -ldl -o wiggle
 strip --strip-unneeded wiggle
 upx --lzma --best wiggle
\ No newline at end of file